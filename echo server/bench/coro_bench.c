@@ -0,0 +1,170 @@
+#include "../header.h"
+#include "../coro.h"
+
+/*
+cost of the coroutine layer (coro.h) per message , ns/op
+
+    ./coro_bench [iterations]
+
+"coroutine" rows resume a handler which waits for readable , takes one msg and waits again ,
+that is what the loop does for every msg of a connection run as a coroutine .
+"state machine" is the same handler written by hand (switch on a state int) , the cost without coro.h .
+"spread" resumes the handlers of all FD_SETSIZE slots in turn , so the coroutine state is not always in L1
+*/
+static volatile long sink;
+static long msg_value;
+
+static long long mono_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+// ------------------------------ handlers ------------------------------
+static long handler_sum[FD_SETSIZE];
+
+static int echo_co(coro* c, int slot, void* arg)
+    {
+    (void)arg;
+    CORO_BEGIN(c);
+    for (;;) {
+        CORO_WAIT_READ(c);
+        handler_sum[slot] += msg_value;
+        }
+    CORO_END(c);
+    }
+
+// same as echo_co , with a timer re-armed per msg (idle timeout of a connection)
+static int echo_timer_co(coro* c, int slot, void* arg)
+    {
+    (void)arg;
+    CORO_BEGIN(c);
+    for (;;) {
+        coro_timeout(c, 30 * 1000000LL);
+        CORO_WAIT_READ(c);
+        if (c->timed_out) {
+            CORO_EXIT(c, CORO_ERROR);
+            }
+        handler_sum[slot] += msg_value;
+        }
+    CORO_END(c);
+    }
+
+typedef struct hand_state {
+    int state;   // 0 = start , 1 = waiting for msg
+    }hand_state;
+
+static hand_state hand[FD_SETSIZE];
+
+static int __attribute__((noinline)) echo_hand(int slot)
+    {
+    switch (hand[slot].state) {
+        case 0:
+            hand[slot].state = 1;
+            return CORO_WAIT;
+        case 1:
+            handler_sum[slot] += msg_value;
+            return CORO_WAIT;
+        }
+    return CORO_DONE;
+    }
+
+// ------------------------------ cases ------------------------------
+static coro_sched sched;
+
+static void spawn_all(coro_fn fn, int slots)
+    {
+    memset(&sched, 0, sizeof(sched));
+    for (int i = 0;i < slots;i++) {
+        coro_spawn(&sched, i, fn, NULL);
+        coro_resume(&sched, i, CORO_EV_START);
+        }
+    }
+
+static void run_coro_one(long n)
+    {
+    spawn_all(echo_co, 1);
+    for (long k = 0;k < n;k++) {
+        msg_value = k;
+        sink += coro_resume(&sched, 0, CORO_EV_READ);
+        }
+    }
+
+static void run_coro_timer(long n)
+    {
+    spawn_all(echo_timer_co, 1);
+    for (long k = 0;k < n;k++) {
+        msg_value = k;
+        sink += coro_resume(&sched, 0, CORO_EV_READ);
+        }
+    }
+
+static void run_coro_spread(long n)
+    {
+    spawn_all(echo_co, FD_SETSIZE);
+    for (long k = 0;k < n;k++) {
+        msg_value = k;
+        sink += coro_resume(&sched, (int)(k % FD_SETSIZE), CORO_EV_READ);
+        }
+    }
+
+static void run_hand_one(long n)
+    {
+    memset(hand, 0, sizeof(hand));
+    echo_hand(0);
+    for (long k = 0;k < n;k++) {
+        msg_value = k;
+        sink += echo_hand(0);
+        }
+    }
+
+static void run_hand_spread(long n)
+    {
+    memset(hand, 0, sizeof(hand));
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        echo_hand(i);
+        }
+    for (long k = 0;k < n;k++) {
+        msg_value = k;
+        sink += echo_hand((int)(k % FD_SETSIZE));
+        }
+    }
+
+typedef struct bench_case {
+    const char* name;
+    void (*fn)(long);
+    }bench_case;
+
+int main(int argc, char* argv[])
+    {
+    long iters = (argc > 1) ? atol(argv[1]) : 20000000;
+    bench_case cases[] = {
+        { "coroutine resume+wait", run_coro_one },
+        { "coroutine + timer re-arm", run_coro_timer },
+        { "coroutine , 1024 slots", run_coro_spread },
+        { "state machine", run_hand_one },
+        { "state machine , 1024 slots", run_hand_spread },
+        };
+    printf("%-30s %10s\n", "case", "ns/msg");
+    for (size_t c = 0;c < sizeof(cases) / sizeof(cases[0]);c++) {
+        // warm up caches / branch predictors
+        cases[c].fn(iters / 10);
+        // best of 3 , the least disturbed run
+        double best = 1e30;
+        for (int r = 0;r < 3;r++) {
+            long long t0 = mono_ns();
+            cases[c].fn(iters);
+            double ns = (double)(mono_ns() - t0) / (double)iters;
+            if (ns < best) {
+                best = ns;
+                }
+            }
+        printf("%-30s %10.2f\n", cases[c].name, best);
+        }
+    long total = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        total += handler_sum[i];
+        }
+    return (int)((sink + total) & 0);
+    }
@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../handshake.h"
+
+/*
+ns per op of the handshake codec (handshake.h)
+
+    ./handshake_bench [iterations]
+
+"legacy" rows run the old combine_msg / break_meta_d way (strlen + strcat on a shared buffer ,
+strndup + strdup per parse) so the two can be compared on the same machine
+*/
+static volatile size_t sink;
+
+static long long mono_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+static const char* bench_name = "alice";
+static const char* bench_uuid = "3f2b8c1e-9a4d-4c61-b0e2-7d5f19a3c8e4";
+static const char* bench_server = "chatserver";
+
+// ------------------------------ legacy code path ------------------------------
+static int legacy_combine(char* msg, const char* new_msg)
+    {
+    int size_dest = strlen(msg), size_src = strlen(new_msg);
+    if (size_dest + size_src + 1 < 256) {
+        strcat(msg, HS_SEP);
+        strcat(msg, new_msg);
+        return 1;
+        }
+    return 0;
+    }
+
+static int legacy_break(const char* buffer, char** name, char** uuid)
+    {
+    const char* ptr = strstr(buffer, HS_SEP);
+    if (!ptr) {
+        return 0;
+        }
+    *name = strndup(buffer, (size_t)(ptr - buffer));
+    *uuid = strdup(ptr + HS_SEP_LEN);
+    return 1;
+    }
+
+// ------------------------------ cases ------------------------------
+static void run_encode_hello(long n)
+    {
+    char out[HS_MSG_MAX + 1];
+    size_t nl = strlen(bench_name), ul = strlen(bench_uuid);
+    for (long k = 0;k < n;k++) {
+        sink += (size_t)hs_encode_hello(out, sizeof(out), bench_name, nl, bench_uuid, ul);
+        }
+    }
+
+static void run_decode_hello(long n)
+    {
+    char msg[HS_MSG_MAX + 1];
+    int len = hs_encode_hello(msg, sizeof(msg), bench_name, strlen(bench_name), bench_uuid, strlen(bench_uuid));
+    hs_hello h;
+    for (long k = 0;k < n;k++) {
+        sink += (size_t)hs_decode_hello(msg, (size_t)len, &h) + h.uuid_len;
+        }
+    }
+
+static void run_encode_welcome(long n)
+    {
+    char out[HS_MSG_MAX + 1];
+    size_t sl = strlen(bench_server);
+    for (long k = 0;k < n;k++) {
+        sink += (size_t)hs_encode_welcome(out, sizeof(out), bench_server, sl, (int)(k % 7));
+        }
+    }
+
+static void run_decode_welcome(long n)
+    {
+    char msg[HS_MSG_MAX + 1];
+    int len = hs_encode_welcome(msg, sizeof(msg), bench_server, strlen(bench_server), 3);
+    hs_welcome w;
+    for (long k = 0;k < n;k++) {
+        sink += (size_t)hs_decode_welcome(msg, (size_t)len, &w) + (size_t)w.color;
+        }
+    }
+
+static void run_legacy_encode(long n)
+    {
+    char buf[256];
+    strcpy(buf, bench_server);
+    size_t base = strlen(buf);
+    for (long k = 0;k < n;k++) {
+        char code[2] = { (char)('0' + k % 7), '\0' };
+        sink += (size_t)legacy_combine(buf, code);
+        // old meta_buffer_refresh()
+        buf[base] = '\0';
+        }
+    }
+
+static void run_legacy_decode(long n)
+    {
+    char msg[256];
+    snprintf(msg, sizeof(msg), "%s%s%s", bench_name, HS_SEP, bench_uuid);
+    for (long k = 0;k < n;k++) {
+        char* name = NULL;
+        char* uuid = NULL;
+        sink += (size_t)legacy_break(msg, &name, &uuid);
+        free(name);
+        free(uuid);
+        }
+    }
+
+typedef struct bench_case {
+    const char* name;
+    void (*fn)(long);
+    }bench_case;
+
+int main(int argc, char* argv[])
+    {
+    long iters = (argc > 1) ? atol(argv[1]) : 5000000;
+    bench_case cases[] = {
+        { "hs_encode_hello", run_encode_hello },
+        { "hs_decode_hello", run_decode_hello },
+        { "hs_encode_welcome", run_encode_welcome },
+        { "hs_decode_welcome", run_decode_welcome },
+        { "legacy combine_msg (welcome)", run_legacy_encode },
+        { "legacy break_meta_d (hello)", run_legacy_decode },
+        };
+    printf("%-30s %10s\n", "case", "ns/op");
+    for (size_t c = 0;c < sizeof(cases) / sizeof(cases[0]);c++) {
+        // warm up caches / branch predictors
+        cases[c].fn(iters / 10);
+        // best of 3 , the least disturbed run
+        double best = 1e30;
+        for (int r = 0;r < 3;r++) {
+            long long t0 = mono_ns();
+            cases[c].fn(iters);
+            double ns = (double)(mono_ns() - t0) / (double)iters;
+            if (ns < best) {
+                best = ns;
+                }
+            }
+        printf("%-30s %10.1f\n", cases[c].name, best);
+        }
+    return (int)(sink & 0);
+    }
@@ -0,0 +1,147 @@
+#include "../header.h"
+#include <poll.h>
+#include <netinet/tcp.h>
+
+/*
+one way latency through the server : sender client -> server -> receiver client
+(both clients in this process , same host , so both ends read the same monotonic clock)
+
+    ./latency_bench <server_ip> <port> [-n msgs] [-i interval_us] [-w warmup]
+
+every msg carries its send time , the next msg is sent only after the previous one arrived
+and interval_us passed , so the server sleeps between msgs (that is where the wakeup path shows)
+run it once against "server <port>" and once against "server <port> -L <cpu>" and compare
+*/
+typedef struct bench_opts {
+    int msgs;
+    int interval_us;
+    int warmup;
+    }bench_opts;
+
+static long long mono_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+// connect + handshake , return -1 on Error
+int bench_connect(const struct sockaddr_in* addr, const char* name)
+    {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) < 0) {
+        perror("connect");
+        return -1;
+        }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    char hs[128];
+    int n = snprintf(hs, sizeof(hs), "%s%sbench-%d-%s", name, MSG_SEPRATE, (int)getpid(), name);
+    if (send(fd, hs, (size_t)n, 0) != n || recv(fd, hs, sizeof(hs), 0) <= 0) {
+        perror("handshake");
+        close(fd);
+        return -1;
+        }
+    return fd;
+    }
+
+static int cmp_ll(const void* a, const void* b)
+    {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+    }
+
+// wait for one full line on fd , return send time found in it (-1 = Error)
+long long recv_stamp(int fd, char* acc, size_t* acc_len, size_t cap)
+    {
+    for (;;) {
+        char* nl = memchr(acc, '\n', *acc_len);
+        if (nl) {
+            long long t = strtoll(acc, NULL, 10);
+            size_t used = (size_t)(nl - acc) + 1;
+            memmove(acc, nl + 1, *acc_len - used);
+            *acc_len -= used;
+            return t;
+            }
+        struct pollfd p = { .fd = fd, .events = POLLIN };
+        if (poll(&p, 1, 2000) <= 0) {
+            fprintf(stderr, "[%sError%s] | No msg from server in 2 s\n", FG_RED, RESET);
+            return -1;
+            }
+        ssize_t n = recv(fd, acc + *acc_len, cap - *acc_len, 0);
+        if (n <= 0) {
+            return -1;
+            }
+        *acc_len += (size_t)n;
+        }
+    }
+
+int main(int argc, char* argv[])
+    {
+    if (argc < 3) {
+        fprintf(stderr, "%sUsage : %s <server_ip> <port> [-n msgs] [-i interval_us] [-w warmup]%s\n", FG_RED, argv[0], RESET);
+        return 2;
+        }
+    bench_opts o = { .msgs = 20000, .interval_us = 200, .warmup = 500 };
+    for (int k = 3;k + 1 < argc;k += 2) {
+        if (strcmp(argv[k], "-n") == 0) o.msgs = atoi(argv[k + 1]);
+        else if (strcmp(argv[k], "-i") == 0) o.interval_us = atoi(argv[k + 1]);
+        else if (strcmp(argv[k], "-w") == 0) o.warmup = atoi(argv[k + 1]);
+        }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &addr.sin_addr) != 1) {
+        fprintf(stderr, "[%sError%s] | Bad address %s\n", FG_RED, RESET, argv[1]);
+        return 2;
+        }
+    int tx = bench_connect(&addr, "tx");
+    int rx = bench_connect(&addr, "rx");
+    if (tx < 0 || rx < 0) {
+        return 1;
+        }
+    // server needs a moment to mark both slots ready
+    usleep(100000);
+
+    long long* lat = (long long*)malloc(sizeof(long long) * (size_t)o.msgs);
+    char acc[4096];
+    size_t acc_len = 0;
+    int got = 0;
+    for (int k = 0;k < o.warmup + o.msgs;k++) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "%lld\n", mono_ns());
+        if (send(tx, line, (size_t)n, MSG_NOSIGNAL) != n) {
+            perror("send");
+            break;
+            }
+        long long sent_at = recv_stamp(rx, acc, &acc_len, sizeof(acc));
+        if (sent_at < 0) {
+            break;
+            }
+        if (k >= o.warmup) {
+            lat[got++] = mono_ns() - sent_at;
+            }
+        // let the server go idle again
+        long long until = mono_ns() + (long long)o.interval_us * 1000;
+        while (o.interval_us > 0 && mono_ns() < until) {
+            usleep((useconds_t)(o.interval_us > 50 ? o.interval_us / 2 : 1));
+            }
+        }
+    if (got == 0) {
+        return 1;
+        }
+    qsort(lat, (size_t)got, sizeof(long long), cmp_ll);
+    double sum = 0;
+    for (int k = 0;k < got;k++) {
+        sum += (double)lat[k];
+        }
+    printf("msgs=%d interval=%dus  one way latency (us) : p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f mean=%.1f\n",
+        got, o.interval_us,
+        lat[got / 2] / 1000.0, lat[(size_t)(got * 0.90)] / 1000.0, lat[(size_t)(got * 0.99)] / 1000.0,
+        lat[(size_t)(got * 0.999)] / 1000.0, lat[got - 1] / 1000.0, sum / got / 1000.0);
+    free(lat);
+    close(tx);
+    close(rx);
+    return 0;
+    }
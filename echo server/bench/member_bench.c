@@ -0,0 +1,265 @@
+#include "../header.h"
+#include "../members.h"
+#include <pthread.h>
+
+/*
+fan out threads reading the room members while one writer joins / leaves members (members.h)
+
+    ./member_bench [-r readers] [-m members] [-t seconds]
+
+every reader "fans out" msgs : walks the member list and counts one delivery per member slot .
+the writer flips a random slot (join or leave) churn times per second and publishes the new list .
+each case runs with three kinds of list :
+    rcu    : member_set snapshots , readers enter / leave an epoch , old sets freed by the writer
+    rwlock : one list changed in place , readers under a read lock , the writer under the write lock
+    mutex  : same list under one mutex
+msgs/s of all readers together , member visits per second , and for rcu the sets published / freed .
+use after free check : a freed set is poisoned (magic , slots = -1) , a reader checks magic and the
+sum of the slots it walked against the sum in the set after every msg ("bad" must stay 0) .
+build with -fsanitize=address as well , that stops on the first read of a freed set :
+    gcc -O2 -pthread bench/member_bench.c -o bench/member_bench
+    gcc -O1 -g -fsanitize=address -pthread bench/member_bench.c -o bench/member_bench_asan
+*/
+#define BENCH_SLOTS   FD_SETSIZE
+#define READERS_MAX   MSET_READERS
+
+enum list_kind {
+    LK_RCU = 0,
+    LK_RWLOCK,
+    LK_MUTEX,
+    LK_COUNT
+    };
+
+static const char* const kind_names[LK_COUNT] = { "rcu", "rwlock", "mutex" };
+
+typedef struct bench_room {
+    int kind;
+    long churn;                   // flips per second , -1 = as fast as it goes
+    atomic_bool stop;
+    member_rcu rcu;
+    // rwlock / mutex : one list changed in place
+    pthread_rwlock_t rw;
+    pthread_mutex_t mu;
+    int slot[BENCH_SLOTS];
+    int count;
+    uint64_t sum;
+    // writer side
+    bool in[BENCH_SLOTS];
+    unsigned long flips;
+    unsigned long full;           // rcu publish refused , retired list full
+    }bench_room;
+
+typedef struct reader_arg {
+    bench_room* room;
+    int id;
+    unsigned long msgs;
+    unsigned long long visits;
+    unsigned long bad;
+    long delivered[BENCH_SLOTS];  // per member slot , what a fan out would queue
+    }reader_arg;
+
+static long long mono_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+// slots of the members , ascending
+static int room_list(const bench_room* r, int* slots)
+    {
+    int n = 0;
+    for (int i = 0;i < BENCH_SLOTS;i++) {
+        if (r->in[i]) {
+            slots[n++] = i;
+            }
+        }
+    return n;
+    }
+
+// one join or leave , published the way the list kind does it
+static void room_flip(bench_room* r, int i)
+    {
+    r->in[i] = !r->in[i];
+    r->flips++;
+    int slots[BENCH_SLOTS];
+    int n = room_list(r, slots);
+    if (r->kind == LK_RCU) {
+        member_set* next = mset_build(r->flips, slots, n);
+        while (next && !mset_publish(&r->rcu, next)) {
+            r->full++;
+            sched_yield();
+            }
+        return;
+        }
+    uint64_t sum = 0;
+    for (int k = 0;k < n;k++) {
+        sum += (uint64_t)slots[k];
+        }
+    if (r->kind == LK_RWLOCK) {
+        pthread_rwlock_wrlock(&r->rw);
+        }
+    else {
+        pthread_mutex_lock(&r->mu);
+        }
+    memcpy(r->slot, slots, (size_t)n * sizeof(int));
+    r->count = n;
+    r->sum = sum;
+    if (r->kind == LK_RWLOCK) {
+        pthread_rwlock_unlock(&r->rw);
+        }
+    else {
+        pthread_mutex_unlock(&r->mu);
+        }
+    }
+
+static void* writer_main(void* p)
+    {
+    bench_room* r = p;
+    unsigned int seed = 12345;
+    long long gap = (r->churn > 0) ? 1000000000LL / r->churn : 0;
+    long long next = mono_ns();
+    while (!atomic_load_explicit(&r->stop, memory_order_relaxed)) {
+        if (r->churn == 0) {
+            usleep(1000);
+            continue;
+            }
+        if (gap > 0) {
+            long long now = mono_ns();
+            if (now < next) {
+                if (next - now > 50000) {
+                    usleep((useconds_t)((next - now) / 1000));
+                    }
+                continue;
+                }
+            next += gap;
+            }
+        room_flip(r, (int)(rand_r(&seed) % BENCH_SLOTS));
+        }
+    return NULL;
+    }
+
+// fan out of one msg over a member list , return the sum of the slots it walked
+static inline uint64_t fan_out(reader_arg* a, const int* slot, int count)
+    {
+    uint64_t sum = 0;
+    for (int k = 0;k < count;k++) {
+        a->delivered[slot[k]]++;
+        sum += (uint64_t)slot[k];
+        }
+    a->visits += (unsigned long long)count;
+    return sum;
+    }
+
+static void* reader_main(void* p)
+    {
+    reader_arg* a = p;
+    bench_room* r = a->room;
+    while (!atomic_load_explicit(&r->stop, memory_order_relaxed)) {
+        if (r->kind == LK_RCU) {
+            const member_set* s = mset_enter(&r->rcu, a->id);
+            uint64_t sum = fan_out(a, s->slot, s->count);
+            if (s->magic != MSET_LIVE || sum != s->sum) {
+                a->bad++;
+                }
+            mset_leave(&r->rcu, a->id);
+            }
+        else if (r->kind == LK_RWLOCK) {
+            pthread_rwlock_rdlock(&r->rw);
+            a->bad += (fan_out(a, r->slot, r->count) != r->sum);
+            pthread_rwlock_unlock(&r->rw);
+            }
+        else {
+            pthread_mutex_lock(&r->mu);
+            a->bad += (fan_out(a, r->slot, r->count) != r->sum);
+            pthread_mutex_unlock(&r->mu);
+            }
+        a->msgs++;
+        }
+    return NULL;
+    }
+
+static unsigned long run_case(int kind, long churn, int readers, int members, int secs)
+    {
+    bench_room* r = calloc(1, sizeof(*r));
+    reader_arg* args = calloc((size_t)readers, sizeof(reader_arg));
+    if (!r || !args || mset_init(&r->rcu) < 0) {
+        fprintf(stderr, "[%sError%s] | Out of memory\n", FG_RED, RESET);
+        exit(1);
+        }
+    r->kind = kind;
+    r->churn = churn;
+    pthread_rwlock_init(&r->rw, NULL);
+    pthread_mutex_init(&r->mu, NULL);
+    // first members , every other slot from 0 up
+    for (int i = 0;i < members && 2 * i < BENCH_SLOTS;i++) {
+        room_flip(r, 2 * i);
+        }
+    r->flips = 0;
+    r->rcu.publishes = r->rcu.reclaims = 0;
+
+    pthread_t wt, rt[READERS_MAX];
+    pthread_create(&wt, NULL, writer_main, r);
+    for (int k = 0;k < readers;k++) {
+        args[k].room = r;
+        args[k].id = k;
+        pthread_create(&rt[k], NULL, reader_main, &args[k]);
+        }
+    long long t0 = mono_ns();
+    sleep((unsigned)secs);
+    atomic_store(&r->stop, true);
+    for (int k = 0;k < readers;k++) {
+        pthread_join(rt[k], NULL);
+        }
+    pthread_join(wt, NULL);
+    double dt = (double)(mono_ns() - t0) / 1e9;
+
+    unsigned long msgs = 0, bad = 0;
+    unsigned long long visits = 0;
+    for (int k = 0;k < readers;k++) {
+        msgs += args[k].msgs;
+        visits += args[k].visits;
+        bad += args[k].bad;
+        }
+    char churn_s[24];
+    snprintf(churn_s, sizeof(churn_s), (churn < 0) ? "max" : "%ld", churn);
+    printf("%-7s %8s %12.0f %14.0f %10.0f %10lu %10lu %6lu %4lu\n", kind_names[kind], churn_s, (double)msgs / dt,
+        (double)visits / dt, (double)r->flips / dt, r->rcu.publishes, r->rcu.reclaims, r->full, bad);
+    mset_destroy(&r->rcu);
+    pthread_rwlock_destroy(&r->rw);
+    pthread_mutex_destroy(&r->mu);
+    free(args);
+    free(r);
+    return bad;
+    }
+
+int main(int argc, char* argv[])
+    {
+    int readers = 4, members = 500, secs = 2;
+    for (int k = 1;k + 1 < argc;k += 2) {
+        if (strcmp(argv[k], "-r") == 0) {
+            readers = atoi(argv[k + 1]);
+            }
+        else if (strcmp(argv[k], "-m") == 0) {
+            members = atoi(argv[k + 1]);
+            }
+        else if (strcmp(argv[k], "-t") == 0) {
+            secs = atoi(argv[k + 1]);
+            }
+        }
+    if (readers < 1 || readers > READERS_MAX || members < 0 || secs < 1) {
+        fprintf(stderr, "usage : %s [-r readers (1..%d)] [-m members] [-t seconds]\n", argv[0], READERS_MAX);
+        return 2;
+        }
+    printf("%d readers , %d members of %d slots , %d s per case\n", readers, members, BENCH_SLOTS, secs);
+    printf("%-7s %8s %12s %14s %10s %10s %10s %6s %4s\n", "list", "churn/s", "msgs/s", "visits/s", "flips/s",
+        "published", "freed", "full", "bad");
+    const long churns[] = { 0, 10000, -1 };
+    unsigned long bad_total = 0;
+    for (size_t c = 0;c < sizeof(churns) / sizeof(churns[0]);c++) {
+        for (int kind = 0;kind < LK_COUNT;kind++) {
+            bad_total += run_case(kind, churns[c], readers, members, secs);
+            }
+        }
+    return bad_total ? 1 : 0;
+    }
@@ -0,0 +1,399 @@
+#include "../header.h"
+#include "../trace.h"
+#include <poll.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+
+/*
+drive a test server with a recorded trace (server <port> -R <file>)
+
+    ./replay <trace> <server_ip> <port> [-s speed] [-w drain_ms]
+
+speed 1 = recorded timing , 10 = ten times faster (idles shrink too) , 0 = as fast as possible
+every traced connection becomes one connection here (opened on its OPEN record , or on its first
+msg when the recording started after it) , every msg is sent with its recorded size from its
+connection , msgs which came in one burst (paste flood) go out in one send() as they did .
+one extra "observer" connection gets every broadcast like a real client , each msg starts with its
+send time so the observer gives one way latency (same process , same monotonic clock) , the
+numbers are printed like latency_bench plus throughput
+blob uploads are counted but not replayed (they measure the disk , not the loop)
+*/
+#define REPLAY_OUT_MAX (4 << 20)   // queued bytes of one connection before it counts as stalled
+#define STAMP_MIN 24               // smallest msg : time stamp + '\n'
+#define REPLAY_BATCH 1024          // records per pass at max speed , reads and sends run in between
+
+typedef struct replay_conn {
+    int fd;                 // -1 = not open
+    bool closing;           // CLOSE seen , closed once out is sent
+    char* out;
+    size_t len;
+    size_t sent;
+    size_t cap;
+    }replay_conn;
+
+typedef struct replay_opts {
+    double speed;
+    int drain_ms;
+    }replay_opts;
+
+static long long mono_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+static int cmp_ll(const void* a, const void* b)
+    {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+    }
+
+// connect + handshake (blocking) , then non-blocking , return -1 on Error
+static int replay_connect(const struct sockaddr_in* addr, const char* name)
+    {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) < 0) {
+        if (fd >= 0) {
+            close(fd);
+            }
+        return -1;
+        }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    char hs[128];
+    int n = snprintf(hs, sizeof(hs), "%s%sreplay-%d-%s", name, MSG_SEPRATE, (int)getpid(), name);
+    if (send(fd, hs, (size_t)n, 0) != n || recv(fd, hs, sizeof(hs), 0) <= 0) {
+        close(fd);
+        return -1;
+        }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+    }
+
+// one msg of size bytes : "<send ns> xxxx...\n" , the stamp is written when the burst is sent
+static bool conn_queue_msg(replay_conn* c, size_t size)
+    {
+    if (size < STAMP_MIN) {
+        size = STAMP_MIN;
+        }
+    if (c->len + size > c->cap) {
+        size_t cap = c->cap ? c->cap : 4096;
+        while (cap < c->len + size) {
+            cap *= 2;
+            }
+        char* p = realloc(c->out, cap);
+        if (!p) {
+            return false;
+            }
+        c->out = p;
+        c->cap = cap;
+        }
+    char* m = c->out + c->len;
+    memset(m, 'x', size - 1);
+    m[0] = '\0';   // stamp goes here
+    m[size - 1] = '\n';
+    c->len += size;
+    return c->len - c->sent <= REPLAY_OUT_MAX;
+    }
+
+// write the send time into every unstamped msg (first byte '\0') , then send as much as the socket takes
+static int conn_flush(replay_conn* c)
+    {
+    long long now = mono_ns();
+    for (size_t k = c->sent;k < c->len;) {
+        char* m = c->out + k;
+        char* nl = memchr(m, '\n', c->len - k);
+        if (m[0] == '\0') {
+            char stamp[STAMP_MIN];
+            int w = snprintf(stamp, sizeof(stamp), "%lld ", now);
+            memcpy(m, stamp, (size_t)w);
+            }
+        k = (size_t)(nl - c->out) + 1;
+        }
+    while (c->sent < c->len) {
+        ssize_t n = send(c->fd, c->out + c->sent, c->len - c->sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+            }
+        c->sent += (size_t)n;
+        }
+    if (c->sent == c->len) {
+        c->sent = c->len = 0;
+        }
+    return 0;
+    }
+
+static void conn_close(replay_conn* c)
+    {
+    if (c->fd >= 0) {
+        close(c->fd);
+        }
+    c->fd = -1;
+    c->closing = false;
+    c->len = c->sent = 0;
+    }
+
+// observer : one latency sample per line which starts with a stamp (control lines are skipped)
+typedef struct observer {
+    int fd;
+    bool lost;
+    bool at_start;
+    bool in_stamp;
+    bool stamped;
+    long long stamp;
+    long long* lat;
+    long cap;
+    long got;
+    unsigned long long bytes;
+    }observer;
+
+static void observer_feed(observer* ob, const char* p, size_t n, long long now)
+    {
+    ob->bytes += n;
+    for (size_t k = 0;k < n;k++) {
+        char ch = p[k];
+        if (ob->at_start) {
+            ob->at_start = false;
+            ob->in_stamp = ob->stamped = (ch >= '0' && ch <= '9');
+            ob->stamp = 0;
+            }
+        if (ch == '\n') {
+            if (ob->stamped && ob->got < ob->cap) {
+                ob->lat[ob->got++] = now - ob->stamp;
+                }
+            ob->at_start = true;
+            continue;
+            }
+        if (ob->in_stamp) {
+            if (ch >= '0' && ch <= '9') {
+                ob->stamp = ob->stamp * 10 + (ch - '0');
+                }
+            else {
+                ob->in_stamp = false;
+                }
+            }
+        }
+    }
+
+int main(int argc, char* argv[])
+    {
+    if (argc < 4) {
+        fprintf(stderr, "%sUsage : %s <trace> <server_ip> <port> [-s speed (0 = max)] [-w drain_ms]%s\n", FG_RED, argv[0], RESET);
+        return 2;
+        }
+    replay_opts o = { .speed = 1.0, .drain_ms = 2000 };
+    for (int k = 4;k + 1 < argc;k += 2) {
+        if (strcmp(argv[k], "-s") == 0) o.speed = atof(argv[k + 1]);
+        else if (strcmp(argv[k], "-w") == 0) o.drain_ms = atoi(argv[k + 1]);
+        }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(argv[3]));
+    if (inet_pton(AF_INET, argv[2], &addr.sin_addr) != 1) {
+        fprintf(stderr, "[%sError%s] | Bad address %s\n", FG_RED, RESET, argv[2]);
+        return 2;
+        }
+
+    // ------------------------------ load the trace ------------------------------
+    FILE* f = fopen(argv[1], "rb");
+    if (!f || !trace_check_magic(f)) {
+        fprintf(stderr, "[%sError%s] | %s is not a trace file\n", FG_RED, RESET, argv[1]);
+        return 2;
+        }
+    size_t rec_cap = 4096, nrec = 0;
+    trace_rec* recs = malloc(rec_cap * sizeof(trace_rec));
+    trace_rec r;
+    memset(&r, 0, sizeof(r));
+    unsigned long max_conn = 0;
+    long msgs_total = 0;
+    unsigned long long trace_bytes = 0, fanout_sum = 0;
+    while (recs && trace_read(f, &r)) {
+        if (nrec == rec_cap) {
+            rec_cap *= 2;
+            recs = realloc(recs, rec_cap * sizeof(trace_rec));
+            if (!recs) {
+                break;
+                }
+            }
+        recs[nrec++] = r;
+        max_conn = (r.conn > max_conn) ? r.conn : max_conn;
+        if (r.type == TR_MSG) {
+            msgs_total++;
+            trace_bytes += r.size;
+            fanout_sum += r.fanout;
+            }
+        }
+    fclose(f);
+    if (!recs || nrec == 0) {
+        fprintf(stderr, "[%sError%s] | Empty trace\n", FG_RED, RESET);
+        return 1;
+        }
+    double trace_s = recs[nrec - 1].t_us / 1e6;
+    printf("trace : %zu records , %lu connections , %ld msgs (%llu bytes , fanout avg %.1f) over %.1f s\n",
+        nrec, max_conn, msgs_total, trace_bytes, msgs_total ? (double)fanout_sum / (double)msgs_total : 0.0, trace_s);
+
+    // ------------------------------ replay ------------------------------
+    replay_conn* conns = calloc(max_conn + 1, sizeof(replay_conn));
+    struct pollfd* pfd = calloc(max_conn + 2, sizeof(struct pollfd));
+    int* pconn = calloc(max_conn + 2, sizeof(int));
+    observer ob = { .at_start = true, .cap = msgs_total, .lat = malloc(sizeof(long long) * (size_t)(msgs_total + 1)) };
+    if (!conns || !pfd || !pconn || !ob.lat) {
+        fprintf(stderr, "[%sError%s] | Memory allocation failed\n", FG_RED, RESET);
+        return 1;
+        }
+    for (unsigned long c = 0;c <= max_conn;c++) {
+        conns[c].fd = -1;
+        }
+    ob.fd = replay_connect(&addr, "observer");
+    if (ob.fd < 0) {
+        perror("observer connect");
+        return 1;
+        }
+    // server needs a moment to mark the observer ready
+    usleep(100000);
+
+    long sent_msgs = 0, connect_fail = 0, stalled = 0, blobs = 0;
+    unsigned long long sent_bytes = 0;
+    size_t next = 0;
+    long long t0 = mono_ns();
+    long long end_at = 0;
+    char buf[65536];
+    for (;;) {
+        long long now = mono_ns();
+        // 1. every record which is due now
+        for (int batch = 0;next < nrec && batch < REPLAY_BATCH;batch++) {
+            trace_rec* e = &recs[next];
+            long long due = (o.speed > 0) ? t0 + (long long)((double)e->t_us * 1000.0 / o.speed) : now;
+            if (due > now) {
+                break;
+                }
+            replay_conn* c = &conns[e->conn];
+            if (e->type == TR_CLOSE) {
+                c->closing = (c->fd >= 0);
+                }
+            else if (e->type == TR_BLOB) {
+                blobs++;
+                }
+            else if (c->fd < 0) {
+                char name[32];
+                snprintf(name, sizeof(name), "r%lu", e->conn);
+                c->fd = replay_connect(&addr, name);
+                connect_fail += (c->fd < 0);
+                }
+            if (e->type == TR_MSG && c->fd >= 0) {
+                if (!conn_queue_msg(c, e->size)) {
+                    stalled++;
+                    }
+                sent_msgs++;
+                sent_bytes += (e->size < STAMP_MIN) ? STAMP_MIN : e->size;
+                }
+            next++;
+            }
+        // 2. send the bursts , close what is done
+        int np = 0;
+        pfd[np].fd = ob.fd;
+        pfd[np].events = POLLIN;
+        pconn[np++] = -1;
+        for (unsigned long k = 1;k <= max_conn;k++) {
+            replay_conn* c = &conns[k];
+            if (c->fd < 0) {
+                continue;
+                }
+            if (c->len > c->sent && conn_flush(c) < 0) {
+                conn_close(c);
+                continue;
+                }
+            if (c->closing && c->len == 0) {
+                conn_close(c);
+                continue;
+                }
+            pfd[np].fd = c->fd;
+            pfd[np].events = POLLIN | ((c->len > c->sent) ? POLLOUT : 0);
+            pconn[np++] = (int)k;
+            }
+        // 3. all records done : wait for the observer to get the rest (or drain_ms of silence)
+        if (ob.lost) {
+            break;
+            }
+        if (next == nrec) {
+            if (end_at == 0) {
+                end_at = now;
+                }
+            if (ob.got >= sent_msgs || now - end_at > (long long)o.drain_ms * 1000000LL) {
+                break;
+                }
+            }
+        long long wait_ns = 100 * 1000000LL;
+        if (next < nrec && o.speed <= 0) {
+            wait_ns = 0;
+            }
+        else if (next < nrec) {
+            long long due = (o.speed > 0) ? t0 + (long long)((double)recs[next].t_us * 1000.0 / o.speed) : now;
+            wait_ns = (due > now) ? ((due - now < wait_ns) ? due - now : wait_ns) : 0;
+            }
+        struct timespec ts = { (time_t)(wait_ns / 1000000000LL), (long)(wait_ns % 1000000000LL) };
+        int ready = ppoll(pfd, (nfds_t)np, &ts, NULL);
+        if (ready < 0 && errno != EINTR) {
+            perror("ppoll");
+            break;
+            }
+        // 4. read everything , the observer measures , the others only drain like idle clients
+        long long rnow = mono_ns();
+        for (int k = 0;k < np && ready > 0;k++) {
+            if (!(pfd[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+                }
+            ssize_t n;
+            while ((n = recv(pfd[k].fd, buf, sizeof(buf), 0)) > 0) {
+                if (pconn[k] < 0) {
+                    observer_feed(&ob, buf, (size_t)n, rnow);
+                    }
+                }
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                if (pconn[k] < 0) {
+                    fprintf(stderr, "[%sError%s] | Server closed the observer\n", FG_RED, RESET);
+                    ob.lost = true;
+                    }
+                else {
+                    conn_close(&conns[pconn[k]]);
+                    }
+                }
+            }
+        }
+    double wall_s = (double)(mono_ns() - t0) / 1e9;
+
+    // ------------------------------ report ------------------------------
+    char speed[32];
+    snprintf(speed, sizeof(speed), (o.speed > 0) ? "%gx" : "max", o.speed);
+    printf("replay : speed %s , %.2f s wall (trace %.2f s) , sent %ld msgs %.1f MB , %.0f msgs/s %.2f MB/s\n",
+        speed, wall_s, trace_s, sent_msgs, sent_bytes / 1e6,
+        sent_msgs / wall_s, sent_bytes / 1e6 / wall_s);
+    printf("observer : got %ld of %ld msgs , %.1f MB , %.2f MB/s   connect_fail=%ld stalled=%ld blobs_skipped=%ld\n",
+        ob.got, sent_msgs, ob.bytes / 1e6, ob.bytes / 1e6 / wall_s, connect_fail, stalled, blobs);
+    if (ob.got > 0) {
+        qsort(ob.lat, (size_t)ob.got, sizeof(long long), cmp_ll);
+        double sum = 0;
+        for (long k = 0;k < ob.got;k++) {
+            sum += (double)ob.lat[k];
+            }
+        long got = ob.got;
+        printf("msgs=%ld  one way latency (us) : p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f mean=%.1f\n",
+            got, ob.lat[got / 2] / 1000.0, ob.lat[(size_t)(got * 0.90)] / 1000.0, ob.lat[(size_t)(got * 0.99)] / 1000.0,
+            ob.lat[(size_t)(got * 0.999)] / 1000.0, ob.lat[got - 1] / 1000.0, sum / got / 1000.0);
+        }
+    for (unsigned long c = 1;c <= max_conn;c++) {
+        conn_close(&conns[c]);
+        free(conns[c].out);
+        }
+    close(ob.fd);
+    free(conns);
+    free(pfd);
+    free(pconn);
+    free(ob.lat);
+    free(recs);
+    return 0;
+    }
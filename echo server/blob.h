@@ -0,0 +1,365 @@
+#ifndef BLOB_H   // file / large blob transfer between clients (zero copy)
+#define BLOB_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+/*
+blob protocol (control lines start with MSG_SEPRATE "!?!?" so they never look like chat) :
+    client -> server : !?!?BLOB <size> <name>\n  followed by exactly <size> raw bytes
+    server -> client : !?!?BLOB <id> <size> <name>\n          announce , sent once
+                       !?!?CHUNK <id> <offset> <len>\n<len raw bytes>
+                       !?!?BFAIL <size> <name>\n               to the sender , its upload was not stored
+    client -> server : !?!?BGET <id> <offset>\n               resume a download from offset
+
+upload  : socket --splice--> pipe --splice--> blobs/<id>   (bytes never enter user space)
+deliver : blobs/<id> --sendfile--> socket                  (straight from the page cache)
+
+every tick a recipient gets at most one chunk of min(BLOB_CHUNK , BLOB_TICK_BUDGET / active jobs) ,
+and only when its chat output is empty . so a big transfer can not starve chat traffic
+*/
+#define BLOB_DIR          "blobs"
+#define BLOB_CHUNK        (64 * 1024)     // max body bytes of one CHUNK frame
+#define BLOB_TICK_BUDGET  (1024 * 1024)   // total blob bytes sent by server in one tick
+#define BLOB_MIN_SHARE    4096
+#define BLOB_MAX_SIZE     (1LL << 32)     // 4 GiB upload limit
+#define BLOB_NAME_MAX     64
+#define BLOB_REGISTRY     256             // blobs remembered in memory (name , size)
+#define BLOB_HDR_MAX      96
+
+typedef struct blob_upload {
+    bool active;
+    unsigned long long id;
+    int file_fd;
+    int pipe_fd[2];
+    long long size;
+    long long left;          // bytes still expected from the socket
+    bool failed;             // spool write failed , the rest is read and dropped , then BFAIL to the sender
+    char name[BLOB_NAME_MAX + 1];
+    }blob_upload;
+
+typedef struct blob_job {
+    unsigned long long id;
+    int file_fd;
+    off_t off;               // next byte of file to send
+    off_t end;
+    off_t chunk_left;        // body bytes of current CHUNK still to send
+    char hdr[BLOB_HDR_MAX];  // CHUNK header , sent before the body
+    size_t hdr_len;
+    size_t hdr_sent;
+    struct blob_job* next;
+    }blob_job;
+
+typedef struct blob_entry {
+    unsigned long long id;
+    long long size;
+    char name[BLOB_NAME_MAX + 1];
+    }blob_entry;
+
+blob_entry blob_registry[BLOB_REGISTRY];
+int blob_registry_next = 0;
+unsigned long long blob_counter = 0;
+
+// blob id = time + counter , unique across server restarts (files stay in blobs/)
+unsigned long long blob_new_id()
+    {
+    return ((unsigned long long)time(NULL) << 20) | (blob_counter++ & 0xfffff);
+    }
+
+void blob_path(char* out, size_t cap, unsigned long long id)
+    {
+    snprintf(out, cap, "%s/%llx", BLOB_DIR, id);
+    }
+
+// keep only safe chars of file name [it is used as a file name on client side]
+void blob_clean_name(char* name)
+    {
+    for (char* p = name; *p; p++) {
+        if (*p == '/' || *p == '\\' || *p == ' ' || (unsigned char)*p < 32) {
+            *p = '_';
+            }
+        }
+    if (name[0] == '.' || name[0] == '\0') {
+        name[0] = '_';
+        }
+    }
+
+blob_entry* blob_lookup(unsigned long long id)
+    {
+    for (int k = 0;k < BLOB_REGISTRY;k++) {
+        if (blob_registry[k].id == id) {
+            return &blob_registry[k];
+            }
+        }
+    return NULL;
+    }
+
+/*
+parse "!?!?BLOB <size> <name>\n" and create the spool file
+    return -1 : Error [bad header or file error]
+    return  n : length of header line (data starts at line + n)
+*/
+int blob_upload_begin(blob_upload* up, const char* line, size_t len)
+    {
+    const char* nl = memchr(line, '\n', len);
+    if (!nl) {
+        return -1;
+        }
+    char hdr[BLOB_HDR_MAX + BLOB_NAME_MAX];
+    size_t hlen = (size_t)(nl - line);
+    if (hlen >= sizeof(hdr)) {
+        return -1;
+        }
+    memcpy(hdr, line, hlen);
+    hdr[hlen] = '\0';
+
+    long long size;
+    char name[BLOB_NAME_MAX + 1];
+    if (sscanf(hdr, "!?!?BLOB %lld %64s", &size, name) != 2 || size <= 0 || size > BLOB_MAX_SIZE) {
+        return -1;
+        }
+    blob_clean_name(name);
+
+    memset(up, 0, sizeof(*up));
+    up->id = blob_new_id();
+    char path[64];
+    blob_path(path, sizeof(path), up->id);
+    up->file_fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (up->file_fd < 0) {
+        perror("blob open");
+        return -1;
+        }
+    if (pipe2(up->pipe_fd, O_CLOEXEC) < 0) {
+        perror("blob pipe");
+        close(up->file_fd);
+        return -1;
+        }
+    // a larger pipe moves more bytes per splice() pair
+    fcntl(up->pipe_fd[1], F_SETPIPE_SZ, BLOB_CHUNK);
+    up->size = size;
+    up->left = size;
+    strcpy(up->name, name);
+    up->active = true;
+    return (int)(hlen + 1);
+    }
+
+/*
+bytes of the blob which came in the same read() as the header (small copy , once)
+return = bytes of data consumed , always all of the upload's part of data : a spool write error
+sets up->failed and the bytes are dropped (so are the ones of later calls)
+*/
+size_t blob_upload_write(blob_upload* up, const char* data, size_t n)
+    {
+    size_t take = (n < (size_t)up->left) ? n : (size_t)up->left;
+    size_t done = 0;
+    while (!up->failed && done < take) {
+        ssize_t w = write(up->file_fd, data + done, take - done);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+                }
+            perror("blob write");
+            up->failed = true;
+            break;
+            }
+        done += (size_t)w;
+        }
+    up->left -= (long long)take;
+    return take;
+    }
+
+/*
+move bytes from socket to spool file without copying them to user space
+    return -1 : Error / peer closed in the middle of upload
+    return 0  : nothing available now
+    return n  : bytes moved
+*/
+ssize_t blob_upload_splice(blob_upload* up, int sock)
+    {
+    size_t want = (up->left < BLOB_CHUNK) ? (size_t)up->left : BLOB_CHUNK;
+    if (up->failed) {
+        char sink[4096];
+        ssize_t got = read(sock, sink, (want < sizeof(sink)) ? want : sizeof(sink));
+        if (got == 0) {
+            return -1;
+            }
+        if (got < 0) {
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+            }
+        up->left -= got;
+        return got;
+        }
+    ssize_t in = splice(sock, NULL, up->pipe_fd[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (in == 0) {
+        return -1;
+        }
+    if (in < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+    ssize_t moved = 0;
+    while (moved < in) {
+        ssize_t out = splice(up->pipe_fd[0], NULL, up->file_fd, NULL, (size_t)(in - moved), SPLICE_F_MOVE);
+        if (out <= 0) {
+            if (out < 0 && errno == EINTR) {
+                continue;
+                }
+            perror("blob splice");
+            return -1;
+            }
+        moved += out;
+        }
+    up->left -= in;
+    return in;
+    }
+
+// upload finished (or aborted) , close spool fds and remember the blob
+void blob_upload_end(blob_upload* up, bool ok)
+    {
+    close(up->pipe_fd[0]);
+    close(up->pipe_fd[1]);
+    close(up->file_fd);
+    if (ok) {
+        blob_entry* e = &blob_registry[blob_registry_next];
+        blob_registry_next = (blob_registry_next + 1) % BLOB_REGISTRY;
+        e->id = up->id;
+        e->size = up->size;
+        strcpy(e->name, up->name);
+        }
+    else {
+        char path[64];
+        blob_path(path, sizeof(path), up->id);
+        unlink(path);
+        }
+    up->active = false;
+    }
+
+// announce line for recipients
+int blob_announce(char* out, size_t cap, unsigned long long id, long long size, const char* name)
+    {
+    return snprintf(out, cap, "!?!?BLOB %llx %lld %s\n", id, size, name);
+    }
+
+/*
+add a delivery job for a recipient starting at offset (offset > 0 = resume)
+    return NULL : blob does not exist (or offset is past the end)
+*/
+blob_job* blob_job_push(blob_job** head, unsigned long long id, off_t offset)
+    {
+    char path[64];
+    blob_path(path, sizeof(path), id);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+        }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || offset < 0 || offset > st.st_size) {
+        close(fd);
+        return NULL;
+        }
+    blob_job* job = (blob_job*)calloc(1, sizeof(blob_job));
+    if (!job) {
+        close(fd);
+        return NULL;
+        }
+    job->id = id;
+    job->file_fd = fd;
+    job->off = offset;
+    job->end = st.st_size;
+    // FIFO , transfers to one client go one after other
+    while (*head) {
+        head = &(*head)->next;
+        }
+    *head = job;
+    return job;
+    }
+
+void blob_jobs_free(blob_job** head)
+    {
+    while (*head) {
+        blob_job* j = *head;
+        *head = j->next;
+        close(j->file_fd);
+        free(j);
+        }
+    }
+
+// true while a CHUNK is half sent , no other output may go to this socket
+bool blob_busy(const blob_job* head)
+    {
+    return head && (head->hdr_sent < head->hdr_len || head->chunk_left > 0);
+    }
+
+/*
+send (part of) next chunk of the first job , called at tick end after chat flush
+    share : body bytes allowed for this client in this tick
+    return -1 : Error [connection broken]
+    return n  : body bytes sent
+*/
+ssize_t blob_pump(int fd, blob_job** head, size_t share, unsigned long* send_calls)
+    {
+    blob_job* job = *head;
+    if (!job) {
+        return 0;
+        }
+    // start a new chunk
+    if (!blob_busy(job)) {
+        off_t len = job->end - job->off;
+        if ((off_t)share < len) {
+            len = (off_t)share;
+            }
+        job->hdr_len = (size_t)snprintf(job->hdr, sizeof(job->hdr), "!?!?CHUNK %llx %lld %lld\n",
+            job->id, (long long)job->off, (long long)len);
+        job->hdr_sent = 0;
+        job->chunk_left = len;
+        }
+    // 1. header (MSG_MORE keeps it in the same segment as the body)
+    while (job->hdr_sent < job->hdr_len) {
+        ssize_t m = send(fd, job->hdr + job->hdr_sent, job->hdr_len - job->hdr_sent, MSG_DONTWAIT | MSG_NOSIGNAL | MSG_MORE);
+        (*send_calls)++;
+        if (m < 0) {
+            if (errno == EINTR) {
+                continue;
+                }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+        job->hdr_sent += (size_t)m;
+        }
+    // 2. body straight from page cache
+    ssize_t total = 0;
+    while (job->chunk_left > 0) {
+        ssize_t m = sendfile(fd, job->file_fd, &job->off, (size_t)job->chunk_left);
+        (*send_calls)++;
+        if (m < 0) {
+            if (errno == EINTR) {
+                continue;
+                }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return total;
+                }
+            return -1;
+            }
+        if (m == 0) {
+            // file got shorter under us
+            return -1;
+            }
+        job->chunk_left -= m;
+        total += m;
+        }
+    // 3. job complete -> next one
+    if (job->off >= job->end) {
+        *head = job->next;
+        close(job->file_fd);
+        free(job);
+        }
+    return total;
+    }
+#endif
@@ -0,0 +1,104 @@
+#ifndef BUF_POOL_H   // size class pool for receive (partial line) buffers
+#define BUF_POOL_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/*
+a connection owns a receive buffer only while it has an unfinished line :
+    1. read() goes into one shared stack buffer , complete lines are handled from there
+    2. only the rest (partial line) is copied into a pool buffer of the smallest class that fits
+    3. when the line completes the buffer goes back to the pool (idle connection = 0 bytes)
+    4. a buffer which is much bigger than its data is swapped for a smaller class
+freed buffers are kept in per class free lists (up to pool_cache_max) so a busy server
+does not call malloc / free for every partial line
+*/
+#define POOL_CLASSES    3
+#define POOL_CONN_MAX   (128 * 1024)   // per connection limit (= largest class)
+#define POOL_GLOBAL_MAX (64 << 20)     // all receive buffers together
+
+static const size_t pool_class_size[POOL_CLASSES] = { 512, 8 * 1024, POOL_CONN_MAX };
+static const int pool_cache_max[POOL_CLASSES] = { 1024, 128, 8 };
+
+typedef struct buf_pool {
+    void* free_list[POOL_CLASSES];   // next pointer is stored in the free buffer itself
+    int free_count[POOL_CLASSES];
+    size_t in_use;         // bytes given to connections
+    size_t in_use_peak;
+    size_t cached;         // bytes waiting in free lists
+    unsigned long gets;
+    unsigned long cache_hits;
+    unsigned long cap_rejects;   // request over per connection / global limit
+    }buf_pool;
+
+// smallest class for n bytes , -1 = too big
+int pool_class(size_t n)
+    {
+    for (int c = 0;c < POOL_CLASSES;c++) {
+        if (n <= pool_class_size[c]) {
+            return c;
+            }
+        }
+    return -1;
+    }
+
+/*
+buffer for at least n bytes
+    return NULL : over the limits (or out of memory)
+*/
+char* pool_get(buf_pool* bp, size_t n, size_t* cap)
+    {
+    int c = pool_class(n);
+    if (c < 0 || bp->in_use + pool_class_size[c] > POOL_GLOBAL_MAX) {
+        bp->cap_rejects++;
+        return NULL;
+        }
+    bp->gets++;
+    char* p;
+    if (bp->free_list[c]) {
+        p = (char*)bp->free_list[c];
+        bp->free_list[c] = *(void**)p;
+        bp->free_count[c]--;
+        bp->cached -= pool_class_size[c];
+        bp->cache_hits++;
+        }
+    else {
+        p = (char*)malloc(pool_class_size[c]);
+        if (!p) {
+            return NULL;
+            }
+        }
+    bp->in_use += pool_class_size[c];
+    if (bp->in_use > bp->in_use_peak) {
+        bp->in_use_peak = bp->in_use;
+        }
+    *cap = pool_class_size[c];
+    return p;
+    }
+
+// give a buffer back (cap = value returned by pool_get)
+void pool_put(buf_pool* bp, char* p, size_t cap)
+    {
+    if (!p) {
+        return;
+        }
+    int c = pool_class(cap);
+    bp->in_use -= cap;
+    if (c >= 0 && pool_class_size[c] == cap && bp->free_count[c] < pool_cache_max[c]) {
+        *(void**)p = bp->free_list[c];
+        bp->free_list[c] = p;
+        bp->free_count[c]++;
+        bp->cached += cap;
+        return;
+        }
+    free(p);
+    }
+
+void pool_report(const buf_pool* bp)
+    {
+    printf("[%sPool%s] rx in_use=%zu peak=%zu cached=%zu (free %d/%d/%d) gets=%lu cache_hit=%lu limit_reject=%lu\n",
+        FG_BCYAN, RESET, bp->in_use, bp->in_use_peak, bp->cached, bp->free_count[0], bp->free_count[1], bp->free_count[2],
+        bp->gets, bp->cache_hits, bp->cap_rejects);
+    }
+#endif
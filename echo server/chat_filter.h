@@ -0,0 +1,61 @@
+#ifndef CHAT_FILTER_H   // C ABI of msg filters : shared objects the server loads with -M
+#define CHAT_FILTER_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+a filter is a shared object which exports
+    const chat_filter_ops* chat_filter_entry(void);
+server calls it once after dlopen() , checks abi == CHAT_FILTER_ABI and calls init(arg)
+(arg = text after ':' in "-M path.so:arg" , "" when there is none) .
+then for every chat line of the room (after the utf-8 check , before it is stored and fanned out) :
+    int filter(void* state , const chat_frame* in , chat_out* out)
+    in points into the read buffer of the server (read only , do not keep it after the call)
+    return CHAT_PASS    : line goes on as it is (no copy)
+           CHAT_DROP    : line is not delivered and not stored
+           CHAT_REWRITE : out->buf holds the new line (out->len bytes , at most out->cap) ,
+                          one line : a '\n' only at the end (the server adds it when in had one)
+           CHAT_ROUTE   : line (in , or out->buf when a filter before rewrote it) goes only to the
+                          member named out->to , not to the room (no room seq , no replay) ,
+                          out->len > 0 = out->buf is the text to send (same rules as CHAT_REWRITE)
+filters run in the order of -M on the event loop thread , a filter must not block . a call over
+the time budget is counted , a filter over it FILTER_STRIKES times in a row is switched off .
+new fields are only added at the end , CHAT_FILTER_ABI changes when a field changes meaning
+*/
+#define CHAT_FILTER_ABI     1
+#define CHAT_FILTER_ENTRY   "chat_filter_entry"
+#define CHAT_ROUTE_NAME_MAX 64
+
+enum chat_verdict {
+    CHAT_PASS = 0,
+    CHAT_DROP,
+    CHAT_REWRITE,
+    CHAT_ROUTE
+    };
+
+typedef struct chat_frame {
+    const char* data;      // the line , ends with '\n' unless it was cut at the line limit
+    size_t len;
+    uint32_t from;         // member id of the sender (roster id)
+    const char* name;      // sender name (nick)
+    const char* uuid;
+    uint32_t ip;           // network order
+    }chat_frame;
+
+typedef struct chat_out {
+    char* buf;             // pooled buffer for CHAT_REWRITE
+    size_t cap;
+    size_t len;
+    char to[CHAT_ROUTE_NAME_MAX + 1];   // member name for CHAT_ROUTE
+    }chat_out;
+
+typedef struct chat_filter_ops {
+    uint32_t abi;
+    const char* name;
+    void* (*init)(const char* arg);    // may be NULL , returns NULL = the filter does not load
+    int (*filter)(void* state, const chat_frame* in, chat_out* out);
+    void (*fini)(void* state);         // may be NULL
+    }chat_filter_ops;
+
+typedef const chat_filter_ops* (*chat_filter_entry_fn)(void);
+#endif
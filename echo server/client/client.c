@@ -1,41 +1,171 @@
 #include "header_cli.h"
 
-void display_msg_safe(const char* color, const char* message, ssize_t msg_len)
+/*
+received text is not painted per msg : recever_thread appends it to a view queue and paints the
+queue as one frame , at most every FRAME_MS . one frame = one copy of the readline line , one
+write() of all queued lines , one redisplay of the prompt . in a busy room the client paints
+30 times a second instead of once per msg and keeps up with the socket .
+a line cut by recv() stays open in the queue and is painted whole with its next piece .
+above VIEW_BACKLOG_MAX queued bytes new text is dropped from view (lines counted) , the next frame
+says how many . only recever_thread touches the queue , display_lck guards the terminal
+*/
+typedef struct view_queue {
+    char* buf;
+    size_t len;
+    size_t cap;
+    bool open;                 // last line has no '\n' yet (its color is still on)
+    unsigned long dropped;     // lines not shown since last frame
+    long long last_frame_ms;
+    }view_queue;
+
+static bool view_reserve(view_queue* vq, size_t n)
     {
-    pthread_mutex_lock(&display_lck);
+    if (vq->len + n <= vq->cap) {
+        return true;
+        }
+    size_t cap = vq->cap ? vq->cap : 4096;
+    while (cap < vq->len + n) {
+        cap *= 2;
+        }
+    char* p = realloc(vq->buf, cap);
+    if (!p) {
+        return false;
+        }
+    vq->buf = p;
+    vq->cap = cap;
+    return true;
+    }
 
-    // save current line buffer
-    int saved_point = rl_point;
-    int saved_end = rl_end;
-    char* saved_line = rl_copy_text(0, rl_end);
+static void view_put(view_queue* vq, const char* s, size_t n)
+    {
+    memcpy(vq->buf + vq->len, s, n);
+    vq->len += n;
+    }
 
-    // clear the current input line
-    rl_save_prompt();
-    rl_replace_line("", 0);
-    rl_redisplay();
+// ends an open line (before a note / a forced frame)
+static void view_close_line(view_queue* vq)
+    {
+    if (vq->open && view_reserve(vq, sizeof(RESET) + 1)) {
+        view_put(vq, RESET "\n", sizeof(RESET));
+        vq->open = false;
+        }
+    }
 
-    // displaying the incoming msg
-    int clean_len = msg_len;
-    while ((clean_len > 0) && (message[clean_len - 1] == '\0' ||
-        message[clean_len - 1] == '\n' || message[clean_len - 1] == '\r')) {
+// labelled : every line already starts with "name: " (roster known) , else the old "Other Client" label
+void view_push(view_queue* vq, const char* color, const char* message, size_t msg_len, bool labelled)
+    {
+    while (msg_len > 0 && message[msg_len - 1] == '\0') {
+        msg_len--;
+        }
+    bool ends_line = (msg_len > 0 && message[msg_len - 1] == '\n');
+    size_t clean_len = msg_len;
+    while ((clean_len > 0) && (message[clean_len - 1] == '\n' || message[clean_len - 1] == '\r')) {
         clean_len--;
         }
-    printf("\r\033[K%sOther Client%s: %.*s\n", color, RESET, clean_len, message);
-    if (msg_len > 0 && message[msg_len - 1] != '\n') {
-        printf("\n");
+    size_t need = clean_len + 64;
+    if (vq->len + need > VIEW_BACKLOG_MAX || !view_reserve(vq, need)) {
+        view_close_line(vq);
+        vq->dropped++;
+        for (const char* p = message; (p = memchr(p, '\n', (size_t)(message + clean_len - p))) != NULL; p++) {
+            vq->dropped++;
+            }
+        return;
+        }
+    if (!vq->open) {
+        vq->len += (size_t)(labelled ? snprintf(vq->buf + vq->len, vq->cap - vq->len, "%s", color)
+            : snprintf(vq->buf + vq->len, vq->cap - vq->len, "%sOther Client%s: ", color, RESET));
+        }
+    view_put(vq, message, clean_len);
+    vq->open = !ends_line;
+    if (ends_line) {
+        view_put(vq, RESET "\n", sizeof(RESET));
+        }
+    }
+
+// plain line (debug notes) , never dropped
+void view_note(view_queue* vq, const char* text)
+    {
+    size_t n = strlen(text);
+    view_close_line(vq);
+    if (view_reserve(vq, n + 1)) {
+        view_put(vq, text, n);
+        view_put(vq, "\n", 1);
         }
+    }
 
-    // Restore the input line 
-    rl_restore_prompt();
+// event note of ev_poll() (typing , ...) into the view
+static void view_event(void* vq, const char* text)
+    {
+    view_note((view_queue*)vq, text);
+    }
+
+/*
+paint what is queued (force = now , else only when FRAME_MS passed since the last frame)
+an open line waits for its end unless the frame is forced
+*/
+void view_frame(view_queue* vq, bool force)
+    {
+    if (force) {
+        view_close_line(vq);
+        }
+    if (vq->dropped > 0) {
+        char note[128];
+        snprintf(note, sizeof(note), "%s[View] %lu line(s) dropped from view , room is faster than the terminal%s",
+            FG_YELLOW, vq->dropped, RESET);
+        view_note(vq, note);
+        vq->dropped = 0;
+        }
+    size_t paint = vq->len;
+    if (vq->open) {
+        const char* nl = memrchr(vq->buf, '\n', vq->len);
+        paint = nl ? (size_t)(nl - vq->buf) + 1 : 0;
+        }
+    if (paint == 0) {
+        return;
+        }
+    long long now = now_ms();
+    if (!force && now - vq->last_frame_ms < FRAME_MS) {
+        return;
+        }
+    pthread_mutex_lock(&display_lck);
+
+    // save current line buffer , the text is painted over the prompt line
+    int saved_point = rl_point;
+    char* saved_line = rl_copy_text(0, rl_end);
+    rl_replace_line("", 0);
+    fflush(stdout);
+    const char* clear = "\r\033[K";
+    ssize_t n = write(STDOUT_FILENO, clear, strlen(clear));
+    for (size_t off = 0;n >= 0 && off < paint;off += (size_t)n) {
+        n = write(STDOUT_FILENO, vq->buf + off, paint - off);
+        if (n < 0 && errno == EINTR) {
+            n = 0;
+            }
+        }
+
+    // Restore the input line , one redisplay for the whole frame
     rl_replace_line(saved_line, 0);
     rl_point = saved_point;
-    rl_end = saved_end;    //
-    rl_redisplay();
+    rl_forced_update_display();
 
     free(saved_line);
     pthread_mutex_unlock(&display_lck);
+    // open line moves to the front , it is painted with the next frame
+    memmove(vq->buf, vq->buf + paint, vq->len - paint);
+    vq->len -= paint;
+    vq->last_frame_ms = now;
     }
 
+// readline key hook (main thread) : a key of a chat line (not a /command) marks typing
+static int typing_getc(FILE* in)
+    {
+    int c = rl_getc(in);
+    bool command = (rl_end == 0) ? (c == '/') : (rl_line_buffer[0] == '/');
+    if (c >= ' ' && c < 127 && !command) {
+        typing_key = true;
+        }
+    return c;
+    }
 
 void* recever_thread(void* arg)
     {
@@ -49,39 +179,73 @@ void* recever_thread(void* arg)
     int flag = fcntl(client->sock, F_GETFL, 0);       // 1.1 it returns (flag) a bitwise mask of current options
     fcntl(client->sock, F_SETFL, flag | O_NONBLOCK);  // 2.1 sets the socket to Non- blocking  mode  
 
-    while (clinet_active) {
+    // splits server stream into chat text and blob frames
+    static stream_parser parser;
+    parser_init(&parser);
+    // received text waits here for the next frame
+    static view_queue view;
+    // seqs of the last connection , duplicates of the replay are skipped
+    parser.boot = client->seq_boot;
+    parser.seq_last = parser.seq_acked = client->seq_last;
+    parser.lines_used = client->lines_base;
+
+    while (clinet_active && server_up) {
+
+        // /who of the main thread , the roster is only touched by this thread
+        if (who_request) {
+            view_frame(&view, true);
+            roster_print(&parser.roster);
+            who_request = false;
+            }
+        // events : UDP setup , due typing / presence , datagrams from the server
+        ev_pump(client->sock);
+        ev_poll(&parser.roster, view_event, &view);
 
         // Receive a reply (unchanged, but ensure null-termination)
-        char buffer_recv[4096];
-        ssize_t recv_size = recv(client->sock, buffer_recv, sizeof(buffer_recv) - 1, 0);
-        if (recv_size > 0)
-            {
-            buffer_recv[recv_size] = '\0';
-
-            if (debug)
-                {
-                display_msg_safe(FG_CYAN, buffer_recv, recv_size);   //in future replace the argument 1 with other_client color
-                pthread_mutex_lock(&display_lck);
-                printf("[DEBUG MODE]Recieved :%zd bytes\n", recv_size);
-                rl_forced_update_display();
-                pthread_mutex_unlock(&display_lck);
-                }
-            else
-                {
-                display_msg_safe(client->cli_display_color, buffer_recv, recv_size);   //in future replace the argument 1 with other_client color
+        char buffer_raw[4096];
+        char buffer_recv[sizeof(buffer_raw) + 2 * CTRL_LINE_MAX];
+        ssize_t recv_size = recv(client->sock, buffer_raw, sizeof(buffer_raw), 0);
+        if (recv_size > 0) {
+            // labels and notices can make the text longer than buffer_recv , so it is shown in pieces
+            size_t used = 0;
+            while (used < (size_t)recv_size || parser_pending(&parser)) {
+                size_t chat_len;
+                used += parser_feed(&parser, buffer_raw + used, (size_t)recv_size - used, buffer_recv, &chat_len, sizeof(buffer_recv) - 1);
+                // only blob bytes / control frames , nothing to display
+                if (chat_len == 0) {
+                    continue;
+                    }
+                if (debug)
+                    {
+                    view_push(&view, FG_CYAN, buffer_recv, chat_len, parser.roster.active);
+                    char note[64];
+                    snprintf(note, sizeof(note), "[DEBUG MODE]Recieved :%zu bytes", chat_len);
+                    view_note(&view, note);
+                    }
+                else
+                    {
+                    view_push(&view, client->cli_display_color, buffer_recv, chat_len, parser.roster.active);
+                    }
                 }
+            view_frame(&view, false);
+            parser_reply(&parser, client->sock);
             }
         else if (recv_size == 0) {
+            view_frame(&view, true);
             pthread_mutex_lock(&display_lck);
-            printf("\n%sServer closed the connection.%s\n", FG_BRED, RESET);
+            printf("\n%sServer closed the connection. Reconnecting...%s\n", FG_BRED, RESET);
             rl_forced_update_display();
             pthread_mutex_unlock(&display_lck);
             break;
             }
         else if (recv_size == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // quiet socket , the rest of the frame is painted and the delayed ACK still goes out
+            view_frame(&view, false);
+            parser_reply(&parser, client->sock);
             usleep(10000);  // 10ms
             }
         else {
+            view_frame(&view, true);
             pthread_mutex_lock(&display_lck);
             perror("recv");
             rl_forced_update_display();
@@ -89,7 +253,17 @@ void* recever_thread(void* arg)
             break;
             }
         }
-    clinet_active = false;
+    // text of the last frame is still shown before the reconnect / quit notice
+    view_frame(&view, true);
+    // main loop sees this and starts the reconnect (SYNC asks for what came after seq_last)
+    client->seq_boot = parser.boot;
+    client->seq_last = parser.seq_last;
+    server_up = false;
+    for (int k = 0;k < DOWNLOAD_MAX;k++) {
+        if (parser.dl[k].fd != -1) {
+            download_close(&parser.dl[k]);
+            }
+        }
     return NULL;
     }
 
@@ -119,12 +293,6 @@ int main(int argc, char* argv[])
         }
 
 
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        fprintf(stderr, "[%s Error %s] | Failed_to_create_socket__\n", FG_RED, RESET);
-        return 1;
-        }
-
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
@@ -133,19 +301,18 @@ int main(int argc, char* argv[])
     // convert IPv4 address from text to binary form
     if (inet_pton(AF_INET, server_ip, &addr.sin_addr) != 1) {
         fprintf(stderr, "[%s Error %s] | Invalid_IPv4_Address:%s__\n", FG_RED, RESET, server_ip);
-        close(sock);
         return 1;
         }
 
     // connect to server
-    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    int sock = connect_server(&addr);
+    if (sock < 0) {
         fprintf(stderr, "[%s Error %s] | Connect\n", BG_RED, RESET);
-        close(sock);
         return 1;
         }
 
     // client info structure filling /initilization
-    client_info* client_info_t = (client_info*)malloc(sizeof(client_info));
+    client_info* client_info_t = (client_info*)calloc(1, sizeof(client_info));
     if (!client_info_t) {
         fprintf(stderr, "[%s Error %s] | Memory allocation failed\n", FG_RED, RESET);
         close(sock);
@@ -153,7 +320,6 @@ int main(int argc, char* argv[])
         }
 
     char buffer[META_D_BUFFER_SIZE];
-    ssize_t n_byte;
 
     printf("%s%sChoose a name to connect server :%s\t", UNDERLINE, FG_BBLUE, RESET);
     fflush(stdout);
@@ -166,48 +332,34 @@ int main(int argc, char* argv[])
         return 1;
         }
 
-    client_info_t->client_name = strdup(buffer);
-    client_info_t->sock = sock;
-
-    // Fetch or generate the uuid of client 
-    client_info_t->cli_uuid = (char*)malloc(37 * sizeof(char));
-    uuid_fetch(client_info_t->cli_uuid, debug);
-    combine_msg(buffer, client_info_t->cli_uuid, debug);
-    if (!client_info_t->cli_uuid) {
-        fprintf(stderr, "[%s Error %s] | Memory allocation failed\n", FG_RED, RESET);
+    // name without the fgets newline , bounded by the handshake field size
+    size_t name_len = strcspn(buffer, "\r\n");
+    if (!hs_name_ok(buffer, name_len)) {
+        fprintf(stderr, "[%s Error %s] | Name must be 1..%d printable chars without %s\n", FG_RED, RESET, HS_NAME_MAX, MSG_SEPRATE);
         free_client(client_info_t);
         close(sock);
         return 1;
         }
+    memcpy(client_info_t->client_name, buffer, name_len);
+    client_info_t->client_name[name_len] = '\0';
+    client_info_t->sock = sock;
 
-    // send meta data to the server 
-    if (send(sock, buffer, strlen(buffer), 0) < 0) {
-        perror("send Meta Data :");
-        free_client(client_info_t);
-        return 1;
-        }
-    // recieve server info || 
-    if ((n_byte = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
-        buffer[n_byte] = '\0';
-
-        if (!break_meta_d(&client_info_t, buffer)) {
-            fprintf(stderr, "[%s Error %s] | Failed to parse server metadata\n", FG_RED, RESET);
-            free_client(client_info_t);
-            close(sock);
-            return 1;
-            }
-        if (debug) {
-            printf("Recieved :%s\n", client_info_t->server_name);
-            printf("Recieved :%sxxxxx%s\n", client_info_t->cli_display_color, RESET);
-            }
+    // Fetch or generate the uuid of client (same identity on every reconnect)
+    uuid_fetch(client_info_t->cli_uuid, debug);
+    backoff_init(client_info_t->cli_uuid);
 
-        }
-    else {
-        perror("Recv Meta Data :");
+    // send meta data to the server and recieve server info
+    if (!session_handshake(client_info_t, debug)) {
+        fprintf(stderr, "[%s Error %s] | Handshake with server failed\n", FG_RED, RESET);
         free_client(client_info_t);
         close(sock);
         return 1;
         }
+    if (debug) {
+        printf("Recieved :%s\n", client_info_t->server_name);
+        printf("Recieved :%sxxxxx%s\n", client_info_t->cli_display_color, RESET);
+        }
+    server_up = true;
 
     printf("Connected to server [ IP= %s%s%s ] [ Port= %s%d%s ]\n", FG_GREEN, server_ip, RESET, FG_GREEN, port, RESET);
     if (debug)
@@ -230,8 +382,20 @@ int main(int argc, char* argv[])
         }
     puts(" ");
 
-    // set up readline
+    // lines the server did not ack in the last run go out first (numbering of them too)
+    outbox queue;
+    outbox_open(&queue);
+    int replayed = outbox_replay(&queue, sock);
+    if (queue.count > 0) {
+        printf("[Outbox] %d queued line(s) sent\n", replayed < 0 ? 0 : replayed);
+        }
+    bool th_joinable = true;
+    int attempt = 0;
+    long long retry_at = 0;
+
+    // set up readline , keys of a chat line become typing events
     rl_catch_signals = 0;
+    rl_getc_function = typing_getc;
 
     char prompt[128];
     snprintf(prompt, sizeof(prompt), "%s>>>%s ", FG_BGREEN, RESET);
@@ -241,6 +405,56 @@ int main(int argc, char* argv[])
     // msg sending loop
     while (clinet_active) {
 
+        // lines the server took (CACK) leave the outbox
+        outbox_ack(&queue, cseq_acked);
+
+        // connection lost : backoff , then reconnect with the same uuid and flush the outbox
+        if (!server_up) {
+            if (th_joinable) {
+                pthread_join(recever_th, NULL);
+                th_joinable = false;
+                close(sock);
+                sock = -1;
+                attempt = 0;
+                retry_at = now_ms() + backoff_delay_ms(attempt);
+                }
+            else if (now_ms() >= retry_at) {
+                sock = connect_server(&addr);
+                client_info_t->sock = sock;
+                if (sock >= 0 && session_handshake(client_info_t, debug)) {
+                    server_up = true;
+                    if (pthread_create(&recever_th, NULL, recever_thread, client_info_t)) {
+                        fprintf(stderr, "[%s Error %s] | Failed to create receiver thread\n", FG_RED, RESET);
+                        break;
+                        }
+                    th_joinable = true;
+                    int sent = outbox_replay(&queue, sock);
+                    pthread_mutex_lock(&display_lck);
+                    printf("\r\033[K%sReconnected%s [ %d queued line(s) sent ]\n", FG_GREEN, RESET, sent < 0 ? 0 : sent);
+                    rl_forced_update_display();
+                    pthread_mutex_unlock(&display_lck);
+                    if (sent < 0) {
+                        shutdown(sock, SHUT_RDWR);
+                        }
+                    }
+                else {
+                    if (sock >= 0) {
+                        close(sock);
+                        sock = -1;
+                        }
+                    attempt++;
+                    long long wait = backoff_delay_ms(attempt);
+                    retry_at = now_ms() + wait;
+                    if (debug) {
+                        pthread_mutex_lock(&display_lck);
+                        printf("[DEBUG] reconnect attempt %d failed , next in %lld ms\n", attempt, wait);
+                        rl_forced_update_display();
+                        pthread_mutex_unlock(&display_lck);
+                        }
+                    }
+                }
+            }
+
         // select to check if stdin has data . making readline non-blocking 
         fd_set readfds;
         FD_ZERO(&readfds);
@@ -292,6 +506,64 @@ int main(int argc, char* argv[])
             break;
             }
 
+        // file share : /send <path>   resume a download : /resume <blob id>
+        if ((strncmp(line, "/send ", 6) == 0 || strncmp(line, "/resume ", 8) == 0) && !server_up) {
+            fprintf(stderr, "[%s Error %s] | Not connected , try again after reconnect\n", FG_RED, RESET);
+            free(line);
+            continue;
+            }
+        if (strncmp(line, "/send ", 6) == 0) {
+            if (send_blob(sock, line + 6) < 0) {
+                fprintf(stderr, "[%s Error %s] | Blob upload failed\n", FG_RED, RESET);
+                }
+            else {
+                printf("[Blob] uploaded %s\n", line + 6);
+                }
+            free(line);
+            continue;
+            }
+        // roster : /who lists who is online , /nick <name> renames this client
+        if (strcmp(line, "/who") == 0) {
+            who_request = true;
+            free(line);
+            continue;
+            }
+        if (strncmp(line, "/nick ", 6) == 0) {
+            size_t nick_len = strlen(line + 6);
+            char req[HS_NAME_MAX + 16];
+            if (!server_up || !hs_name_ok(line + 6, nick_len)) {
+                fprintf(stderr, "[%s Error %s] | Not connected or not a valid name\n", FG_RED, RESET);
+                }
+            else {
+                int rlen = snprintf(req, sizeof(req), "!?!?NICK %s\n", line + 6);
+                if (send_all(sock, req, (size_t)rlen) < 0) {
+                    fprintf(stderr, "[%s Error %s] | send_all\n", FG_RED, RESET);
+                    }
+                // a reconnect uses the new name too
+                memcpy(client_info_t->client_name, line + 6, nick_len + 1);
+                }
+            free(line);
+            continue;
+            }
+        if (strncmp(line, "/resume ", 8) == 0) {
+            unsigned long long id = strtoull(line + 8, NULL, 16);
+            long long off = download_offset(id);
+            char req[64];
+            int rlen = snprintf(req, sizeof(req), "!?!?BGET %llx %lld\n", id, off < 0 ? 0 : off);
+            if (send_all(sock, req, (size_t)rlen) < 0) {
+                fprintf(stderr, "[%s Error %s] | send_all\n", FG_RED, RESET);
+                }
+            free(line);
+            continue;
+            }
+
+        // a line starting with MSG_SEPRATE would be a request , the server drops the ones it does not know
+        if (strncmp(line, MSG_SEPRATE, MSG_SEP_LEN) == 0) {
+            fprintf(stderr, "[%s Error %s] | A line can not start with %s\n", FG_RED, RESET, MSG_SEPRATE);
+            free(line);
+            continue;
+            }
+
         // add \n for transmission
         size_t line_len = strlen(line);
         char* line_wt_newline = (char*)malloc(line_len + 2);
@@ -304,12 +576,22 @@ int main(int argc, char* argv[])
         line_wt_newline[line_len] = '\n';
         line_wt_newline[line_len + 1] = '\0';
 
-        // send the user input
-        if (send_all(sock, line_wt_newline, (size_t)line_len + 1) < 0) {
-            fprintf(stderr, "[%s Error %s] | send_all\n", FG_RED, RESET);
+        // every line goes through the outbox (kept until the server acks it) , offline it waits there
+        outbox_push(&queue, line_wt_newline);
+        if (!server_up) {
+            pthread_mutex_lock(&display_lck);
+            printf("[Outbox] queued , %d line(s) waiting%s\n", queue.count, queue.dropped ? " (oldest dropped)" : "");
+            pthread_mutex_unlock(&display_lck);
             free(line_wt_newline);
             free(line);
-            break;
+            continue;
+            }
+        if (outbox_flush(&queue, sock) < 0) {
+            // connection broke under us , receiver thread ends on shutdown and reconnect starts
+            shutdown(sock, SHUT_RDWR);
+            free(line_wt_newline);
+            free(line);
+            continue;
             }
         if (debug) {
             pthread_mutex_lock(&display_lck);
@@ -320,6 +602,11 @@ int main(int argc, char* argv[])
         free(line_wt_newline);
         free(line);
 
+        }
+    // lines sent just now are acked within a tick , do not leave them for a resend by the next run
+    for (int k = 0;k < 50 && server_up && queue.count > 0;k++) {
+        usleep(10000);
+        outbox_ack(&queue, cseq_acked);
         }
     // cleanup 
     clinet_active = false;
@@ -327,9 +614,14 @@ int main(int argc, char* argv[])
     if (debug) {
         printf("\nWaiting for receiver thread to finish...\n");
         }
-    pthread_join(recever_th, NULL);
+    if (th_joinable) {
+        pthread_join(recever_th, NULL);
+        }
+    outbox_close(&queue);
     free_client(client_info_t);
-    close(sock);
+    if (sock >= 0) {
+        close(sock);
+        }
 
     rl_clear_history();
     if (debug) {
@@ -13,6 +13,15 @@
 #include <readline/readline.h> //readline is used for better GUI 
 #include <readline/history.h>
 #include <fcntl.h>    // used for file control 
+#include <poll.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <zlib.h>
+#include "../handshake.h"
 #define UUIDE_FILE "client_uuid.txt"
 
 // Style macros
@@ -70,32 +79,78 @@
 #define MSG_SEPRATE "!?!?"
 #define MSG_SEP_LEN strlen(MSG_SEPRATE)
 #define META_D_BUFFER_SIZE 256
+#define DOWNLOAD_DIR "downloads"
+#define DOWNLOAD_MAX 32        // blobs tracked at same time
+#define BLOB_NAME_MAX 64
+#define CTRL_LINE_MAX 512      // longest control line from server
+#define ROSTER_SLOTS 1024      // = slot part of a member id (ROSTER_SLOT_BITS of server roster.h)
+#define OUTBOX_FILE "client_outbox.txt"
+#define OUTBOX_MAX 256         // lines not acked by the server (unsent or in flight) , oldest is dropped above this
+#define ACK_EVERY 32           // room msgs per cumulative ACK
+#define ACK_DELAY_MS 500       // fewer msgs are acked after this
+#define BACKOFF_BASE_MS 250    // first reconnect waits up to this
+#define BACKOFF_CAP_MS 30000   // max reconnect wait
+#define CONNECT_TIMEOUT_MS 3000
+#define FRAME_MS 33            // received text is painted at most every FRAME_MS (~30 frames per second)
+#define VIEW_BACKLOG_MAX (512 * 1024)   // text waiting for the next frame , lines above this are dropped from view
+#define ZDICT_MAX 8192         // = ZDICT_MAX of server zwire.h
+#define Z_RAW_MAX (64 * 1024)  // = ZW_MSG_MAX of server zwire.h
+#define Z_FRAME_MAX (Z_RAW_MAX + 1024)
+#define EV_TEXT_MAX 96         // = UDP_TEXT_MAX of server udp_lane.h
+#define EV_DGRAM_MAX 1200      // = UDP_DGRAM_MAX of server udp_lane.h
+#define TYPING_EVERY_MS 2000   // one typing event per this while keys come
+#define TYPING_SHOW_MS 4000    // "is typing" of a member shown again after a pause this long
+#define PRESENCE_MS 30000      // presence ping , /who shows when a member was last active
+#define UDP_HELLO_MS 1000
+#define UDP_HELLO_TRIES 3      // no UACK after these , events stay on TCP
 
 // -------------------global variable--------------------
 bool clinet_active = true;
 bool debug = false;
+atomic_bool server_up = false;    // cleared by recever_thread when the connection is lost
+atomic_bool who_request = false;  // /who , printed by recever_thread (owner of the roster)
+atomic_ullong cseq_acked = 0;     // last own chat line the server took (CACK) , outbox drops up to it
+atomic_ullong lines_sent = 0;     // own chat lines written to the socket , the room seqs they take are not sent back to us
+atomic_bool typing_key = false;   // readline got a key of a chat line , recever_thread sends the typing event
 static pthread_mutex_t display_lck = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t send_lck = PTHREAD_MUTEX_INITIALIZER;   // main thread sends chat / blobs , recever_thread sends PONG
 // ------------------------------------------------------
 
 // data structures
 typedef struct client_info {
-    char* client_name;
-    char* server_name;
-    char* cli_display_color;
-    char* cli_uuid;
+    char client_name[HS_NAME_MAX + 1];
+    char server_name[HS_NAME_MAX + 1];
+    const char* cli_display_color;   // points into display_colors[]
+    char cli_uuid[37];
     int sock;
+    // resume point of the room msgs , kept over reconnects (recever_thread writes it when it ends)
+    uint32_t seq_boot;
+    unsigned long long seq_last;
+    unsigned long long lines_base;   // lines_sent at the SYNC of this connection
 
     }client_info;
 
-static int send_all(int sock, const void* buf, size_t len)
+// socket is non-blocking (set by recever_thread) , so wait until it is writable again
+static int wait_writable(int sock)
+    {
+    struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+    int r;
+    while ((r = poll(&pfd, 1, -1)) < 0 && errno == EINTR) {}
+    return r;
+    }
+
+// caller holds send_lck (or is the only sender)
+static int send_raw(int sock, const void* buf, size_t len)
     {
     const char* p = (const char*)buf;
     size_t total = 0;
     while (total < len) {
-        ssize_t n = send(sock, p + total, len - total, 0);
+        ssize_t n = send(sock, p + total, len - total, MSG_NOSIGNAL);
         if (n < 0) {
             // interrupted by signal
             if (errno == EINTR)continue;
+            // send buffer full
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(sock) > 0)continue;
             // other error
             return -1;
             }
@@ -108,71 +163,46 @@ static int send_all(int sock, const void* buf, size_t len)
     return (int)total;
     }
 
+// one whole frame , never interleaved with a frame of the other thread
+static int send_all(int sock, const void* buf, size_t len)
+    {
+    pthread_mutex_lock(&send_lck);
+    int r = send_raw(sock, buf, len);
+    pthread_mutex_unlock(&send_lck);
+    return r;
+    }
+
 // check quit
 bool quit_check(char* line)
     {
     return (strcmp(line, "quit") == 0 || strcmp(line, "exit") == 0);
     }
 
-// display color for client
-void color_pick(client_info** cli_, int num)
-    {
-    switch (num)
-        {
-        case 0:
-            (*cli_)->cli_display_color = strdup(FG_BBLUE);
-            break;
-
-        case 1:
-            (*cli_)->cli_display_color = strdup(FG_BCYAN);
-            break;
-
-        case 2:
-            (*cli_)->cli_display_color = strdup(FG_BGREEN);
-            break;
-
-        case 3:
-            (*cli_)->cli_display_color = strdup(FG_BMAGENTA);
-            break;
-
-        case 4:
-            (*cli_)->cli_display_color = strdup(FG_BRED);
-            break;
-
-        case 5:
-            (*cli_)->cli_display_color = strdup(FG_BWHITE);
-            break;
-
-        case 6:
-            (*cli_)->cli_display_color = strdup(FG_BYELLOW);
-            break;
+// display color for client (index = color code from server)
+static const char* const display_colors[] = {
+    FG_BBLUE, FG_BCYAN, FG_BGREEN, FG_BMAGENTA, FG_BRED, FG_BWHITE, FG_BYELLOW
+    };
 
-        default:
-            (*cli_)->cli_display_color = strdup(FG_BBLACK);
-            break;
+const char* color_pick(int num)
+    {
+    if (num < 0 || num >= (int)(sizeof(display_colors) / sizeof(display_colors[0]))) {
+        return FG_BBLACK;
         }
+    return display_colors[num];
     }
 
-// break meta_data_msg into particular sub_msg
-
-bool break_meta_d(client_info** cli__, char* buffer)
+// break meta_data_msg (server welcome) into particular sub_msg
+bool break_meta_d(client_info* cli__, const char* buffer, size_t n)
     {
-    char* ptr;
-    short int size;
-    if ((ptr = strstr(buffer, MSG_SEPRATE))!= NULL) {
-        size = ptr - buffer;
-        // 1.name filling
-        (*cli__)->server_name = strndup(buffer, size);
-        ptr = ptr + MSG_SEP_LEN ;
-        // 2. color_code filling
-        int c_code = *ptr - '0';
-        color_pick(&(*cli__), c_code);
-        return true;
+    hs_welcome w;
+    if (hs_decode_welcome(buffer, n, &w) < 0) {
+        return false;
         }
-    return false;
+    memcpy(cli__->server_name, w.server, (size_t)w.server_len + 1);
+    cli__->cli_display_color = color_pick(w.color);
+    return true;
     }
 
-
 void generate_store_uuid(char* uuid_str)
     {
     uuid_t uuid;
@@ -220,44 +250,1168 @@ void uuid_fetch(char* cli__uuid, bool debug)
         }
     }
 
-bool combine_msg(char* msg, char* new_msg, bool debug)
+long long now_ms()
     {
-    // sequence : 1.client name is already present in msg [we have to remove the \n from buffer]
-    // 2.MSG_SEPERATE + uuid of client
-    /*
-    NOTE: 1. fgets , if string (str) string_len is n(len is returned by strlen ) .
-             then the str[n] == '\n' and str[n+1] == '\0'  */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+    }
 
-    int size_dest = strlen(msg), size_src = strlen(new_msg);
-    msg[size_dest - 1] = '\0';
-    if (size_dest + size_src + 1 < META_D_BUFFER_SIZE) {
-        strcat(msg, MSG_SEPRATE);
-        strcat(msg, new_msg);
-        if (debug) {
-            printf("meta buffer : %s\n", msg);
+// ----------------------------- blob transfer ------------------------------
+/*
+protocol (see blob.h of server) :
+    upload   : !?!?BLOB <size> <name>\n + raw bytes (sendfile from the file)
+    incoming : !?!?BLOB <id> <size> <name>\n  then  !?!?CHUNK <id> <off> <len>\n + raw bytes
+    resume   : !?!?BGET <id> <offset>\n
+files are saved as downloads/<id>_<name>
+*/
+typedef struct download {
+    unsigned long long id;
+    long long size;
+    long long got;
+    int fd;
+    char name[BLOB_NAME_MAX + 1];
+    }download;
+
+// ----------------------------- compressed room msgs ------------------------------
+/*
+protocol (see zwire.h of server , only when it runs with -Z) :
+    ask      : !?!?ZLIB <dict id>\n  (right after the handshake , 0 = no dictionary kept)
+    incoming : !?!?ZDICT <id> <len>\n + dictionary  ,  !?!?Z <len>\n + one raw deflate room msg
+the dictionary is kept over reconnects , the server sends it again only when it changed
+*/
+enum z_kind {
+    ZK_NONE = 0,
+    ZK_DICT,
+    ZK_MSG,
+    ZK_SKIP    // too long , read over
+    };
+
+typedef struct zclient {
+    z_stream inf;
+    bool inf_ok;
+    uint8_t dict[ZDICT_MAX];
+    size_t dict_len;
+    uint32_t dict_id;
+    uint8_t in[Z_FRAME_MAX];    // body being read
+    char out[Z_RAW_MAX];        // inflated msg being shown
+    }zclient;
+
+zclient zc;   // only recever_thread decodes , session_handshake reads dict_id before it starts
+
+/*
+roster (see roster.h of server) : SNAP + MEMB lines once , then JOIN / LEFT / NICK deltas with epochs ,
+"!?!?FROM <id> [<seq>]" names the sender (and the room seq) of the chat lines after it
+an entry keeps the name of the member which had the slot before , chat queued before a LEFT
+can arrive after the control lane already told us about it
+*/
+typedef struct roster_entry {
+    uint32_t id;          // 0 = empty
+    char name[HS_NAME_MAX + 1];
+    long long seen_ms;    // last event of the member (typing / presence)
+    long long typing_ms;
+    uint32_t prev_id;
+    char prev_name[HS_NAME_MAX + 1];
+    }roster_entry;
+
+typedef struct roster_view {
+    bool active;                  // first SNAP arrived
+    unsigned long long epoch;
+    int snap_left;                // MEMB lines still expected , -1 = asked for a new SNAP
+    int count;
+    uint32_t from_id;             // sender of the next chat line
+    roster_entry e[ROSTER_SLOTS];
+    }roster_view;
+
+typedef struct stream_parser {
+    bool at_line_start;
+    char line[CTRL_LINE_MAX];   // control line being collected
+    size_t line_len;
+    bool in_ctrl;
+    long long body_left;        // raw CHUNK bytes still expected
+    long long body_off;
+    download* body_dl;
+    download dl[DOWNLOAD_MAX];
+    bool pong_pending;          // server sent PING , recever_thread answers with PONG
+    long long ping_ts;
+    bool resync_pending;        // roster epoch gap , ask for a new SNAP
+    roster_view roster;
+    // room seqs (delivery.h of server)
+    uint32_t boot;
+    unsigned long long seq_next;   // seq of next chat line , 0 = not numbered
+    unsigned long long seq_last;   // newest msg shown , a replayed msg up to it is a duplicate
+    unsigned long long seq_acked;
+    unsigned long long seq_expect; // seq the next FROM should have , 0 = any (SEQ came)
+    unsigned long long seq_head;   // newest seq at the SEQ , the replay up to it skips msgs of our uuid
+    unsigned long long lines_used; // own lines (lines_sent) a skipped seq was taken by
+    long long ack_ms;
+    bool skip_line;                // rest of current chat line is a duplicate
+    // Z frames (zc holds the bytes)
+    int zkind;
+    long long zleft;               // body bytes still expected
+    size_t zin_len;
+    uint32_t zid;                  // id of the ZDICT being read
+    size_t zout_len;               // inflated msg , shown from zout_off
+    size_t zout_off;
+    }stream_parser;
+
+void parser_init(stream_parser* sp)
+    {
+    memset(sp, 0, sizeof(*sp));
+    sp->at_line_start = true;
+    for (int k = 0;k < DOWNLOAD_MAX;k++) {
+        sp->dl[k].fd = -1;
+        }
+    }
+
+download* download_find(stream_parser* sp, unsigned long long id)
+    {
+    for (int k = 0;k < DOWNLOAD_MAX;k++) {
+        if (sp->dl[k].fd != -1 && sp->dl[k].id == id) {
+            return &sp->dl[k];
+            }
+        }
+    return NULL;
+    }
+
+// name of the server side file is cleaned by server , still never trust a '/'
+download* download_open(stream_parser* sp, unsigned long long id, long long size, const char* name)
+    {
+    download* d = download_find(sp, id);
+    if (d) {
+        return d;
+        }
+    for (int k = 0;k < DOWNLOAD_MAX;k++) {
+        if (sp->dl[k].fd == -1) {
+            d = &sp->dl[k];
+            break;
+            }
+        }
+    if (!d || strchr(name, '/')) {
+        return NULL;
+        }
+    mkdir(DOWNLOAD_DIR, 0755);
+    char path[BLOB_NAME_MAX + 64];
+    snprintf(path, sizeof(path), "%s/%llx_%s", DOWNLOAD_DIR, id, name);
+    // no O_TRUNC , an existing partial file is resumed
+    d->fd = open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    if (d->fd < 0) {
+        return NULL;
+        }
+    struct stat st;
+    fstat(d->fd, &st);
+    d->id = id;
+    d->size = size;
+    d->got = st.st_size;
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    return d;
+    }
+
+void download_close(download* d)
+    {
+    close(d->fd);
+    d->fd = -1;
+    }
+
+// ----------------------------- roster view ------------------------------
+static roster_entry* roster_slot(roster_view* rv, uint32_t id)
+    {
+    return &rv->e[id % ROSTER_SLOTS];
+    }
+
+const char* roster_name(roster_view* rv, uint32_t id)
+    {
+    roster_entry* re = roster_slot(rv, id);
+    if (id != 0 && re->id == id) {
+        return re->name;
+        }
+    if (id != 0 && re->prev_id == id) {
+        return re->prev_name;
+        }
+    return "Other Client";
+    }
+
+static void roster_set(roster_view* rv, uint32_t id, const char* name)
+    {
+    roster_entry* re = roster_slot(rv, id);
+    if (re->id != id) {
+        if (re->id != 0) {
+            re->prev_id = re->id;
+            memcpy(re->prev_name, re->name, sizeof(re->name));
+            }
+        else {
+            rv->count++;
             }
+        re->id = id;
+        re->seen_ms = re->typing_ms = 0;
+        }
+    snprintf(re->name, sizeof(re->name), "%s", name);
+    }
 
+static void roster_unset(roster_view* rv, uint32_t id)
+    {
+    roster_entry* re = roster_slot(rv, id);
+    if (re->id != id) {
+        return;
+        }
+    re->prev_id = re->id;
+    memcpy(re->prev_name, re->name, sizeof(re->name));
+    re->id = 0;
+    rv->count--;
+    }
+
+/*
+epoch check of a delta
+    return false : skip it (old , or a gap -> resync asked)
+*/
+static bool roster_next(stream_parser* sp, unsigned long long epoch)
+    {
+    roster_view* rv = &sp->roster;
+    if (!rv->active || rv->snap_left != 0 || epoch <= rv->epoch) {
+        return false;
+        }
+    if (epoch != rv->epoch + 1) {
+        sp->resync_pending = true;
+        return false;
+        }
+    rv->epoch = epoch;
+    return true;
+    }
+
+void roster_print(roster_view* rv)
+    {
+    pthread_mutex_lock(&display_lck);
+    if (!rv->active) {
+        printf("\r\033[K[Roster] not received yet\n");
+        }
+    else {
+        printf("\r\033[K[Roster] %d online (epoch %llu) :\n", rv->count, rv->epoch);
+        long long now = now_ms();
+        for (int k = 0;k < ROSTER_SLOTS;k++) {
+            if (rv->e[k].id == 0) {
+                continue;
+                }
+            if (rv->e[k].seen_ms != 0) {
+                printf("    %s (active %llds ago)\n", rv->e[k].name, (now - rv->e[k].seen_ms) / 1000);
+                }
+            else {
+                printf("    %s\n", rv->e[k].name);
+                }
+            }
+        }
+    rl_forced_update_display();
+    pthread_mutex_unlock(&display_lck);
+    }
+
+// ----------------------------- event lane ------------------------------
+/*
+events (see udp_lane.h of server) : typing / presence , loss tolerant , never in the outbox .
+session_handshake asks with "!?!?UDP" , the server answers "!?!?UTOK <port> <id> <token>" ,
+port 0 = no UDP there . with a port : hello datagrams until "!?!?UACK" , then events go as
+"!?!?UEV <id> <token> <type> <text>" datagrams , else as "!?!?EV <type> <text>" on TCP .
+incoming "!?!?EV <from id> <type> <text>" lines come in datagrams or on the TCP control lane .
+only recever_thread touches this (the main thread sets typing_key)
+*/
+enum ev_type {
+    EV_HELLO = 0,
+    EV_TYPING,
+    EV_PRESENCE
+    };
+
+typedef struct ev_lane {
+    int fd;                  // UDP socket , kept over reconnects (-1 = none yet)
+    unsigned short port;     // from UTOK , 0 = no UDP
+    bool connect_pending;    // UTOK came , socket connects in ev_pump()
+    bool up;                 // UACK came
+    uint32_t id;             // own member id , own events are skipped
+    unsigned long long token;
+    int hellos;
+    long long hello_ms;
+    long long typing_ms;
+    long long presence_ms;
+    }ev_lane;
+
+ev_lane evl = { .fd = -1 };
+
+// new connection , events go over TCP until the next UTOK / UACK
+void ev_reset()
+    {
+    evl.port = 0;
+    evl.connect_pending = evl.up = false;
+    evl.id = 0;
+    evl.token = 0;
+    evl.presence_ms = 0;
+    }
+
+/*
+event of member from for the user
+    return false : nothing to show (own event , presence , typing shown a moment ago)
+*/
+static bool ev_note(roster_view* rv, uint32_t from, int type, const char* text, char* note, size_t cap)
+    {
+    roster_entry* re = &rv->e[from % ROSTER_SLOTS];
+    if (from == evl.id || !rv->active || re->id != from) {
+        return false;
+        }
+    long long now = now_ms();
+    long long last = re->typing_ms;
+    re->seen_ms = now;
+    if (type == EV_TYPING) {
+        re->typing_ms = now;
+        if (now - last < TYPING_SHOW_MS) {
+            return false;
+            }
+        snprintf(note, cap, "[Typing] %s is typing ...", re->name);
         return true;
         }
-    //Final sequence : clinet name + MSG_SEPERATE + uuid  
-    return false;
+    if (type == EV_PRESENCE) {
+        return false;
+        }
+    snprintf(note, cap, "[Event] %s : %d %s", re->name, type, text);
+    return true;
     }
 
-void free_client(client_info* client)
+// one event , datagram when the UDP path is up , else a TCP line (skipped while the main thread sends)
+static void ev_send(int sock, int type, const char* text)
+    {
+    char line[EV_TEXT_MAX + 64];
+    if (evl.up || (type == EV_HELLO && evl.fd >= 0)) {
+        int len = snprintf(line, sizeof(line), "!?!?UEV %x %llx %d %.*s\n", evl.id, evl.token, type, EV_TEXT_MAX, text);
+        send(evl.fd, line, (size_t)len, MSG_DONTWAIT);
+        return;
+        }
+    if (type == EV_HELLO || pthread_mutex_trylock(&send_lck) != 0) {
+        return;
+        }
+    int len = snprintf(line, sizeof(line), "!?!?EV %d %.*s\n", type, EV_TEXT_MAX, text);
+    send_raw(sock, line, (size_t)len);
+    pthread_mutex_unlock(&send_lck);
+    }
+
+// UDP setup after UTOK , hello retries , typing and presence events that are due (recever_thread)
+void ev_pump(int sock)
     {
-    if (client->cli_display_color) {
-        free(client->cli_display_color);
+    long long now = now_ms();
+    if (evl.connect_pending) {
+        evl.connect_pending = false;
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (evl.fd < 0) {
+            evl.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            }
+        // same server address as the TCP connection , port from UTOK
+        if (evl.fd >= 0 && getpeername(sock, (struct sockaddr*)&addr, &len) == 0) {
+            addr.sin_port = htons(evl.port);
+            if (connect(evl.fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+                evl.hellos = 0;
+                evl.hello_ms = 0;
+                }
+            else {
+                evl.port = 0;
+                }
+            }
         }
-    if (client->client_name) {
-        free(client->client_name);
+    if (evl.port != 0 && !evl.up && evl.hellos < UDP_HELLO_TRIES && now - evl.hello_ms >= UDP_HELLO_MS) {
+        ev_send(sock, EV_HELLO, "");
+        evl.hellos++;
+        evl.hello_ms = now;
         }
-    if (client->server_name) {
-        free(client->server_name);
+    if (typing_key) {
+        typing_key = false;
+        if (now - evl.typing_ms >= TYPING_EVERY_MS) {
+            evl.typing_ms = now;
+            ev_send(sock, EV_TYPING, "");
+            }
         }
-    if (client->cli_uuid) {
-        free(client->cli_uuid); 
+    if (evl.id != 0 && now - evl.presence_ms >= PRESENCE_MS) {
+        evl.presence_ms = now;
+        ev_send(sock, EV_PRESENCE, "");
         }
-    if (client) {
-        free(client);
+    }
+
+/*
+datagrams from the server : UACK , EV lines
+    note : called for every event worth showing
+*/
+void ev_poll(roster_view* rv, void (*note)(void* ctx, const char* text), void* ctx)
+    {
+    char d[EV_DGRAM_MAX + 1];
+    ssize_t n;
+    while (evl.fd >= 0 && (n = recv(evl.fd, d, EV_DGRAM_MAX, MSG_DONTWAIT)) > 0) {
+        d[n] = '\0';
+        for (char* line = d, *nl;(nl = strchr(line, '\n')) != NULL;line = nl + 1) {
+            *nl = '\0';
+            unsigned int from;
+            int type, pos = 0;
+            char text[EV_TEXT_MAX + 64];
+            if (strcmp(line, "!?!?UACK") == 0) {
+                evl.up = (evl.port != 0);
+                }
+            else if (sscanf(line, "!?!?EV %x %d%n", &from, &type, &pos) == 2 &&
+                ev_note(rv, from, type, line + pos + (line[pos] == ' '), text, sizeof(text))) {
+                note(ctx, text);
+                }
+            }
+        }
+    }
+
+// append a notice for the user to the chat output
+static void parser_notice(char* out, size_t* out_len, size_t cap, const char* text)
+    {
+    int w = snprintf(out + *out_len, cap - *out_len, "%s\n", text);
+    if (w > 0) {
+        *out_len += ((size_t)w < cap - *out_len) ? (size_t)w : cap - *out_len - 1;
+        }
+    }
+
+/*
+body of a Z / ZDICT frame is in zc.in : keep the dictionary , or inflate the msg into zc.out
+(parser_feed shows it as chat)
+*/
+static void parser_zframe(stream_parser* sp, char* out, size_t* out_len, size_t cap)
+    {
+    int kind = sp->zkind;
+    sp->zkind = ZK_NONE;
+    if (kind == ZK_DICT) {
+        memcpy(zc.dict, zc.in, sp->zin_len);
+        zc.dict_len = sp->zin_len;
+        zc.dict_id = sp->zid;
+        return;
+        }
+    if (kind == ZK_MSG) {
+        if (!zc.inf_ok) {
+            zc.inf_ok = (inflateInit2(&zc.inf, -15) == Z_OK);
+            }
+        if (zc.inf_ok && inflateReset(&zc.inf) == Z_OK &&
+            (zc.dict_len == 0 || inflateSetDictionary(&zc.inf, zc.dict, (uInt)zc.dict_len) == Z_OK)) {
+            zc.inf.next_in = zc.in;
+            zc.inf.avail_in = (uInt)sp->zin_len;
+            zc.inf.next_out = (Bytef*)zc.out;
+            zc.inf.avail_out = sizeof(zc.out);
+            if (inflate(&zc.inf, Z_FINISH) == Z_STREAM_END) {
+                sp->zout_len = sizeof(zc.out) - zc.inf.avail_out;
+                sp->zout_off = 0;
+                return;
+                }
+            }
+        }
+    parser_notice(out, out_len, cap, "[Zlib] bad compressed msg , not shown");
+    }
+
+/*
+room seq of a "!?!?FROM" , the server only jumps over msgs we do not get :
+    1. first FROM after a SEQ : any seq
+    2. up to the SEQ head : replay leaves out the msgs of our uuid
+    3. after it : at most one seq per own line sent on this connection
+    return false : goes back or skips too far , ignore the FROM
+*/
+static bool parser_seq_ok(stream_parser* sp, unsigned long long seq)
+    {
+    if (sp->seq_expect == 0) {
+        sp->seq_expect = seq;
+        return true;
+        }
+    if (seq < sp->seq_expect) {
+        return false;
+        }
+    unsigned long long skip = seq - sp->seq_expect;
+    if (sp->seq_head >= sp->seq_expect) {
+        unsigned long long replay = sp->seq_head - sp->seq_expect + 1;
+        skip = (skip > replay) ? skip - replay : 0;
+        }
+    unsigned long long own = lines_sent - sp->lines_used;
+    if (skip > own) {
+        return false;
+        }
+    sp->lines_used += skip;
+    sp->seq_expect = seq;
+    return true;
+    }
+
+static void parser_ctrl_line(stream_parser* sp, char* out, size_t* out_len, size_t cap)
+    {
+    unsigned long long id, ep;
+    unsigned int rid;
+    unsigned short port;
+    int pos = 0, a_pos = 0;
+    long long a, b;
+    char name[BLOB_NAME_MAX + 1];
+    char note[CTRL_LINE_MAX + 64];
+    sp->line[sp->line_len] = '\0';
+    if (sscanf(sp->line, "!?!?CHUNK %llx %lld %lld", &id, &a, &b) == 3) {
+        sp->body_dl = download_find(sp, id);
+        sp->body_off = a;
+        sp->body_left = b;
+        }
+    else if (sscanf(sp->line, "!?!?BLOB %llx %lld %64s", &id, &a, name) == 3) {
+        download* d = download_open(sp, id, a, name);
+        snprintf(note, sizeof(note), "[Blob] incoming %s (%lld bytes) id=%llx%s", name, a, id, d ? "" : " [can not save]");
+        parser_notice(out, out_len, cap, note);
+        }
+    else if ((pos = sscanf(sp->line, "!?!?FROM %x %llu", &rid, &ep)) >= 1) {
+        // a seq which goes back or skips more than the replay + our own lines is not from the server
+        if (pos == 2 && !parser_seq_ok(sp, ep)) {
+            return;
+            }
+        sp->roster.from_id = rid;
+        sp->seq_next = (pos == 2) ? ep : 0;
+        }
+    else if (sscanf(sp->line, "!?!?SEQ %x %llu %llu", &rid, &ep, &id) == 3) {
+        // other server run , our old seqs mean nothing there
+        if (rid != sp->boot) {
+            sp->boot = rid;
+            sp->seq_last = sp->seq_acked = 0;
+            }
+        sp->seq_expect = 0;
+        sp->seq_head = ep;
+        if (id > 0) {
+            snprintf(note, sizeof(note), "[Sync] %llu msg(s) missed , too old to be sent again", id);
+            parser_notice(out, out_len, cap, note);
+            }
+        }
+    else if (sscanf(sp->line, "!?!?CACK %llu", &id) == 1) {
+        cseq_acked = id;
+        }
+    else if (sscanf(sp->line, "!?!?JOIN %llu %x %n", &ep, &rid, &pos) == 2 && pos > 0) {
+        if (roster_next(sp, ep)) {
+            roster_set(&sp->roster, rid, sp->line + pos);
+            snprintf(note, sizeof(note), "[Roster] %s joined (%d online)", sp->line + pos, sp->roster.count);
+            parser_notice(out, out_len, cap, note);
+            }
+        }
+    else if (sscanf(sp->line, "!?!?LEFT %llu %x", &ep, &rid) == 2) {
+        if (roster_next(sp, ep)) {
+            snprintf(note, sizeof(note), "[Roster] %s left", roster_name(&sp->roster, rid));
+            roster_unset(&sp->roster, rid);
+            parser_notice(out, out_len, cap, note);
+            }
         }
-    }
\ No newline at end of file
+    else if (sscanf(sp->line, "!?!?NICK %llu %x %n", &ep, &rid, &pos) == 2 && pos > 0) {
+        if (roster_next(sp, ep)) {
+            snprintf(note, sizeof(note), "[Roster] %s is now %s", roster_name(&sp->roster, rid), sp->line + pos);
+            roster_set(&sp->roster, rid, sp->line + pos);
+            parser_notice(out, out_len, cap, note);
+            }
+        }
+    else if (sscanf(sp->line, "!?!?MEMB %x %n", &rid, &pos) == 1 && pos > 0) {
+        if (sp->roster.snap_left > 0) {
+            roster_set(&sp->roster, rid, sp->line + pos);
+            if (--sp->roster.snap_left == 0) {
+                snprintf(note, sizeof(note), "[Roster] %d online (/who lists them)", sp->roster.count);
+                parser_notice(out, out_len, cap, note);
+                }
+            }
+        }
+    else if (sscanf(sp->line, "!?!?SNAP %llu %d", &ep, &pos) == 2) {
+        // full state , drop the old view (names of old senders stay as prev_name)
+        roster_view* rv = &sp->roster;
+        for (int k = 0;k < ROSTER_SLOTS;k++) {
+            if (rv->e[k].id != 0) {
+                roster_unset(rv, rv->e[k].id);
+                }
+            }
+        rv->active = true;
+        rv->epoch = ep;
+        rv->count = 0;
+        rv->snap_left = pos;
+        sp->resync_pending = false;
+        }
+    else if (sscanf(sp->line, "!?!?PING %lld", &a) == 1) {
+        sp->ping_ts = a;
+        sp->pong_pending = true;
+        }
+    else if (sscanf(sp->line, "!?!?ZDICT %x %lld", &rid, &a) == 2 && a >= 0) {
+        sp->zkind = (a <= ZDICT_MAX) ? ZK_DICT : ZK_SKIP;
+        sp->zid = rid;
+        sp->zleft = a;
+        sp->zin_len = 0;
+        if (a == 0) {
+            parser_zframe(sp, out, out_len, cap);
+            }
+        }
+    else if (sscanf(sp->line, "!?!?Z %lld", &a) == 1 && a > 0) {
+        sp->zkind = (a <= Z_FRAME_MAX) ? ZK_MSG : ZK_SKIP;
+        sp->zleft = a;
+        sp->zin_len = 0;
+        }
+    else if (sscanf(sp->line, "!?!?EV %x %d%n", &rid, &pos, &a_pos) == 2) {
+        if (ev_note(&sp->roster, rid, pos, sp->line + a_pos + (sp->line[a_pos] == ' '), note, sizeof(note))) {
+            parser_notice(out, out_len, cap, note);
+            }
+        }
+    else if (sscanf(sp->line, "!?!?UTOK %hu %x %llx", &port, &rid, &id) == 3) {
+        evl.port = port;
+        evl.id = rid;
+        evl.token = id;
+        evl.up = false;
+        evl.connect_pending = (port != 0);
+        }
+    else if (sscanf(sp->line, "!?!?BERR %llx", &id) == 1) {
+        snprintf(note, sizeof(note), "[Blob] server has no blob %llx", id);
+        parser_notice(out, out_len, cap, note);
+        }
+    else if (sscanf(sp->line, "!?!?BFAIL %lld %64s", &a, name) == 2) {
+        snprintf(note, sizeof(note), "[Blob] upload of %s (%lld bytes) failed on the server", name, a);
+        parser_notice(out, out_len, cap, note);
+        }
+    // unknown control lines are ignored (newer server)
+    }
+
+// "name: " in front of a chat line (once the roster is known)
+static void parser_label(stream_parser* sp, char* out, size_t* out_len)
+    {
+    if (!sp->roster.active) {
+        return;
+        }
+    const char* name = roster_name(&sp->roster, sp->roster.from_id);
+    size_t len = strlen(name);
+    memcpy(out + *out_len, name, len);
+    memcpy(out + *out_len + len, ": ", 2);
+    *out_len += len + 2;
+    }
+
+/*
+start of a chat line : seq check , then the sender label
+    return false : a replayed msg which was shown already , skip the line
+*/
+static bool parser_chat_begin(stream_parser* sp, char* out, size_t* out_len)
+    {
+    if (sp->seq_next != 0) {
+        unsigned long long seq = sp->seq_next++;
+        sp->seq_expect = seq + 1;
+        if (seq <= sp->seq_last) {
+            return false;
+            }
+        sp->seq_last = seq;
+        }
+    parser_label(sp, out, out_len);
+    return true;
+    }
+
+/*
+split the bytes from server into chat text and control frames
+    out : chat text (+ notices , sender labels) to display , out_len its length , cap > 2 * CTRL_LINE_MAX
+    return : bytes of data used , the caller displays out and calls again with the rest
+             (and while parser_pending() , a long inflated msg is shown in pieces)
+*/
+size_t parser_feed(stream_parser* sp, const char* data, size_t n, char* out, size_t* out_len, size_t cap)
+    {
+    size_t i = 0;
+    *out_len = 0;
+    // room for one notice / label / separator fallback is always kept
+    while ((i < n || sp->zout_off < sp->zout_len) && cap - *out_len > 2 * CTRL_LINE_MAX) {
+        // 0. inflated room msg , chat like it came plain (it starts at a line start)
+        if (sp->zout_off < sp->zout_len) {
+            if (sp->zout_off == 0) {
+                sp->skip_line = !parser_chat_begin(sp, out, out_len);
+                }
+            size_t room = cap - *out_len - CTRL_LINE_MAX;
+            size_t take = (sp->zout_len - sp->zout_off < room) ? sp->zout_len - sp->zout_off : room;
+            if (!sp->skip_line) {
+                memcpy(out + *out_len, zc.out + sp->zout_off, take);
+                *out_len += take;
+                }
+            sp->zout_off += take;
+            if (sp->zout_off == sp->zout_len) {
+                sp->at_line_start = (zc.out[sp->zout_len - 1] == '\n');
+                sp->zout_off = sp->zout_len = 0;
+                }
+            continue;
+            }
+        // 1a. body of a Z / ZDICT frame
+        if (sp->zleft > 0) {
+            size_t take = ((long long)(n - i) < sp->zleft) ? n - i : (size_t)sp->zleft;
+            if (sp->zkind != ZK_SKIP) {
+                memcpy(zc.in + sp->zin_len, data + i, take);
+                sp->zin_len += take;
+                }
+            sp->zleft -= (long long)take;
+            i += take;
+            if (sp->zleft == 0) {
+                parser_zframe(sp, out, out_len, cap);
+                }
+            continue;
+            }
+        // 1b. raw body of a CHUNK
+        if (sp->body_left > 0) {
+            size_t take = ((long long)(n - i) < sp->body_left) ? n - i : (size_t)sp->body_left;
+            download* d = sp->body_dl;
+            if (d && pwrite(d->fd, data + i, take, sp->body_off) == (ssize_t)take) {
+                d->got = (sp->body_off + (long long)take > d->got) ? sp->body_off + (long long)take : d->got;
+                }
+            sp->body_off += (long long)take;
+            sp->body_left -= (long long)take;
+            i += take;
+            if (sp->body_left == 0 && d && d->got >= d->size) {
+                char note[BLOB_NAME_MAX + 96];
+                snprintf(note, sizeof(note), "[Blob] saved %s/%llx_%s (%lld bytes)", DOWNLOAD_DIR, d->id, d->name, d->size);
+                parser_notice(out, out_len, cap, note);
+                download_close(d);
+                }
+            continue;
+            }
+        // 2. control line (starts with MSG_SEPRATE at line start)
+        if (sp->in_ctrl || (sp->at_line_start && data[i] == MSG_SEPRATE[0])) {
+            sp->in_ctrl = true;
+            while (i < n && data[i] != '\n') {
+                if (sp->line_len < CTRL_LINE_MAX - 1) {
+                    sp->line[sp->line_len++] = data[i];
+                    }
+                i++;
+                // looked like a separator , but it is chat after all
+                if (sp->line_len <= MSG_SEP_LEN && memcmp(sp->line, MSG_SEPRATE, sp->line_len) != 0) {
+                    sp->skip_line = !parser_chat_begin(sp, out, out_len);
+                    if (!sp->skip_line) {
+                        memcpy(out + *out_len, sp->line, sp->line_len);
+                        *out_len += sp->line_len;
+                        }
+                    sp->line_len = 0;
+                    sp->in_ctrl = false;
+                    sp->at_line_start = false;
+                    break;
+                    }
+                }
+            if (sp->in_ctrl && i < n) {
+                i++;   // '\n'
+                // short line like "!?\n" is chat
+                if (sp->line_len < MSG_SEP_LEN) {
+                    if (parser_chat_begin(sp, out, out_len)) {
+                        memcpy(out + *out_len, sp->line, sp->line_len);
+                        *out_len += sp->line_len;
+                        out[(*out_len)++] = '\n';
+                        }
+                    }
+                else {
+                    parser_ctrl_line(sp, out, out_len, cap);
+                    }
+                sp->line_len = 0;
+                sp->in_ctrl = false;
+                sp->at_line_start = true;
+                }
+            continue;
+            }
+        // 3. chat bytes until end of line
+        if (sp->at_line_start) {
+            sp->skip_line = !parser_chat_begin(sp, out, out_len);
+            }
+        size_t room = cap - *out_len - CTRL_LINE_MAX;
+        size_t avail = (n - i < room) ? n - i : room;
+        const char* nl = memchr(data + i, '\n', avail);
+        size_t take = nl ? (size_t)(nl - (data + i)) + 1 : avail;
+        if (!sp->skip_line) {
+            memcpy(out + *out_len, data + i, take);
+            *out_len += take;
+            }
+        i += take;
+        sp->at_line_start = (nl != NULL);
+        }
+    return i;
+    }
+
+// part of an inflated msg is still to be shown
+static inline bool parser_pending(const stream_parser* sp)
+    {
+    return sp->zout_off < sp->zout_len;
+    }
+
+// cumulative ACK of shown msgs is due (every ACK_EVERY msgs , or ACK_DELAY_MS after the first unacked)
+static bool parser_ack_due(stream_parser* sp)
+    {
+    if (sp->seq_last <= sp->seq_acked) {
+        sp->ack_ms = 0;
+        return false;
+        }
+    if (sp->ack_ms == 0) {
+        sp->ack_ms = now_ms();
+        }
+    return sp->seq_last - sp->seq_acked >= ACK_EVERY || now_ms() - sp->ack_ms >= ACK_DELAY_MS;
+    }
+
+/*
+answers of recever_thread after parser_feed() : PONG for a PING (heartbeat , server.c) ,
+ROSTER for a roster epoch gap , ACK of shown msgs . skipped while the main thread holds the socket
+(blob upload) , the upload bytes keep the connection alive on the server side and the next PING is answered
+*/
+void parser_reply(stream_parser* sp, int sock)
+    {
+    bool ack = parser_ack_due(sp);
+    if ((!sp->pong_pending && !sp->resync_pending && !ack) || pthread_mutex_trylock(&send_lck) != 0) {
+        return;
+        }
+    char line[64];
+    if (ack) {
+        int len = snprintf(line, sizeof(line), "!?!?ACK %llu\n", sp->seq_last);
+        if (send_raw(sock, line, (size_t)len) >= 0) {
+            sp->seq_acked = sp->seq_last;
+            sp->ack_ms = 0;
+            }
+        }
+    if (sp->pong_pending) {
+        int len = snprintf(line, sizeof(line), "!?!?PONG %lld\n", sp->ping_ts);
+        send_raw(sock, line, (size_t)len);
+        sp->pong_pending = false;
+        }
+    if (sp->resync_pending) {
+        int len = snprintf(line, sizeof(line), "!?!?ROSTER %llu\n", sp->roster.epoch);
+        send_raw(sock, line, (size_t)len);
+        // stays set (deltas are skipped) until the SNAP arrives
+        sp->roster.snap_left = -1;
+        sp->resync_pending = false;
+        }
+    pthread_mutex_unlock(&send_lck);
+    }
+
+/*
+upload a file , header line then the bytes with sendfile (no user space copy)
+    return -1 : Error , 0 : Success
+*/
+int send_blob(int sock, const char* path)
+    {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+        }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        fprintf(stderr, "[%s Error %s] | Not a regular non empty file : %s\n", FG_RED, RESET, path);
+        close(fd);
+        return -1;
+        }
+    const char* base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    char hdr[BLOB_NAME_MAX + 64];
+    int hlen = snprintf(hdr, sizeof(hdr), "!?!?BLOB %lld %.*s\n", (long long)st.st_size, BLOB_NAME_MAX, base);
+    // header and body are one frame , a PONG must not land in the middle of the raw bytes
+    pthread_mutex_lock(&send_lck);
+    if (send_raw(sock, hdr, (size_t)hlen) < 0) {
+        pthread_mutex_unlock(&send_lck);
+        close(fd);
+        return -1;
+        }
+    off_t off = 0;
+    while (off < st.st_size) {
+        ssize_t m = sendfile(sock, fd, &off, (size_t)(st.st_size - off));
+        if (m < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(sock) > 0) continue;
+            perror("sendfile");
+            pthread_mutex_unlock(&send_lck);
+            close(fd);
+            return -1;
+            }
+        if (m == 0) {
+            break;
+            }
+        }
+    pthread_mutex_unlock(&send_lck);
+    close(fd);
+    return (off == st.st_size) ? 0 : -1;
+    }
+
+/*
+resume offset of a blob = size of downloads/<id>_* file (works after client restart too)
+    return -1 : no partial file
+*/
+long long download_offset(unsigned long long id)
+    {
+    char prefix[32];
+    int plen = snprintf(prefix, sizeof(prefix), "%llx_", id);
+    DIR* dir = opendir(DOWNLOAD_DIR);
+    if (!dir) {
+        return -1;
+        }
+    long long off = -1;
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, prefix, (size_t)plen) == 0) {
+            char path[PATH_MAX];
+            struct stat st;
+            int n = snprintf(path, sizeof(path), "%s/%s", DOWNLOAD_DIR, de->d_name);
+            if (n < 0 || (size_t)n >= sizeof(path)) {
+                // cut path would stat another file
+                continue;
+                }
+            if (stat(path, &st) == 0) {
+                off = st.st_size;
+                }
+            break;
+            }
+        }
+    closedir(dir);
+    return off;
+    }
+
+// ----------------------------- reconnect ------------------------------
+/*
+when the connection is lost the client keeps running :
+    1. every typed line goes to the outbox with its number , a ring of OUTBOX_MAX lines which is
+       also appended to OUTBOX_FILE (so lines survive a client restart too) . a line leaves the
+       outbox when the server acks it ("!?!?CACK <n>") , not when send() took it
+    2. reconnect is tried after a "full jitter" backoff : random wait in [0 , min(cap , base * 2^attempt)]
+       every client picks a different wait , so after a server restart they do not all come back
+       in the same moment
+    3. after the handshake (same uuid from client_uuid.txt) "!?!?CSEQ <run> <first>" and every line
+       of the outbox are sent again in order , the server drops the ones it took before the break
+journal = "!?!?CSEQ <run> <first>" then the lines , the numbers survive a restart (resend is deduped too)
+*/
+typedef struct outbox {
+    char* line[OUTBOX_MAX];    // each line ends with '\n'
+    unsigned long long cseq[OUTBOX_MAX];
+    int head;
+    int count;
+    int sent;                  // lines at head already sent on this connection
+    unsigned int run;          // numbering of this client process (or of the journal it continues)
+    unsigned long long next;   // number of next new line
+    long dropped;
+    FILE* journal;
+    }outbox;
+
+static unsigned int backoff_seed;
+
+// seed from uuid + pid + clock , two clients started together still get different waits
+void backoff_init(const char* uuid)
+    {
+    unsigned int h = 2166136261u;
+    for (const char* p = uuid; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+        }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    backoff_seed = h ^ (unsigned int)getpid() ^ (unsigned int)ts.tv_nsec;
+    }
+
+// wait before reconnect attempt number 'attempt' (0 based)
+long long backoff_delay_ms(int attempt)
+    {
+    long long ceil_ms = BACKOFF_BASE_MS;
+    for (int k = 0;k < attempt && ceil_ms < BACKOFF_CAP_MS;k++) {
+        ceil_ms *= 2;
+        }
+    if (ceil_ms > BACKOFF_CAP_MS) {
+        ceil_ms = BACKOFF_CAP_MS;
+        }
+    return (long long)(rand_r(&backoff_seed) % (unsigned int)(ceil_ms + 1));
+    }
+
+// add line to memory ring only (journal is written by caller)
+static void outbox_keep(outbox* ob, const char* line, unsigned long long cseq)
+    {
+    if (ob->count == OUTBOX_MAX) {
+        free(ob->line[ob->head]);
+        ob->head = (ob->head + 1) % OUTBOX_MAX;
+        ob->count--;
+        ob->sent -= (ob->sent > 0);
+        ob->dropped++;
+        }
+    int k = (ob->head + ob->count) % OUTBOX_MAX;
+    ob->line[k] = strdup(line);
+    ob->cseq[k] = cseq;
+    ob->count++;
+    }
+
+// load lines left from last run and open the journal for append (backoff_init() first , it seeds run)
+void outbox_open(outbox* ob)
+    {
+    memset(ob, 0, sizeof(*ob));
+    ob->run = (unsigned int)rand_r(&backoff_seed) | 1u;
+    ob->next = 1;
+    FILE* f = fopen(OUTBOX_FILE, "r");
+    if (f) {
+        char buf[4096];
+        unsigned int run;
+        unsigned long long first;
+        while (fgets(buf, sizeof(buf), f)) {
+            size_t n = strlen(buf);
+            // numbers of the last run , a line it sent and the server took is not delivered twice
+            if (ob->count == 0 && sscanf(buf, "!?!?CSEQ %u %llu", &run, &first) == 2 && first > 0) {
+                ob->run = run;
+                ob->next = first;
+                continue;
+                }
+            if (n > 0 && buf[n - 1] == '\n') {
+                outbox_keep(ob, buf, ob->next++);
+                }
+            }
+        fclose(f);
+        }
+    ob->dropped = 0;
+    ob->journal = fopen(OUTBOX_FILE, "a");
+    if (!ob->journal) {
+        perror("outbox journal");
+        }
+    }
+
+// rewrite journal with what is still queued (empty file when everything is acked)
+static void outbox_sync(outbox* ob)
+    {
+    if (!ob->journal) {
+        return;
+        }
+    fflush(ob->journal);
+    if (ftruncate(fileno(ob->journal), 0) < 0) {
+        perror("outbox truncate");
+        return;
+        }
+    if (ob->count > 0) {
+        fprintf(ob->journal, "!?!?CSEQ %u %llu\n", ob->run, ob->cseq[ob->head]);
+        }
+    for (int k = 0;k < ob->count;k++) {
+        fputs(ob->line[(ob->head + k) % OUTBOX_MAX], ob->journal);
+        }
+    fflush(ob->journal);
+    }
+
+// queue one line (with '\n') under the next number , memory + journal
+void outbox_push(outbox* ob, const char* line)
+    {
+    outbox_keep(ob, line, ob->next++);
+    if (ob->count == 1) {
+        // journal gets its CSEQ header first
+        outbox_sync(ob);
+        }
+    else if (ob->journal) {
+        fputs(line, ob->journal);
+        fflush(ob->journal);
+        }
+    }
+
+/*
+send the lines not sent on this connection yet
+    return -1 : Error [connection lost , lines stay queued]
+    return n  : lines sent
+*/
+int outbox_flush(outbox* ob, int sock)
+    {
+    int sent = 0;
+    while (ob->sent < ob->count) {
+        char* line = ob->line[(ob->head + ob->sent) % OUTBOX_MAX];
+        // counted before , the server can answer before send_all() returns
+        lines_sent++;
+        if (send_all(sock, line, strlen(line)) < 0) {
+            return -1;
+            }
+        ob->sent++;
+        sent++;
+        }
+    return sent;
+    }
+
+/*
+new connection : numbering first , then every line which is not acked (in order)
+    return -1 : Error [connection lost again]
+    return n  : lines sent
+*/
+int outbox_replay(outbox* ob, int sock)
+    {
+    char hdr[64];
+    int len = snprintf(hdr, sizeof(hdr), "!?!?CSEQ %u %llu\n", ob->run, ob->count ? ob->cseq[ob->head] : ob->next);
+    if (send_all(sock, hdr, (size_t)len) < 0) {
+        return -1;
+        }
+    ob->sent = 0;
+    return outbox_flush(ob, sock);
+    }
+
+// drop lines up to the server ack , return how many
+int outbox_ack(outbox* ob, unsigned long long acked)
+    {
+    int done = 0;
+    while (ob->count > 0 && ob->cseq[ob->head] <= acked) {
+        free(ob->line[ob->head]);
+        ob->head = (ob->head + 1) % OUTBOX_MAX;
+        ob->count--;
+        ob->sent -= (ob->sent > 0);
+        done++;
+        }
+    if (done > 0) {
+        outbox_sync(ob);
+        }
+    return done;
+    }
+
+void outbox_close(outbox* ob)
+    {
+    while (ob->count > 0) {
+        free(ob->line[ob->head]);
+        ob->head = (ob->head + 1) % OUTBOX_MAX;
+        ob->count--;
+        }
+    if (ob->journal) {
+        fclose(ob->journal);
+        }
+    ob->journal = NULL;
+    }
+
+/*
+connect with a timeout (a dead server address must not block the input loop for minutes)
+    return -1 : Error , else connected blocking socket
+*/
+int connect_server(const struct sockaddr_in* addr)
+    {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        return -1;
+        }
+    if (connect(sock, (const struct sockaddr*)addr, sizeof(*addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(sock);
+            return -1;
+            }
+        struct pollfd pfd = { .fd = sock, .events = POLLOUT };
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) <= 0 ||
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err != 0) {
+            close(sock);
+            return -1;
+            }
+        }
+    int flag = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flag & ~O_NONBLOCK);
+    return sock;
+    }
+
+/*
+send name!?!?uuid and read server meta data on client->sock (used on first connect and reconnect)
+    return false : Error
+*/
+bool session_handshake(client_info* client, bool debug)
+    {
+    char buffer[META_D_BUFFER_SIZE];
+    int len = hs_encode_hello(buffer, sizeof(buffer), client->client_name, strlen(client->client_name),
+        client->cli_uuid, strlen(client->cli_uuid));
+    if (len < 0) {
+        return false;
+        }
+    if (debug) {
+        printf("meta buffer : %s\n", buffer);
+        }
+    if (send_all(client->sock, buffer, (size_t)len) < 0) {
+        return false;
+        }
+    // server answers at once , do not hang on a half open server
+    struct timeval tv = { .tv_sec = CONNECT_TIMEOUT_MS / 1000, .tv_usec = 0 };
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ssize_t n_byte = recv(client->sock, buffer, sizeof(buffer) - 1, 0);
+    tv.tv_sec = 0;
+    setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (n_byte <= 0 || !break_meta_d(client, buffer, (size_t)n_byte)) {
+        return false;
+        }
+    // roster : SNAP of who is online , then only changes (new connection = fresh parser , epoch 0)
+    // sync : room msgs after the last one shown are sent again (delivery.h of server)
+    // zlib : Z frames when the server has -Z , with the dictionary we kept (zwire.h of server)
+    // events : UTOK tells if the server has a UDP lane (udp_lane.h of server)
+    ev_reset();
+    // own lines from here on take room seqs which the FROM lines of this connection jump over
+    client->lines_base = lines_sent;
+    len = snprintf(buffer, sizeof(buffer), "!?!?ROSTER 0\n!?!?ZLIB %x\n!?!?UDP\n!?!?SYNC %x %llu\n", zc.dict_id,
+        client->seq_boot, client->seq_last);
+    return send_all(client->sock, buffer, (size_t)len) >= 0;
+    }
+
+void free_client(client_info* client)
+    {
+    free(client);
+    }
@@ -0,0 +1,108 @@
+#ifndef CONFIG_H   // server -C <file> : start without the prompts
+#define CONFIG_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "handshake.h"
+
+/*
+one "key = value" per line , '#' starts a comment :
+    name = lobby              server name (the prompt , same rules)
+    debug = 0                 0 no , 1 normal , 2 advance (the prompt)
+    snapshot = server.snap    state snapshot , read at start and written every snapshot_every s
+    snapshot_every = 30       0 = only at shutdown
+*/
+#define CONFIG_PATH_MAX 256
+
+typedef struct server_config {
+    char name[HS_NAME_MAX + 1];
+    unsigned short debug;
+    char snapshot[CONFIG_PATH_MAX];
+    int snapshot_every;
+    }server_config;
+
+// line without spaces around it
+static char* config_trim(char* s)
+    {
+    while (isspace((unsigned char)*s)) {
+        s++;
+        }
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1])) {
+        s[--n] = '\0';
+        }
+    return s;
+    }
+
+/*
+Meanings of return :
+    return -1 : Error [file / unknown key / bad value] , printed with its line
+    return 0  : Success
+*/
+int config_load(const char* path, server_config* c)
+    {
+    memset(c, 0, sizeof(*c));
+    snprintf(c->snapshot, sizeof(c->snapshot), "server.snap");
+    c->snapshot_every = 30;
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "[%sError%s] | Config %s : %s\n", FG_RED, RESET, path, strerror(errno));
+        return -1;
+        }
+    char line[512];
+    int no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        no++;
+        char* hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+            }
+        char* eq = strchr(line, '=');
+        char* key = config_trim(line);
+        if (*key == '\0') {
+            continue;
+            }
+        if (!eq) {
+            ok = false;
+            break;
+            }
+        *eq = '\0';
+        key = config_trim(key);
+        char* val = config_trim(eq + 1);
+        if (strcmp(key, "name") == 0) {
+            ok = hs_name_ok(val, strlen(val));
+            if (ok) {
+                snprintf(c->name, sizeof(c->name), "%s", val);
+                }
+            }
+        else if (strcmp(key, "debug") == 0) {
+            c->debug = (unsigned short)atoi(val);
+            ok = (strlen(val) == 1 && c->debug <= 2 && isdigit((unsigned char)*val));
+            }
+        else if (strcmp(key, "snapshot") == 0) {
+            ok = (strlen(val) < sizeof(c->snapshot));
+            snprintf(c->snapshot, sizeof(c->snapshot), "%s", val);
+            }
+        else if (strcmp(key, "snapshot_every") == 0) {
+            c->snapshot_every = atoi(val);
+            ok = (c->snapshot_every >= 0);
+            }
+        else {
+            ok = false;
+            }
+        }
+    fclose(f);
+    if (!ok) {
+        fprintf(stderr, "[%sError%s] | Config %s line %d : bad line\n", FG_RED, RESET, path, no);
+        return -1;
+        }
+    if (c->name[0] == '\0') {
+        fprintf(stderr, "[%sError%s] | Config %s : no server name\n", FG_RED, RESET, path);
+        return -1;
+        }
+    return 0;
+    }
+#endif
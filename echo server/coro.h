@@ -0,0 +1,161 @@
+#ifndef CORO_H   // stackless coroutines for per connection handlers , resumed by the select() loop
+#define CORO_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/select.h>
+
+/*
+a handler is a plain function written as sequential code :
+
+    int my_handler(coro* c, int slot, void* arg)
+        {
+        CORO_BEGIN(c);
+        coro_timeout(c, 5000000);
+        for (;;) {
+            CORO_WAIT_READ(c);              // returns to the loop , comes back here when readable
+            if (c->timed_out) {
+                CORO_EXIT(c, CORO_ERROR);
+                }
+            ...
+            }
+        CORO_END(c);
+        }
+
+how it works (protothread way) : CORO_BEGIN is a switch on c->line , every wait stores __LINE__
+and returns , the next resume jumps to that case label . so a coroutine costs one int of state and
+a resume is one indirect call + one jump , no stack switch , no allocation
+rules :
+    1. locals do not survive a wait , keep state in the slot arrays (or in arg)
+    2. no switch() of your own around a wait and at most one wait per source line
+one coroutine per slot , the loop resumes it on readable (CORO_EV_READ) or when its timer
+expired (CORO_EV_TIMER , c->timed_out is set) . CORO_ERROR tells the loop to drop the client
+*/
+#define CORO_WAIT   0    // suspended
+#define CORO_DONE   1    // finished
+#define CORO_ERROR -1    // finished , drop the client
+
+#define CORO_EV_START 0
+#define CORO_EV_READ  1
+#define CORO_EV_TIMER 2
+
+typedef struct coro {
+    int line;               // resume point , 0 = start
+    bool want_read;         // waits for the socket
+    bool timed_out;         // this resume comes from the timer
+    long long deadline_us;  // 0 = no timer
+    }coro;
+
+typedef int (*coro_fn)(coro* c, int slot, void* arg);
+
+typedef struct coro_sched {
+    coro co[FD_SETSIZE];
+    coro_fn fn[FD_SETSIZE];   // NULL = no coroutine on the slot
+    void* arg[FD_SETSIZE];
+    int live;
+    unsigned long spawns;
+    unsigned long resumes;
+    unsigned long timeouts;
+    }coro_sched;
+
+#define CORO_BEGIN(c)      switch ((c)->line) { case 0:
+#define CORO_END(c)        } (c)->line = -1; return CORO_DONE
+#define CORO_EXIT(c, r)    do { (c)->line = -1; return (r); } while (0)
+#define CORO_YIELD(c)      do { (c)->line = __LINE__; return CORO_WAIT; case __LINE__:; } while (0)
+#define CORO_WAIT_READ(c)  do { (c)->want_read = true; CORO_YIELD(c); (c)->want_read = false; } while (0)
+
+static long long coro_now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+// arm the timer of c (us from now) , 0 = disarm
+static inline void coro_timeout(coro* c, long long us)
+    {
+    c->deadline_us = us ? coro_now_us() + us : 0;
+    }
+
+// start fn on slot (the caller resumes it with CORO_EV_START when it wants it to run)
+void coro_spawn(coro_sched* s, int slot, coro_fn fn, void* arg)
+    {
+    if (!s->fn[slot]) {
+        s->live++;
+        }
+    memset(&s->co[slot], 0, sizeof(coro));
+    s->fn[slot] = fn;
+    s->arg[slot] = arg;
+    s->spawns++;
+    }
+
+// slot closed while its coroutine waits
+void coro_cancel(coro_sched* s, int slot)
+    {
+    if (s->fn[slot]) {
+        s->fn[slot] = NULL;
+        s->live--;
+        }
+    }
+
+static inline bool coro_running(const coro_sched* s, int slot)
+    {
+    return s->fn[slot] != NULL;
+    }
+
+/*
+Meanings of return in coro_resume :
+    return CORO_WAIT  : suspended again
+    return CORO_DONE  : finished (or no coroutine on the slot)
+    return CORO_ERROR : finished , drop the client
+*/
+int coro_resume(coro_sched* s, int slot, int ev)
+    {
+    coro_fn fn = s->fn[slot];
+    if (!fn) {
+        return CORO_DONE;
+        }
+    coro* c = &s->co[slot];
+    c->timed_out = (ev == CORO_EV_TIMER);
+    if (c->timed_out) {
+        c->deadline_us = 0;
+        s->timeouts++;
+        }
+    s->resumes++;
+    int r = fn(c, slot, s->arg[slot]);
+    if (r != CORO_WAIT && s->fn[slot] == fn) {
+        s->fn[slot] = NULL;
+        s->live--;
+        }
+    return r;
+    }
+
+static inline bool coro_expired(const coro_sched* s, int slot, long long now)
+    {
+    return s->fn[slot] && s->co[slot].deadline_us && s->co[slot].deadline_us <= now;
+    }
+
+// select() timeout : cap_us or less when a timer expires earlier
+long long coro_wait_us(const coro_sched* s, long long now, long long cap_us)
+    {
+    if (s->live == 0) {
+        return cap_us;
+        }
+    long long best = cap_us;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (s->fn[i] && s->co[i].deadline_us) {
+            long long left = s->co[i].deadline_us - now;
+            best = (left < best) ? (left > 0 ? left : 0) : best;
+            }
+        }
+    return best;
+    }
+
+void coro_report(coro_sched* s)
+    {
+    printf("[%sCoro%s] live=%d spawned=%lu resumes=%lu timeouts=%lu\n",
+        FG_BCYAN, RESET, s->live, s->spawns, s->resumes, s->timeouts);
+    s->spawns = s->resumes = s->timeouts = 0;
+    }
+#endif
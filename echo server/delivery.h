@@ -0,0 +1,331 @@
+#ifndef DELIVERY_H   // reliable delivery : room sequence numbers , retransmit ring , acks per uuid session
+#define DELIVERY_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "handshake.h"
+#include "out_buffer.h"
+
+/*
+server -> client (room msgs) :
+    every msg of the room gets the next room seq . a synced client gets the seq inside the FROM mark ,
+    "!?!?FROM <id> <seq>\n" , only when the sender changed or the seq is not last + 1 (own msgs are
+    not sent back) , so a run of msgs costs nothing extra . the client counts lines from the mark
+    1. client -> "!?!?SYNC <boot> <last seq it has>\n" after ROSTER (seq 0 = nothing , use my acks)
+       server -> "!?!?SEQ <boot> <room seq> <missed>\n" then replays every msg after that seq
+       which is still in the ring (missed = msgs already gone from the ring)
+    2. client -> "!?!?ACK <seq>\n" cumulative , every DLV_ACK_EVERY msgs or after a short delay
+    3. boot changes with every server start , old seqs of a client mean nothing then (a start from a
+       state snapshot keeps boot , seq , ring and sessions , snapshot.h)
+the ring keeps the last RTX_MSGS msgs / RTX_BYTES bytes , older ones are lost for a resume (at
+least once , bounded) . acks are kept per uuid (a client restart resumes from its last ack)
+
+client -> server (chat lines) :
+    "!?!?CSEQ <run> <n>\n" numbers the chat lines after it n , n+1 ... (run = client process)
+    server delivers a line only when its number is above the last one of the uuid , answers with
+    "!?!?CACK <n>\n" once per tick . client keeps lines until they are acked and sends them again
+    after a reconnect , a line which already made it is dropped here (resend dedupe)
+*/
+#define RTX_MSGS     4096
+#define RTX_BYTES    (OUT_BUFFER_MAX / 2)   // a full replay always fits in one output buffer
+#define DLV_SESSIONS 4096                   // uuid sessions (power of 2)
+#define DLV_PROBE    16                     // hash probes , a full window evicts the oldest idle session
+#define DLV_LINE_MAX 96
+
+typedef struct rtx_entry {
+    unsigned long long seq;
+    uint32_t from;     // member id of the sender (FROM mark)
+    int sess;          // session of the sender , not replayed to it
+    size_t off;        // in ring
+    size_t len;
+    }rtx_entry;
+
+typedef struct dlv_session {
+    char uuid[HS_UUID_MAX + 1];   // "" = free
+    int conns;                    // live connections , never evicted while > 0
+    time_t last_seen;
+    unsigned long long acked;     // room seq the client acked
+    unsigned int run;             // client process of cseq
+    unsigned long long cseq;      // last chat line taken from it
+    }dlv_session;
+
+typedef struct delivery {
+    uint32_t boot;
+    unsigned long long seq;       // last room seq given
+    char* ring;
+    size_t wpos;
+    rtx_entry e[RTX_MSGS];
+    int head;                     // oldest entry
+    int count;
+    size_t bytes;
+    dlv_session s[DLV_SESSIONS];
+    // per slot
+    int sess_of[FD_SETSIZE];      // -1 = none
+    bool synced[FD_SETSIZE];      // sent SYNC , gets seqs in the FROM marks
+    uint32_t from_sent[FD_SETSIZE];
+    unsigned long long seq_sent[FD_SETSIZE];
+    unsigned long long cseq_next[FD_SETSIZE];   // number of next chat line , 0 = client does not number
+    bool cack_due[FD_SETSIZE];
+    // counters since last report
+    unsigned long acks;
+    unsigned long syncs;
+    unsigned long replayed;
+    unsigned long missed;
+    unsigned long dups;
+    unsigned long cacks;
+    unsigned long evicted;        // sessions pushed out of a full table
+    }delivery;
+
+void dlv_init(delivery* d)
+    {
+    memset(d, 0, sizeof(*d));
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    d->boot = ((uint32_t)ts.tv_sec * 2654435761u) ^ (uint32_t)ts.tv_nsec ^ (uint32_t)getpid();
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        d->sess_of[i] = -1;
+        }
+    }
+
+static inline rtx_entry* rtx_oldest(delivery* d)
+    {
+    return &d->e[d->head];
+    }
+
+static void rtx_evict(delivery* d)
+    {
+    d->bytes -= d->e[d->head].len;
+    d->head = (d->head + 1) % RTX_MSGS;
+    d->count--;
+    }
+
+/*
+give msg of slot i the next room seq and keep a copy in the ring
+    return : the seq
+*/
+unsigned long long dlv_push(delivery* d, int i, uint32_t from, const char* msg, size_t n)
+    {
+    unsigned long long seq = ++d->seq;
+    if (!d->ring) {
+        d->ring = malloc(RTX_BYTES);
+        }
+    if (!d->ring || n > RTX_BYTES / 4) {
+        return seq;   // not kept , a resume over it counts as missed
+        }
+    size_t at = d->wpos;
+    if (at + n > RTX_BYTES) {
+        // tail of the ring is skipped , entries still living there are the oldest ones
+        while (d->count > 0 && rtx_oldest(d)->off >= at) {
+            rtx_evict(d);
+            }
+        at = 0;
+        }
+    while (d->count > 0) {
+        rtx_entry* o = rtx_oldest(d);
+        if (d->count < RTX_MSGS && (o->off >= at + n || o->off + o->len <= at)) {
+            break;
+            }
+        rtx_evict(d);
+        }
+    memcpy(d->ring + at, msg, n);
+    rtx_entry* e = &d->e[(d->head + d->count) % RTX_MSGS];
+    e->seq = seq;
+    e->from = from;
+    e->sess = d->sess_of[i];
+    e->off = at;
+    e->len = n;
+    d->count++;
+    d->bytes += n;
+    d->wpos = at + n;
+    return seq;
+    }
+
+// first ring index (0 = oldest) with seq > after
+int dlv_find(delivery* d, unsigned long long after)
+    {
+    int lo = 0, hi = d->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (d->e[(d->head + mid) % RTX_MSGS].seq > after) {
+            hi = mid;
+            }
+        else {
+            lo = mid + 1;
+            }
+        }
+    return lo;
+    }
+
+static inline rtx_entry* dlv_entry(delivery* d, int k)
+    {
+    return &d->e[(d->head + k) % RTX_MSGS];
+    }
+
+// msgs after seq 'after' which are no longer in the ring
+unsigned long long dlv_missed(delivery* d, unsigned long long after)
+    {
+    unsigned long long first = d->count ? rtx_oldest(d)->seq : d->seq + 1;
+    return (after + 1 < first) ? first - after - 1 : 0;
+    }
+
+/*
+mark in front of a msg of member from (with seq) for slot j
+    return 0 : no mark needed , else bytes written to out
+*/
+int dlv_mark(delivery* d, int j, uint32_t from, unsigned long long seq, char* out, size_t cap)
+    {
+    if (!d->synced[j]) {
+        if (d->from_sent[j] == from) {
+            return 0;
+            }
+        d->from_sent[j] = from;
+        return snprintf(out, cap, "!?!?FROM %x\n", from);
+        }
+    bool next = (d->seq_sent[j] + 1 == seq);
+    d->seq_sent[j] = seq;
+    if (next && d->from_sent[j] == from) {
+        return 0;
+        }
+    d->from_sent[j] = from;
+    return snprintf(out, cap, "!?!?FROM %x %llu\n", from, seq);
+    }
+
+// mark of a msg outside the room seqs (routed by a filter) , the next room msg gets a full mark again
+int dlv_mark_direct(delivery* d, int j, uint32_t from, char* out, size_t cap)
+    {
+    d->from_sent[j] = 0;
+    return snprintf(out, cap, "!?!?FROM %x\n", from);
+    }
+
+// session of uuid , created (or an idle one evicted) when it is not known
+static int dlv_session_get(delivery* d, const char* uuid)
+    {
+    uint32_t h = 2166136261u;
+    for (const char* p = uuid; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+        }
+    int free_k = -1, old_k = -1;
+    for (int probe = 0;probe < DLV_PROBE;probe++) {
+        int k = (int)((h + (uint32_t)probe) & (DLV_SESSIONS - 1));
+        dlv_session* s = &d->s[k];
+        if (s->uuid[0] == '\0') {
+            if (free_k < 0) {
+                free_k = k;
+                }
+            continue;
+            }
+        if (strcmp(s->uuid, uuid) == 0) {
+            return k;
+            }
+        if (s->conns == 0 && (old_k < 0 || s->last_seen < d->s[old_k].last_seen)) {
+            old_k = k;
+            }
+        }
+    int k = (free_k >= 0) ? free_k : old_k;
+    if (k < 0) {
+        return -1;
+        }
+    if (free_k < 0) {
+        d->evicted++;
+        }
+    dlv_session* s = &d->s[k];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->uuid, sizeof(s->uuid), "%s", uuid);
+    // a new uuid starts at the present , it has no history to resume
+    s->acked = d->seq;
+    return k;
+    }
+
+// slot i finished the handshake as uuid
+void dlv_attach(delivery* d, int i, const char* uuid)
+    {
+    int k = dlv_session_get(d, uuid);
+    d->sess_of[i] = k;
+    if (k >= 0) {
+        d->s[k].conns++;
+        d->s[k].last_seen = time(NULL);
+        }
+    d->synced[i] = false;
+    d->from_sent[i] = 0;
+    d->seq_sent[i] = 0;
+    d->cseq_next[i] = 0;
+    d->cack_due[i] = false;
+    }
+
+void dlv_detach(delivery* d, int i)
+    {
+    int k = d->sess_of[i];
+    if (k >= 0) {
+        d->s[k].conns--;
+        d->s[k].last_seen = time(NULL);
+        }
+    d->sess_of[i] = -1;
+    d->synced[i] = false;
+    d->from_sent[i] = 0;
+    d->cseq_next[i] = 0;
+    d->cack_due[i] = false;
+    }
+
+static inline dlv_session* dlv_sess(delivery* d, int i)
+    {
+    return (d->sess_of[i] >= 0) ? &d->s[d->sess_of[i]] : NULL;
+    }
+
+// cumulative ack of slot i , only up to the newest seq marked for it (more is an older server run or made up)
+void dlv_ack(delivery* d, int i, unsigned long long seq)
+    {
+    dlv_session* s = dlv_sess(d, i);
+    if (s && seq > s->acked && seq <= d->seq_sent[i]) {
+        s->acked = seq;
+        }
+    d->acks++;
+    }
+
+// "!?!?CSEQ <run> <n>" : numbering of the chat lines of slot i
+void dlv_cseq(delivery* d, int i, unsigned int run, unsigned long long n)
+    {
+    dlv_session* s = dlv_sess(d, i);
+    if (n == 0) {
+        return;
+        }
+    d->cseq_next[i] = n;
+    // other client process , its numbers start again
+    if (s && s->run != run) {
+        s->run = run;
+        s->cseq = n - 1;
+        }
+    }
+
+/*
+next chat line of slot i
+    return false : already delivered before (resend after a reconnect) , drop it
+*/
+bool dlv_take_line(delivery* d, int i)
+    {
+    dlv_session* s = dlv_sess(d, i);
+    if (d->cseq_next[i] == 0 || !s) {
+        return true;
+        }
+    unsigned long long c = d->cseq_next[i]++;
+    d->cack_due[i] = true;
+    if (c <= s->cseq) {
+        d->dups++;
+        return false;
+        }
+    s->cseq = c;
+    return true;
+    }
+
+void dlv_report(delivery* d)
+    {
+    printf("[%sDelivery%s] seq=%llu ring=%d msgs %zu bytes (from seq %llu) acks=%lu syncs=%lu replayed=%lu missed=%lu dup_lines=%lu cacks=%lu sessions_evicted=%lu\n",
+        FG_BCYAN, RESET, d->seq, d->count, d->bytes, d->count ? rtx_oldest(d)->seq : d->seq + 1,
+        d->acks, d->syncs, d->replayed, d->missed, d->dups, d->cacks, d->evicted);
+    d->acks = d->syncs = d->replayed = d->missed = d->dups = d->cacks = d->evicted = 0;
+    }
+#endif
@@ -1,13 +1,1237 @@
 
 #include "header.h"
 #include "wrapper.h"
+#include "out_buffer.h"
+#include "stats.h"
+#include "blob.h"
+#include "log_index.h"
+#include "scan.h"
+#include "buf_pool.h"
+#include "lowlat.h"
+#include "roster.h"
+#include "delivery.h"
+#include "coro.h"
+#include "loop_prof.h"
+#include "trace.h"
+#include "filter.h"
+#include "sock_tune.h"
+#include "zwire.h"
+#include "zlog.h"
+#include "udp_lane.h"
+#include "steer.h"
+#include "config.h"
+#include "snapshot.h"
 
 #ifndef FD_SETSIZE
 #define FD_SETSIZE 1024
 #endif 
+#define LINE_MAX_LEN  65536   // longer line without '\n' is delivered as it is
+#define SCAN_MAX_LINES 512    // lines per scan_lines() call
+#define CTRL_LINE_MAX  512    // longest request line from a client , longer ones are unknown
+#define ACCEPT_BUDGET  64     // accepts per tick , rest waits one select() so connected clients are served
+#define DEFER_ACCEPT_S 5      // kernel keeps the connection until the handshake bytes arrive
+#define HANDSHAKE_TIMEOUT_S 10
+#define HELLO_SETTLE_US 200000   // hello without '\n' (old clients) is taken after this long without more bytes
+#define HEARTBEAT_INTERVAL_S 15   // PING on the control lane
+#define HEARTBEAT_TIMEOUT_S  45   // nothing received for this long -> dead (only clients which answer PING)
 
+// -------------------global variable--------------------
+// to track active client [stores client file descriptor]
+int clinets[FD_SETSIZE];
+bool cli_ready[FD_SETSIZE];      // handshake done , slot gets chat / blobs
+time_t cli_accept_t[FD_SETSIZE];
+int cli_files[FD_SETSIZE];
+FILE* f_ptr[FD_SETSIZE];
+void* clinet_struct[FD_SETSIZE];
+client_info cli_infos[FD_SETSIZE];   // clinet_struct[i] points here once the handshake is done
+out_buffer out_bufs[FD_SETSIZE];    // data lane (chat)
+out_buffer ctrl_bufs[FD_SETSIZE];   // control lane , always flushed first
+size_t data_credit[FD_SETSIZE];     // data lane bytes allowed in current tick
+unsigned long credit_tick[FD_SETSIZE];
+unsigned long tick_no = 0;
+time_t tick_now;
+time_t cli_last_in[FD_SETSIZE];     // last time bytes came from the client
+bool cli_pong[FD_SETSIZE];          // client answers PING , heartbeat timeout applies
+blob_upload uploads[FD_SETSIZE];
+blob_job* blob_jobs[FD_SETSIZE];
+// transcript index (per uuid writer , shared by connections of same uuid)
+log_index* log_idx[FD_SETSIZE];
+uint32_t cli_ip[FD_SETSIZE];
+int cli_file_no[FD_SETSIZE];
+long cli_log_off[FD_SETSIZE];   // end of cli_N.txt (raw size of cli_N.zlog with -Z) , kept here (ftell on append stream costs a lseek)
+// unfinished line of last read() (msgs are '\n' framed) , buffer comes from rx_pool
+char* partial[FD_SETSIZE];
+size_t partial_len[FD_SETSIZE];
+size_t partial_cap[FD_SETSIZE];
+long long hs_deadline_us[FD_SETSIZE];   // end of the handshake of the slot (the coroutine timer also settles the hello)
+// slots which got output in current tick (flushed once at tick end)
+int dirty_slots[FD_SETSIZE];
+int dirty_count = 0;
+server_stats stats;
+buf_pool rx_pool;
+roster room;
+delivery dlv;          // room seqs , retransmit ring , acks per uuid
+coro_sched co_sched;   // per slot handlers (handshake) , resumed by the loop
+trace_writer tracer;   // -R <file> , traffic trace for bench/replay
+filter_chain filters;  // -M <filter.so[:arg]> , run on every chat line before the fan out
+sock_tuner tuner;      // per connection socket tuning from TCP_INFO , -T <csv>
+zwire zroom;           // -Z : room msgs as Z frames (room dictionary) , transcripts block compressed
+udp_lane udp;          // typing / presence events , -U : over UDP (else on the control lane)
+steer_table steering;  // uuid -> home slot , sessions parked there for a reconnect
+snapshotter snapper;   // -C : state snapshot , written in the background , read at start
+volatile sig_atomic_t stop_requested = 0;   // SIGINT / SIGTERM : leave the loop , write the last snapshot
+// ------------------------------------------------------
 
+// remove client of slot i [socket , client info , file , pending output]
+void drop_client(int i, int debug)
+    {
+    time_t disconnect_t = time(NULL);
+    printf("\n[%sClinet Disconnected%s] %s", FG_RED, RESET, ctime(&disconnect_t));
+    bool was_ready = cli_ready[i];
+    if (was_ready) {
+        roster_leave(&room, i);
+        trace_event(&tracer, TR_CLOSE, i, 0, 0);
+        }
+    dlv_detach(&dlv, i);
+    udp_forget(&udp, i);
+    coro_cancel(&co_sched, i);
+    close_client(clinet_struct[i], clinets[i], debug);
+    clinets[i] = -1;
+    cli_files[i] = -1;
+    cli_ready[i] = false;
+    // transcript + index writer stay open on the home slot of the uuid for a quick reconnect
+    if (was_ready && steer_park(&steering, i, f_ptr[i], log_idx[i], cli_file_no[i], cli_log_off[i], cli_ip[i], disconnect_t)) {
+        f_ptr[i] = NULL;
+        log_idx[i] = NULL;
+        }
+    else {
+        file_close(&f_ptr[i], debug);
+        }
+    clinet_struct[i] = NULL;
+    out_free(&out_bufs[i]);
+    out_free(&ctrl_bufs[i]);
+    data_credit[i] = 0;
+    cli_pong[i] = false;
+    if (uploads[i].active) {
+        blob_upload_end(&uploads[i], false);
+        }
+    blob_jobs_free(&blob_jobs[i]);
+    log_index_close(log_idx[i]);
+    log_idx[i] = NULL;
+    pool_put(&rx_pool, partial[i], partial_cap[i]);
+    partial[i] = NULL;
+    partial_len[i] = partial_cap[i] = 0;
+    }
+
+static void mark_dirty(int i)
+    {
+    if (!out_bufs[i].dirty) {
+        out_bufs[i].dirty = true;
+        dirty_slots[dirty_count++] = i;
+        }
+    }
+
+// data lane credit of slot i , refilled once per tick (unused credit is kept up to 2 quanta)
+static size_t* lane_credit(int i)
+    {
+    if (credit_tick[i] != tick_no) {
+        size_t cap = out_pending(&out_bufs[i]) ? 2 * OUT_DATA_QUANTUM : OUT_DATA_QUANTUM;
+        data_credit[i] += OUT_DATA_QUANTUM;
+        if (data_credit[i] > cap) {
+            data_credit[i] = cap;
+            }
+        credit_tick[i] = tick_no;
+        }
+    return &data_credit[i];
+    }
+
+/*
+send both lanes of slot i (control first)
+    return -1 : Error , client is dropped
+    return 0 / 1 : like out_flush_lanes()
+*/
+static int flush_slot(int i, int flags, int debug)
+    {
+    size_t before = out_pending(&ctrl_bufs[i]) + out_pending(&out_bufs[i]);
+    int r = (before > 0) ? out_flush_lanes(clinets[i], &ctrl_bufs[i], &out_bufs[i], lane_credit(i), flags, &stats.send_calls) : 0;
+    size_t written = before - out_pending(&ctrl_bufs[i]) - out_pending(&out_bufs[i]);
+    stats.bytes_out += written;
+    if (r < 0) {
+        fprintf(stderr, "[%sError%s]", FG_BRED, RESET);
+        perror("Send");
+        drop_client(i, debug);
+        return -1;
+        }
+    if (debug == 1 && written > 0) {
+        printf("client[%d] = %d\twritten ;%zu bytes\n", i, clinets[i], written);
+        }
+    return r;
+    }
+
+// queue msg for slot i on the data lane , the real send() happens in flush_dirty()
+void queue_msg(int i, const char* msg, size_t n, int debug)
+    {
+    out_buffer* ob = &out_bufs[i];
+    if (!lane_append(ob, LANE_DATA, msg, n)) {
+        fprintf(stderr, "[%sError%s] | Slow client , output limit reached [fd=%d]\n", FG_RED, RESET, clinets[i]);
+        drop_client(i, debug);
+        return;
+        }
+    stats.msgs_delivered++;
+    mark_dirty(i);
+    // big burst for one client , push it now but keep the segment open for the rest of tick
+    if (out_pending(ob) >= OUT_FLUSH_HIGH_WATER && !blob_busy(blob_jobs[i])) {
+        stats.early_flushes++;
+        flush_slot(i, MSG_MORE, debug);
+        }
+    }
+
+// what was queued for slot i since the last call (mark , dict , msg , line end) is one data frame
+void queue_frame_end(int i, int debug)
+    {
+    if (clinets[i] != -1 && !lane_frame_end(&out_bufs[i])) {
+        fprintf(stderr, "[%sError%s] | Out of memory for output frames [fd=%d]\n", FG_RED, RESET, clinets[i]);
+        drop_client(i, debug);
+        }
+    }
+
+// queue a control frame for slot i (heartbeat , blob notice , ...) , goes out before any queued chat
+void queue_ctrl(int i, const char* msg, size_t n, int debug)
+    {
+    if (!lane_append(&ctrl_bufs[i], LANE_CTRL, msg, n)) {
+        fprintf(stderr, "[%sError%s] | Control lane limit reached [fd=%d]\n", FG_RED, RESET, clinets[i]);
+        drop_client(i, debug);
+        return;
+        }
+    mark_dirty(i);
+    }
+
+// flush every dirty connection with one sendmsg() , called at tick end (and by the latency cap)
+void flush_dirty(int debug)
+    {
+    int keep = 0;
+    for (int k = 0;k < dirty_count;k++) {
+        int i = dirty_slots[k];
+        if (clinets[i] == -1) {
+            continue;
+            }
+        // a CHUNK body is half sent , chat waits until blob_pump() finishes it
+        if (blob_busy(blob_jobs[i])) {
+            dirty_slots[keep++] = i;
+            continue;
+            }
+        int r = flush_slot(i, 0, debug);
+        if (r < 0) {
+            continue;
+            }
+        out_uncork(clinets[i], &out_bufs[i]);
+        // still has data (kernel buffer full / data credit used) -> waits for writable in select
+        if (r == 1) {
+            dirty_slots[keep++] = i;
+            }
+        else {
+            out_bufs[i].dirty = false;
+            }
+        }
+    dirty_count = keep;
+    }
+
+// give every client with a blob job its share of this tick blob budget
+void pump_blobs(int debug)
+    {
+    int active = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (clinets[i] != -1 && blob_jobs[i]) {
+            active++;
+            }
+        }
+    if (active == 0) {
+        return;
+        }
+    size_t share = BLOB_TICK_BUDGET / (size_t)active;
+    share = (share < BLOB_MIN_SHARE) ? BLOB_MIN_SHARE : (share > BLOB_CHUNK) ? BLOB_CHUNK : share;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (clinets[i] == -1 || !blob_jobs[i]) {
+            continue;
+            }
+        // chat first , a new chunk only starts on an empty output buffer
+        if (!blob_busy(blob_jobs[i]) && (out_pending(&out_bufs[i]) > 0 || out_pending(&ctrl_bufs[i]) > 0)) {
+            continue;
+            }
+        ssize_t m = blob_pump(clinets[i], &blob_jobs[i], share, &stats.send_calls);
+        if (m < 0) {
+            fprintf(stderr, "[%sError%s]", FG_BRED, RESET);
+            perror("Blob send");
+            drop_client(i, debug);
+            continue;
+            }
+        stats.bytes_out += (unsigned long)m;
+        }
+    }
+
+/*
+room msg for slot j , as Z frame when j asked for them and the frame is smaller (zwire.h)
+zw_begin() once per msg before , the frame is made on the first capable recipient
+*/
+static void queue_room_msg(int j, const char* msg, size_t n, int debug)
+    {
+    long z = zroom.cap[j] ? zw_frame(&zroom, msg, n) : 0;
+    if (z <= 0) {
+        queue_msg(j, msg, n, debug);
+        return;
+        }
+    // dictionary of the frame first , in order on the same lane
+    char hdr[ZW_HDR_MAX];
+    int h = zw_dict_header(&zroom, j, hdr, sizeof(hdr));
+    if (h > 0 && (!lane_append(&out_bufs[j], LANE_DATA, hdr, (size_t)h) ||
+        !lane_append(&out_bufs[j], LANE_DATA, (const char*)zroom.dict, zroom.dict_len))) {
+        fprintf(stderr, "[%sError%s] | Slow client , output limit reached [fd=%d]\n", FG_RED, RESET, clinets[j]);
+        drop_client(j, debug);
+        return;
+        }
+    zroom.sent++;
+    zroom.raw_bytes += n;
+    zroom.wire_bytes += (unsigned long long)z;
+    queue_msg(j, (const char*)zroom.frame, (size_t)z, debug);
+    }
+
+// msg of slot i into its transcript + index
+static void store_msg(int i, const char* msg, size_t n)
+    {
+    fwrite(msg, 1, n, f_ptr[i]);
+    if (log_idx[i] && cli_log_off[i] >= 0) {
+        log_index_add(log_idx[i], cli_ip[i], (uint32_t)cli_file_no[i], (uint64_t)cli_log_off[i], msg, n);
+        }
+    cli_log_off[i] += (long)n;
+    stats.msgs_in++;
+    }
+
+// one complete msg (line) of slot i : store , index and queue for every other client
+void deliver_msg(int i, const char* msg, size_t n, int debug)
+    {
+    store_msg(i, msg, n);
+
+    // broadcasting algorithm [only queued here , sent once per client at tick end]
+    int fd = clinets[i];
+    uint32_t from = room.m[i].id;
+    unsigned long long seq = dlv_push(&dlv, i, from, msg, n);
+    bool has_nl = (n > 0 && msg[n - 1] == '\n');
+    unsigned long fanout = 0;
+    zw_begin(&zroom);
+    zroom.msgs_since_train++;
+    // members of this moment , a member dropped in the loop stays in the set (slot checks below)
+    const member_set* ms = roster_members(&room);
+    for (int k = 0;k < ms->count;k++) {
+        int j = ms->slot[k];
+        int cli_fd = clinets[j];
+        if (cli_fd != -1 && cli_fd != fd && cli_ready[j]) {
+            // roster subscribers learn the sender (and synced ones the seq) from a FROM mark
+            char mark[DLV_LINE_MAX];
+            int mark_len = (room.m[j].subscribed || dlv.synced[j]) ? dlv_mark(&dlv, j, from, seq, mark, sizeof(mark)) : 0;
+            if (mark_len > 0 && !lane_append(&out_bufs[j], LANE_DATA, mark, (size_t)mark_len)) {
+                fprintf(stderr, "[%sError%s] | Slow client , output limit reached [fd=%d]\n", FG_RED, RESET, cli_fd);
+                drop_client(j, debug);
+                continue;
+                }
+            queue_room_msg(j, msg, n, debug);
+            fanout++;
+            // a synced client counts seqs by lines , an over long piece gets its own line end
+            if (!has_nl && dlv.synced[j] && clinets[j] != -1) {
+                queue_msg(j, "\n", 1, debug);
+                }
+            queue_frame_end(j, debug);
+            }
+        }
+    roster_members_done(&room);
+    trace_event(&tracer, TR_MSG, i, (unsigned long)n, fanout);
+    }
+
+// msg of slot i which a filter routed to the member named to : stored , but no room seq (not replayed)
+void route_msg(int i, const char* msg, size_t n, const char* to, int debug)
+    {
+    int j = 0;
+    while (j < FD_SETSIZE && !(clinets[j] != -1 && cli_ready[j] && room.m[j].id != 0 && strcmp(room.m[j].name, to) == 0)) {
+        j++;
+        }
+    if (j == FD_SETSIZE) {
+        filters.route_miss++;
+        return;
+        }
+    store_msg(i, msg, n);
+    char mark[DLV_LINE_MAX];
+    int mark_len = (room.m[j].subscribed || dlv.synced[j]) ? dlv_mark_direct(&dlv, j, room.m[i].id, mark, sizeof(mark)) : 0;
+    if (mark_len > 0 && !lane_append(&out_bufs[j], LANE_DATA, mark, (size_t)mark_len)) {
+        fprintf(stderr, "[%sError%s] | Slow client , output limit reached [fd=%d]\n", FG_RED, RESET, clinets[j]);
+        drop_client(j, debug);
+        return;
+        }
+    queue_msg(j, msg, n, debug);
+    if (!(n > 0 && msg[n - 1] == '\n') && dlv.synced[j] && clinets[j] != -1) {
+        queue_msg(j, "\n", 1, debug);
+        }
+    queue_frame_end(j, debug);
+    trace_event(&tracer, TR_MSG, i, (unsigned long)n, 1);
+    }
+
+// chat line of slot i through the filter chain (no filter = straight to the room)
+void filter_msg(int i, const char* msg, size_t n, int debug)
+    {
+    if (filters.count == 0) {
+        deliver_msg(i, msg, n, debug);
+        return;
+        }
+    chat_frame fr = { .data = msg, .len = n, .from = room.m[i].id, .name = room.m[i].name,
+        .uuid = cli_infos[i].cli_uuid, .ip = cli_ip[i] };
+    char* pooled;
+    size_t pooled_cap;
+    char to[CHAT_ROUTE_NAME_MAX + 1];
+    prof_enter(PH_FILTER, clinets[i]);
+    int verdict = filter_run(&filters, &rx_pool, &fr, &pooled, &pooled_cap, to);
+    prof_leave();
+    if (verdict == CHAT_PASS) {
+        deliver_msg(i, fr.data, fr.len, debug);
+        }
+    else if (verdict == CHAT_ROUTE) {
+        route_msg(i, fr.data, fr.len, to, debug);
+        }
+    pool_put(&rx_pool, pooled, pooled_cap);
+    }
+
+// room for n bytes in the partial buffer of slot i (next size class , old bytes are kept)
+bool partial_reserve(int i, size_t n)
+    {
+    if (n <= partial_cap[i]) {
+        return true;
+        }
+    size_t cap;
+    char* p = pool_get(&rx_pool, n, &cap);
+    if (!p) {
+        return false;
+        }
+    if (partial_len[i] > 0) {
+        memcpy(p, partial[i], partial_len[i]);
+        }
+    pool_put(&rx_pool, partial[i], partial_cap[i]);
+    partial[i] = p;
+    partial_cap[i] = cap;
+    return true;
+    }
+
+// keep unfinished line for next read , no rest -> buffer goes back to the pool
+bool partial_store(int i, const char* data, size_t n)
+    {
+    if (n == 0) {
+        pool_put(&rx_pool, partial[i], partial_cap[i]);
+        partial[i] = NULL;
+        partial_len[i] = partial_cap[i] = 0;
+        return true;
+        }
+    // no buffer , too small , or a smaller class is enough now
+    int cls = pool_class(n);
+    if (!partial[i] || cls < 0 || pool_class_size[cls] != partial_cap[i]) {
+        size_t cap;
+        char* p = pool_get(&rx_pool, n, &cap);
+        if (!p) {
+            return false;
+            }
+        // data can point into partial[i] itself , copy before it is given back
+        memcpy(p, data, n);
+        pool_put(&rx_pool, partial[i], partial_cap[i]);
+        partial[i] = p;
+        partial_cap[i] = cap;
+        }
+    else {
+        memmove(partial[i], data, n);
+        }
+    partial_len[i] = n;
+    return true;
+    }
+
+/*
+memory of connections , printed with the stats
+idle = no partial line , no queued output , no blob transfer
+*/
+void mem_report()
+    {
+    int conns = 0, idle = 0;
+    size_t rx = 0, tx = 0, idle_bytes = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (clinets[i] == -1) {
+            continue;
+            }
+        conns++;
+        rx += partial_cap[i];
+        tx += out_bufs[i].cap + ctrl_bufs[i].cap;
+        if (partial_len[i] == 0 && out_pending(&out_bufs[i]) == 0 && out_pending(&ctrl_bufs[i]) == 0 && !uploads[i].active && !blob_jobs[i]) {
+            idle++;
+            idle_bytes += partial_cap[i] + out_bufs[i].cap + ctrl_bufs[i].cap;
+            }
+        }
+    lowlat_report();
+    lanes_report();
+    roster_report(&room);
+    dlv_report(&dlv);
+    coro_report(&co_sched);
+    prof_report();
+    trace_report(&tracer);
+    filter_report(&filters);
+    tune_report(&tuner, clinets);
+    zw_report(&zroom);
+    zlog_report();
+    udp_report(&udp);
+    steer_report(&steering);
+    printf("[%sMemory%s] conns=%d idle=%d rx_buffers=%zu tx_buffers=%zu buffer bytes per idle conn=%zu\n",
+        FG_BCYAN, RESET, conns, idle, rx, tx, idle ? idle_bytes / (size_t)idle : 0);
+    pool_report(&rx_pool);
+    }
+
+// upload of slot i is complete , announce it and start delivery to every other client
+void finish_upload(int i, int debug)
+    {
+    blob_upload* up = &uploads[i];
+    if (up->failed) {
+        // all bytes are read , the spool file goes and the sender is told
+        blob_upload_end(up, false);
+        char line[BLOB_HDR_MAX + BLOB_NAME_MAX];
+        int len = snprintf(line, sizeof(line), "!?!?BFAIL %lld %s\n", up->size, up->name);
+        queue_ctrl(i, line, (size_t)len, debug);
+        return;
+        }
+    blob_upload_end(up, true);
+    printf("[%sBlob%s] %s (%lld bytes) stored as %s/%llx\n", FG_BMAGENTA, RESET, up->name, up->size, BLOB_DIR, up->id);
+    trace_event(&tracer, TR_BLOB, i, (unsigned long)up->size, 0);
+    if (f_ptr[i]) {
+        fprintf(f_ptr[i], "[blob %llx %s %lld bytes]\n", up->id, up->name, up->size);
+        }
+    char line[BLOB_HDR_MAX + BLOB_NAME_MAX];
+    int len = blob_announce(line, sizeof(line), up->id, up->size, up->name);
+    const member_set* ms = roster_members(&room);
+    for (int k = 0;k < ms->count;k++) {
+        int j = ms->slot[k];
+        if (clinets[j] == -1 || j == i || !cli_ready[j]) {
+            continue;
+            }
+        queue_ctrl(j, line, (size_t)len, debug);
+        tuner.last_ms[j] = 0;
+        if (clinets[j] != -1 && !blob_job_push(&blob_jobs[j], up->id, 0)) {
+            fprintf(stderr, "[%sError%s] | Blob job failed [fd=%d]\n", FG_RED, RESET, clinets[j]);
+            }
+        }
+    roster_members_done(&room);
+    }
+
+/*
+handle blob control lines from client
+    return -1 : Error , drop the client
+    return  n : bytes of buf consumed (0 = not a blob line)
+*/
+int blob_control(int i, const char* buf, size_t n, int debug)
+    {
+    if (n > 9 && memcmp(buf, "!?!?BLOB ", 9) == 0) {
+        int used = blob_upload_begin(&uploads[i], buf, n);
+        if (used < 0) {
+            fprintf(stderr, "[%sError%s] | Bad blob header [fd=%d]\n", FG_RED, RESET, clinets[i]);
+            return -1;
+            }
+        used += (int)blob_upload_write(&uploads[i], buf + used, n - (size_t)used);
+        if (uploads[i].failed) {
+            fprintf(stderr, "[%sError%s] | Blob spool write failed , dropping the upload [fd=%d]\n", FG_RED, RESET, clinets[i]);
+            }
+        // bulk now , retuned on the next visit
+        tuner.last_ms[i] = 0;
+        if (uploads[i].left == 0) {
+            finish_upload(i, debug);
+            }
+        return used;
+        }
+    if (n > 9 && memcmp(buf, "!?!?BGET ", 9) == 0) {
+        unsigned long long id;
+        long long off;
+        const char* nl = memchr(buf, '\n', n);
+        if (sscanf(buf, "!?!?BGET %llx %lld", &id, &off) != 2 || !nl) {
+            return -1;
+            }
+        blob_entry* e = blob_lookup(id);
+        char line[BLOB_HDR_MAX + BLOB_NAME_MAX];
+        blob_job* job = blob_job_push(&blob_jobs[i], id, (off_t)off);
+        tuner.last_ms[i] = 0;
+        if (job) {
+            // announce again so the client knows size and name after its own restart
+            int len = blob_announce(line, sizeof(line), id, (long long)job->end, e ? e->name : "blob");
+            queue_ctrl(i, line, (size_t)len, debug);
+            }
+        else {
+            int len = snprintf(line, sizeof(line), "!?!?BERR %llx\n", id);
+            queue_ctrl(i, line, (size_t)len, debug);
+            }
+        return (int)(nl - buf + 1);
+        }
+    return 0;
+    }
+
+
+
+
+/*
+roster requests of slot i :
+    !?!?ROSTER <epoch>   subscribe , SNAP unless the client is already at the room epoch
+    !?!?NICK <name>      rename , every subscriber gets one NICK delta
+    return -1 : Error , 0 : not a roster line , n : bytes consumed
+*/
+int roster_control(int i, const char* buf, size_t n, int debug)
+    {
+    const char* nl = memchr(buf, '\n', n);
+    if (!nl) {
+        return 0;
+        }
+    size_t line_len = (size_t)(nl - buf);
+    if (line_len > 11 && memcmp(buf, "!?!?ROSTER ", 11) == 0) {
+        unsigned long long have = strtoull(buf + 11, NULL, 10);
+        room.m[i].subscribed = true;
+        dlv.from_sent[i] = 0;
+        if (have == 0 || have != room.epoch) {
+            const out_buffer* snap = roster_snapshot(&room);
+            queue_ctrl(i, snap->data, snap->len, debug);
+            room.snaps++;
+            room.snap_bytes += snap->len;
+            }
+        return (int)(line_len + 1);
+        }
+    if (line_len > 9 && memcmp(buf, "!?!?NICK ", 9) == 0) {
+        size_t name_len = hs_trim(buf + 9, line_len - 9);
+        if (!roster_nick(&room, i, buf + 9, name_len)) {
+            fprintf(stderr, "[%sError%s] | Bad nick [fd=%d]\n", FG_RED, RESET, clinets[i]);
+            return -1;
+            }
+        memcpy(cli_infos[i].cli_name, room.m[i].name, name_len + 1);
+        return (int)(line_len + 1);
+        }
+    return 0;
+    }
+
+// deltas of this tick , one append per subscriber
+void roster_flush(int debug)
+    {
+    if (room.delta.len == 0) {
+        return;
+        }
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (clinets[i] != -1 && room.m[i].subscribed) {
+            queue_ctrl(i, room.delta.data, room.delta.len, debug);
+            room.delta_bytes += room.delta.len;
+            }
+        }
+    room.delta.len = room.delta.sent = 0;
+    }
+
+/*
+reliable delivery requests of slot i (delivery.h) :
+    !?!?SYNC <boot> <seq>   resume , replay the ring after seq (0 / other boot = after the uuid ack)
+    !?!?ACK <seq>           cumulative ack of room msgs
+    !?!?CSEQ <run> <n>      numbering of the chat lines which follow
+    return -1 : Error , 0 : not a delivery line , n : bytes consumed (slot can be dropped by a replay over the output limit)
+*/
+int delivery_control(int i, const char* buf, size_t n, int debug)
+    {
+    const char* nl = memchr(buf, '\n', n);
+    if (!nl) {
+        return 0;
+        }
+    int used = (int)(nl - buf + 1);
+    unsigned int boot;
+    unsigned long long a;
+    if (sscanf(buf, "!?!?ACK %llu", &a) == 1) {
+        dlv_ack(&dlv, i, a);
+        return used;
+        }
+    if (sscanf(buf, "!?!?CSEQ %u %llu", &boot, &a) == 2) {
+        dlv_cseq(&dlv, i, boot, a);
+        return used;
+        }
+    if (memcmp(buf, "!?!?SYNC ", 9) != 0) {
+        return 0;
+        }
+    if (sscanf(buf, "!?!?SYNC %x %llu", &boot, &a) != 2) {
+        return -1;
+        }
+    dlv_session* s = dlv_sess(&dlv, i);
+    unsigned long long after = (boot == dlv.boot && a != 0) ? a : (s ? s->acked : dlv.seq);
+    if (after > dlv.seq) {
+        after = dlv.seq;
+        }
+    if (s && after > s->acked) {
+        s->acked = after;
+        }
+    dlv.synced[i] = true;
+    dlv.from_sent[i] = 0;
+    dlv.seq_sent[i] = after;
+    dlv.syncs++;
+    unsigned long long missed = dlv_missed(&dlv, after);
+    dlv.missed += missed;
+    char line[DLV_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "!?!?SEQ %x %llu %llu\n", dlv.boot, dlv.seq, missed);
+    queue_ctrl(i, line, (size_t)len, debug);
+    // the gap , in order and before any msg which comes after this line
+    for (int k = dlv_find(&dlv, after);k < dlv.count && clinets[i] != -1;k++) {
+        rtx_entry* e = dlv_entry(&dlv, k);
+        if (e->sess >= 0 && e->sess == dlv.sess_of[i]) {
+            continue;
+            }
+        len = dlv_mark(&dlv, i, e->from, e->seq, line, sizeof(line));
+        if (len > 0 && !lane_append(&out_bufs[i], LANE_DATA, line, (size_t)len)) {
+            fprintf(stderr, "[%sError%s] | Slow client , output limit reached [fd=%d]\n", FG_RED, RESET, clinets[i]);
+            drop_client(i, debug);
+            break;
+            }
+        zw_begin(&zroom);
+        queue_room_msg(i, dlv.ring + e->off, e->len, debug);
+        if (e->len > 0 && dlv.ring[e->off + e->len - 1] != '\n' && clinets[i] != -1) {
+            queue_msg(i, "\n", 1, debug);
+            }
+        queue_frame_end(i, debug);
+        dlv.replayed++;
+        }
+    // a replay over the output limit dropped the slot already , the caller checks clinets[i]
+    return used;
+    }
+
+// CACK to every slot whose chat lines were taken this tick
+void delivery_flush(int debug)
+    {
+    char line[DLV_LINE_MAX];
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (!dlv.cack_due[i] || clinets[i] == -1) {
+            continue;
+            }
+        dlv.cack_due[i] = false;
+        dlv_session* s = dlv_sess(&dlv, i);
+        if (!s) {
+            continue;
+            }
+        int len = snprintf(line, sizeof(line), "!?!?CACK %llu\n", s->cseq);
+        queue_ctrl(i, line, (size_t)len, debug);
+        dlv.cacks++;
+        }
+    }
+
+/*
+"!?!?ZLIB <dict id>" : slot i takes Z frames , it has dictionary <dict id> (ignored without -Z)
+    return 0 : not a ZLIB line , n : bytes consumed
+*/
+int zwire_control(int i, const char* buf, size_t n)
+    {
+    const char* nl = memchr(buf, '\n', n);
+    unsigned int id;
+    if (!nl || n < 9 || memcmp(buf, "!?!?ZLIB ", 9) != 0 || sscanf(buf, "!?!?ZLIB %x", &id) != 1) {
+        return 0;
+        }
+    if (zroom.enabled) {
+        zroom.cap[i] = true;
+        zroom.have[i] = id;
+        }
+    return (int)(nl - buf + 1);
+    }
+
+/*
+"!?!?UDP" : slot i takes events (UTOK , with a token when -U) , "!?!?EV <type> <text>" : event over TCP (udp_lane.h)
+    return 0 : not an event line , n : bytes consumed
+*/
+int udp_control(int i, const char* buf, size_t n, int debug)
+    {
+    const char* nl = memchr(buf, '\n', n);
+    if (!nl) {
+        return 0;
+        }
+    size_t len = (size_t)(nl - buf);
+    if (len == 7 && memcmp(buf, "!?!?UDP", 7) == 0) {
+        // port 0 / token 0 : no UDP , the client still learns its member id (skips its own events)
+        uint64_t token = udp_want(&udp, i);
+        char line[96];
+        int l = snprintf(line, sizeof(line), "!?!?UTOK %u %x %llx\n", token ? (unsigned)udp.port : 0u, room.m[i].id,
+            (unsigned long long)token);
+        queue_ctrl(i, line, (size_t)l, debug);
+        return (int)len + 1;
+        }
+    int type, pos = 0;
+    if (len >= 8 && memcmp(buf, "!?!?EV ", 7) == 0 && sscanf(buf + 7, "%d%n", &type, &pos) == 1) {
+        const char* text = buf + 7 + pos;
+        text += (text < nl && *text == ' ');
+        udp.tcp_events_in++;
+        udp_post(&udp, i, room.m[i].id, type, text, (size_t)(nl - text));
+        return (int)len + 1;
+        }
+    return 0;
+    }
+
+// event datagrams (UDP_READ_BATCHES recvmmsg at most) , a hello or a new address of a member gets UACK
+void udp_input()
+    {
+    for (int b = 0;b < UDP_READ_BATCHES;b++) {
+        int n = udp_recv_batch(&udp);
+        for (int k = 0;k < n;k++) {
+            uint32_t id;
+            uint64_t token;
+            int type;
+            const char* text;
+            size_t len;
+            int i = 0;
+            struct sockaddr_in* from = &udp.rx_from[k];
+            // token of the member , from the ip of its TCP connection
+            if (!udp_parse(&udp, k, &id, &token, &type, &text, &len) || (i = (int)(id & ROSTER_SLOT_MASK)) >= FD_SETSIZE ||
+                clinets[i] == -1 || room.m[i].id != id || udp.token[i] != token || from->sin_addr.s_addr != cli_ip[i]) {
+                udp.bad_in++;
+                continue;
+                }
+            if (type == UE_HELLO || udp.addr[i].sin_port != from->sin_port) {
+                udp.addr[i] = *from;
+                sendto(udp.fd, "!?!?UACK\n", 9, 0, (struct sockaddr*)from, sizeof(*from));
+                }
+            udp.events_in += (type != UE_HELLO);
+            udp_post(&udp, i, id, type, text, len);
+            }
+        if (n < UDP_BATCH) {
+            break;
+            }
+        }
+    }
+
+// events of the tick : datagrams to the UDP clients (sendmmsg) , the same EV lines on the control lane of the others
+void udp_tick(int debug)
+    {
+    if (udp.ev_count == 0) {
+        return;
+        }
+    int n = udp_batch(&udp);
+    if (udp.fd >= 0) {
+        udp_fanout(&udp);
+        }
+    for (int j = 0;j < FD_SETSIZE;j++) {
+        if (!udp.want[j] || udp.addr[j].sin_port != 0 || clinets[j] == -1) {
+            continue;
+            }
+        if (out_pending(&ctrl_bufs[j]) >= UDP_TCP_BACKLOG) {
+            udp.tcp_skipped++;
+            continue;
+            }
+        for (int d = 0;d < n && clinets[j] != -1;d++) {
+            queue_ctrl(j, udp.dgram[d], udp.dgram_len[d], debug);
+            }
+        udp.tcp_batches++;
+        }
+    }
+
+// room dictionary trained again from the newest msgs of the delivery ring (zwire.h)
+void zwire_tick()
+    {
+    if (!zroom.enabled || zroom.msgs_since_train < (zroom.dict_len ? ZDICT_TRAIN_MSGS : ZDICT_FIRST_MSGS)) {
+        return;
+        }
+    static const char* msg[RTX_MSGS];
+    static size_t len[RTX_MSGS];
+    int first = dlv.count;
+    size_t bytes = 0;
+    while (first > 0 && bytes < ZDICT_SAMPLE) {
+        bytes += dlv_entry(&dlv, --first)->len;
+        }
+    int n = 0;
+    for (int k = first;k < dlv.count;k++) {
+        rtx_entry* e = dlv_entry(&dlv, k);
+        msg[n] = dlv.ring + e->off;
+        len[n++] = e->len;
+        }
+    zw_train(&zroom, msg, len, n);
+    }
+
+/*
+control line of slot i (starts with MSG_SEPRATE)
+    return -1 : Error , drop the client
+    return  n : bytes consumed (0 = no handler knows it , the caller drops it , never relayed as chat)
+*/
+int control_line(int i, const char* buf, size_t n, int debug)
+    {
+    // buf is a slice of the read buffer without '\0' , the parsers below sscanf() it (strlen of the input)
+    char ctl[CTRL_LINE_MAX + 1];
+    if (n > CTRL_LINE_MAX) {
+        return 0;
+        }
+    memcpy(ctl, buf, n);
+    ctl[n] = '\0';
+    buf = ctl;
+    if (n > 9 && memcmp(buf, "!?!?PONG ", 9) == 0) {
+        long long sent_us = strtoll(buf + 9, NULL, 10);
+        long long rtt = now_us() - sent_us;
+        cli_pong[i] = true;
+        if (rtt >= 0 && rtt > stats.hb_rtt_max_us) {
+            stats.hb_rtt_max_us = rtt;
+            }
+        return (int)n;
+        }
+    int used = roster_control(i, buf, n, debug);
+    if (used != 0) {
+        return used;
+        }
+    used = delivery_control(i, buf, n, debug);
+    if (used != 0) {
+        return used;
+        }
+    used = zwire_control(i, buf, n);
+    if (used != 0) {
+        return used;
+        }
+    used = udp_control(i, buf, n, debug);
+    if (used != 0) {
+        return used;
+        }
+    return blob_control(i, buf, n, debug);
+    }
+
+/*
+PING every ready client on the control lane , drop clients which stopped answering
+(a busy data lane does not delay the PING , it is sent first)
+*/
+void heartbeat(int debug)
+    {
+    static time_t last = 0;
+    if (tick_now - last < HEARTBEAT_INTERVAL_S) {
+        return;
+        }
+    last = tick_now;
+    char ping[48];
+    int len = snprintf(ping, sizeof(ping), "!?!?PING %lld\n", now_us());
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        // welcome has no newline , a PING in the handshake tick would be glued to it
+        if (clinets[i] == -1 || !cli_ready[i] || tick_now - cli_accept_t[i] < HEARTBEAT_INTERVAL_S) {
+            continue;
+            }
+        if (cli_pong[i] && tick_now - cli_last_in[i] > HEARTBEAT_TIMEOUT_S) {
+            fprintf(stderr, "[%sError%s] | Heartbeat timeout [fd=%d]\n", FG_RED, RESET, clinets[i]);
+            stats.hb_timeouts++;
+            drop_client(i, debug);
+            continue;
+            }
+        queue_ctrl(i, ping, (size_t)len, debug);
+        stats.hb_pings++;
+        }
+    }
+
+// socket tuning of the next TUNE_PER_TICK slots (sock_tune.h)
+void tune_sockets()
+    {
+    long long now = now_us() / 1000;
+    for (int n = 0;n < TUNE_PER_TICK;n++) {
+        int i = tuner.next;
+        tuner.next = (tuner.next + 1) % FD_SETSIZE;
+        if (clinets[i] == -1 || !cli_ready[i] || now - tuner.last_ms[i] < TUNE_INTERVAL_MS) {
+            continue;
+            }
+        tune_slot(&tuner, i, clinets[i], uploads[i].active || blob_jobs[i] != NULL, now);
+        }
+    }
+
+/*
+split received bytes of slot i into msgs (scan.h) and handle each of them
+    return -1 : Error , drop the client
+    return 0  : Success (or the slot was dropped on the way , clinets[i] == -1)
+*/
+int process_input(int i, const char* data, size_t len, int debug)
+    {
+    size_t off = 0;
+    while (off < len) {
+        // raw blob bytes which followed a BLOB header in the same read()
+        if (uploads[i].active) {
+            bool was_failed = uploads[i].failed;
+            off += blob_upload_write(&uploads[i], data + off, len - off);
+            if (uploads[i].failed && !was_failed) {
+                fprintf(stderr, "[%sError%s] | Blob spool write failed , dropping the upload [fd=%d]\n", FG_RED, RESET, clinets[i]);
+                }
+            if (uploads[i].left == 0) {
+                finish_upload(i, debug);
+                }
+            continue;
+            }
+        scan_line lines[SCAN_MAX_LINES];
+        size_t consumed;
+        size_t count = scan_lines(data + off, len - off, lines, SCAN_MAX_LINES, &consumed);
+        if (count == 0) {
+            break;
+            }
+        bool upload_started = false;
+        for (size_t k = 0;k < count;k++) {
+            const char* line = data + off + lines[k].start;
+            // control line (starts with MSG_SEPRATE)
+            if (lines[k].sep == 0) {
+                int used = control_line(i, line, lines[k].len, debug);
+                // its answer went over the output limit , the slot is dropped already
+                if (clinets[i] == -1) {
+                    return 0;
+                    }
+                if (used < 0) {
+                    return -1;
+                    }
+                if (used > 0 && uploads[i].active) {
+                    // bytes after the header are blob data , not lines
+                    off += lines[k].start + lines[k].len;
+                    upload_started = true;
+                    break;
+                    }
+                if (used > 0) {
+                    continue;
+                    }
+                }
+            // resend of a line which made it before the reconnect
+            if (!dlv_take_line(&dlv, i)) {
+                continue;
+                }
+            // unknown request (newer client / forged frame) : never relayed , a receiver would run it as a server frame
+            if (lines[k].sep == 0) {
+                stats.ctrl_dropped++;
+                if (debug) {
+                    fprintf(stderr, "[%sError%s] | Unknown control line dropped [fd=%d]\n", FG_RED, RESET, clinets[i]);
+                    }
+                continue;
+                }
+            if (!lines[k].utf8_ok) {
+                stats.msgs_invalid++;
+                if (debug) {
+                    fprintf(stderr, "[%sError%s] | Invalid utf-8 msg dropped [fd=%d]\n", FG_RED, RESET, clinets[i]);
+                    }
+                continue;
+                }
+            filter_msg(i, line, lines[k].len, debug);
+            if (clinets[i] == -1) {
+                return 0;
+                }
+            }
+        if (!upload_started) {
+            off += consumed;
+            }
+        }
+    // rest is an unfinished line
+    size_t rest = len - off;
+    if (rest >= LINE_MAX_LEN) {
+        if (dlv_take_line(&dlv, i) && memcmp(data + off, MSG_SEPRATE, MSG_SEP_LEN) != 0) {
+            filter_msg(i, data + off, rest, debug);
+            }
+        rest = 0;
+        }
+    if (!partial_store(i, data + off, rest)) {
+        return -1;
+        }
+    return 0;
+    }
+
+/*
+transcript files of slot i : client_files/<uuid>/<ip>/cli_N.txt and the index writer of the uuid
+    return -1 : Error
+*/
+static int open_transcript(int i, int* file_count, int debug)
+    {
+    char path[META_BUFFER_SIZE];
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr a = { .s_addr = cli_ip[i] };
+    inet_ntop(AF_INET, &a, ip, sizeof(ip));
+    // 1. client_files/<client_uuid>
+    snprintf(path, sizeof(path), "client_files/%s", cli_infos[i].cli_uuid);
+    if (create_directory(path, debug) == -1) {
+        return -1;
+        }
+    log_idx[i] = log_index_open(path, cli_infos[i].cli_uuid);
+    if (!log_idx[i]) {
+        fprintf(stderr, "[%sError%s] | Transcript index not opened [%s]\n", FG_RED, RESET, path);
+        }
+    cli_file_no[i] = *file_count;
+
+    // 2. client_files/<client_uuid>/<clinet_ip>
+    size_t dir_len = strlen(path);
+    snprintf(path + dir_len, sizeof(path) - dir_len, "/%s", ip);
+    if (create_directory(path, debug) == -1) {
+        return -1;
+        }
+
+    // 3. client_files/<client_uuid>/<clinet_ip>/cli_<no.of file>.txt (-Z : cli_<no>.zlog + .zidx)
+    dir_len = strlen(path);
+    snprintf(path + dir_len, sizeof(path) - dir_len, "/cli_%d", (*file_count)++);
+    if (zroom.enabled) {
+        f_ptr[i] = zlog_fopen(path, &cli_log_off[i]);
+        if (!f_ptr[i]) {
+            return -1;
+            }
+        }
+    else {
+        // append , the transcript index points into old bytes of this file (after a restart)
+        strncat(path, ".txt", sizeof(path) - strlen(path) - 1);
+        f_ptr[i] = fopen(path, "a");
+        if (!f_ptr[i]) {
+            perror("Error opening file");
+            return -1;
+            }
+        fseek(f_ptr[i], 0, SEEK_END);
+        cli_log_off[i] = ftell(f_ptr[i]);
+        }
+    return 0;
+    }
+
+/*
+handshake of slot i : read "name!?!?uuid" , answer "server_name!?!?<color>" and open the transcript files
+(runs on first readable , with TCP_DEFER_ACCEPT that is normally right after accept)
+the hello is collected in partial[i] over reads , it ends at a '\n' after the separator . a hello without
+'\n' (old clients) which decodes is whole only when no more bytes follow : settled = called after
+HELLO_SETTLE_US of quiet , take the collected bytes as they are
+    return -1 : Error , drop the client
+    return 0  : no whole hello yet
+    return 1  : Success
+    return 2  : hello without '\n' decodes , take it if nothing follows (call again with settled)
+*/
+int client_handshake(int i, const char* server_name, size_t server_len, int* file_count, bool settled, int debug)
+    {
+    int cli_fd = clinets[i];
+    if (!settled) {
+        if (!partial_reserve(i, META_BUFFER_SIZE)) {
+            fprintf(stderr, "[%sError%s] | Receive memory limit reached [fd=%d]\n", FG_RED, RESET, cli_fd);
+            return -1;
+            }
+        ssize_t n = recv(cli_fd, partial[i] + partial_len[i], META_BUFFER_SIZE - partial_len[i], 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return 0;
+            }
+        if (n <= 0) {
+            fprintf(stderr, "Meta Data 'recv' Failed [fd=%d]\n", cli_fd);
+            return -1;
+            }
+        partial_len[i] += (size_t)n;
+        }
+    else if (partial_len[i] == 0) {
+        return -1;
+        }
+    // '\n' in front of the separator is the fgets newline of old clients , part of the name
+    long sep = hs_find_sep(partial[i], partial_len[i]);
+    const char* nl = NULL;
+    if (sep >= 0) {
+        size_t from = (size_t)sep + HS_SEP_LEN;
+        nl = memchr(partial[i] + from, '\n', partial_len[i] - from);
+        }
+    size_t hello_len = nl ? (size_t)(nl - partial[i]) + 1 : partial_len[i];
+    hs_hello hello;
+    bool ok = (hs_decode_hello(partial[i], hello_len, &hello) == 0);
+    if (!nl && !settled && partial_len[i] < META_BUFFER_SIZE) {
+        return ok ? 2 : 0;
+        }
+    if (!ok) {
+        // settled without a hello = the handshake timed out , counted by the caller
+        if (!settled) {
+            fprintf(stderr, "[%sError%s] | Bad meta data [fd=%d]\n", FG_RED, RESET, cli_fd);
+            }
+        return -1;
+        }
+    // bytes after the hello are the first chat / control lines , read with the next bytes
+    if (!partial_store(i, partial[i] + hello_len, partial_len[i] - hello_len)) {
+        fprintf(stderr, "[%sError%s] | Receive memory limit reached [fd=%d]\n", FG_RED, RESET, cli_fd);
+        return -1;
+        }
+    client_info* client_info_t = &cli_infos[i];
+    memcpy(client_info_t->cli_name, hello.name, (size_t)hello.name_len + 1);
+    memcpy(client_info_t->cli_uuid, hello.uuid, (size_t)hello.uuid_len + 1);
+    clinet_struct[i] = client_info_t;
+    printf("Client_name:%s\n", client_info_t->cli_name);
+    printf("Clinet uuid key: %s\n", client_info_t->cli_uuid);
+
+    // send server name , send a random number to pick a color
+    char reply[HS_MSG_MAX + 1];
+    int reply_len = hs_encode_welcome(reply, sizeof(reply), server_name, server_len, random_int());
+    // fresh socket , the short reply always fits in the send buffer
+    if (reply_len < 0 || send(cli_fd, reply, (size_t)reply_len, MSG_NOSIGNAL) != reply_len) {
+        fprintf(stderr, "[%sError%s] | Meta Data 'send' Failed [To fd=%d]\n", FG_RED, RESET, cli_fd);
+        return -1;
+        }
+
+    // ------------file creation part-------------
+    // a reconnect within STEER_KEEP_S goes on with the transcript parked on its home slot
+    uint64_t uuid_hash = steer_hash(client_info_t->cli_uuid);
+    if (!steer_resume(&steering, i, uuid_hash, cli_ip[i], &f_ptr[i], &log_idx[i], &cli_file_no[i], &cli_log_off[i]) &&
+        open_transcript(i, file_count, debug) < 0) {
+        return -1;
+        }
+    // handshake is done , from now all output goes through out_bufs[i]
+    tune_client_socket(cli_fd);
+    cli_ready[i] = true;
+    cli_last_in[i] = time(NULL);
+    client_info_t->cli_id = (int)roster_join(&room, i, client_info_t->cli_name);
+    dlv_attach(&dlv, i, client_info_t->cli_uuid);
+    tune_reset(&tuner, i);
+    zw_attach(&zroom, i);
+    steer_claim(&steering, i, uuid_hash);
+    trace_event(&tracer, TR_OPEN, i, 0, 0);
+    return 1;
+    }
 
+// what the handshake coroutine needs from main()
+typedef struct handshake_env {
+    const char* server_name;
+    size_t server_len;
+    int* file_count;
+    int debug;
+    }handshake_env;
+
+/*
+handshake of slot i as a coroutine : hello can come in pieces of reads (or late , without
+TCP_DEFER_ACCEPT) , the coroutine waits for the rest with a timer instead of a per tick scan .
+the same timer settles a hello without '\n' (HELLO_SETTLE_US , never past the handshake end)
+*/
+int handshake_co(coro* c, int i, void* arg)
+    {
+    handshake_env* env = (handshake_env*)arg;
+    int r;
+    CORO_BEGIN(c);
+    coro_timeout(c, HANDSHAKE_TIMEOUT_S * 1000000LL);
+    hs_deadline_us[i] = c->deadline_us;
+    for (;;) {
+        r = client_handshake(i, env->server_name, env->server_len, env->file_count, false, env->debug);
+        if (r == 1 || r < 0) {
+            CORO_EXIT(c, (r < 0) ? CORO_ERROR : CORO_DONE);
+            }
+        c->deadline_us = hs_deadline_us[i];
+        if (r == 2 && coro_now_us() + HELLO_SETTLE_US < c->deadline_us) {
+            c->deadline_us = coro_now_us() + HELLO_SETTLE_US;
+            }
+        CORO_WAIT_READ(c);
+        if (c->timed_out) {
+            // quiet after a hello without '\n' , or the end of the handshake
+            if (client_handshake(i, env->server_name, env->server_len, env->file_count, true, env->debug) == 1) {
+                CORO_EXIT(c, CORO_DONE);
+                }
+            if (coro_now_us() >= hs_deadline_us[i]) {
+                stats.handshake_timeouts++;
+                }
+            CORO_EXIT(c, CORO_ERROR);
+            }
+        }
+    CORO_END(c);
+    }
+
+/*
+put an accepted fd into a free slot , the home slot of its uuid when the hello is already there (steer.h)
+    return -1 : no free slot (or fd too big for select) , fd is closed
+    return  i : slot
+*/
+int place_client(int cli_fd, const struct sockaddr_in* cli)
+    {
+    if (cli_fd >= FD_SETSIZE) {
+        close(cli_fd);
+        return -1;
+        }
+    time_t now = time(NULL);
+    int i = steer_slot(&steering, steer_peek(&steering, cli_fd), clinets, now);
+    if (i < 0) {
+        close(cli_fd);
+        return -1;
+        }
+    clinets[i] = cli_fd;
+    cli_files[i] = cli_fd;
+    cli_ready[i] = false;
+    cli_accept_t[i] = now;
+    cli_ip[i] = cli->sin_addr.s_addr;
+    return i;
+    }
 
 //create a TCP socket , 
 static int make_listen_socket(uint16_t port)
@@ -70,37 +1294,112 @@ from host byte order to network byte order. Network byte order is big-endian.
         perror("[Error] listen");
         exit(1);
         }
+    /*
+    1. non-blocking , the accept loop drains the backlog until EAGAIN
+    2. TCP_DEFER_ACCEPT , a connection wakes us only when its handshake bytes are there
+       (half open / silent connections of a storm never reach the event loop)
+    */
+    int flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+    int defer = DEFER_ACCEPT_S;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer)) < 0) {
+        perror("setsockopt TCP_DEFER_ACCEPT");
+        }
     return fd;
     }
 
 
+static void on_stop(int sig)
+    {
+    (void)sig;
+    stop_requested = 1;
+    }
+
 int main(int argc, char* argv[])
     {
     //if port is not given through command line
-    if (argc != 2) {
-        fprintf(stderr, "%sUsage : %s <port>%s\n", FG_RED, argv[0], RESET);
+    if (argc < 2) {
+        fprintf(stderr, "%sUsage : %s <port> [-L <cpu>] [-P <slow_tick_ms>] [-F <folded_stacks_file>] [-R <trace_file>] [-M <filter.so[:arg]>]... [-T <tune_csv>] [-Z] [-U] [-C <config>]%s\n", FG_RED, argv[0], RESET);
         return 2;
         }
+    udp.fd = -1;
+    server_config conf;
+    bool have_conf = false;
+    // options after the port
+    for (int k = 2;k < argc;k++) {
+        if (strcmp(argv[k], "-L") == 0 && k + 1 < argc) {
+            // pin + local NUMA node before any slot state is touched
+            if (lowlat_init(atoi(argv[++k])) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-P") == 0 && k + 1 < argc) {
+            prof.slow_us = atol(argv[++k]) * 1000LL;
+            }
+        else if (strcmp(argv[k], "-F") == 0 && k + 1 < argc) {
+            if (prof_sampling_start(argv[++k]) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-R") == 0 && k + 1 < argc) {
+            if (trace_open(&tracer, argv[++k]) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-U") == 0) {
+            // same port number as the TCP listener
+            if (udp_open(&udp, (uint16_t)atoi(argv[1])) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-Z") == 0) {
+            if (zw_init(&zroom) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-T") == 0 && k + 1 < argc) {
+            if (tune_csv_open(&tuner, argv[++k]) < 0) {
+                return 2;
+                }
+            }
+        else if (strcmp(argv[k], "-C") == 0 && k + 1 < argc) {
+            // name , debug mode and snapshot from the file , no prompts
+            if (config_load(argv[++k], &conf) < 0) {
+                return 2;
+                }
+            have_conf = true;
+            }
+        else if (strcmp(argv[k], "-M") == 0 && k + 1 < argc) {
+            // chain runs in the order of the options
+            if (filter_load(&filters, argv[++k]) < 0) {
+                return 2;
+                }
+            }
+        else {
+            fprintf(stderr, "%sUsage : %s <port> [-L <cpu>] [-P <slow_tick_ms>] [-F <folded_stacks_file>] [-R <trace_file>] [-M <filter.so[:arg]>]... [-T <tune_csv>] [-Z] [-U] [-C <config>]%s\n", FG_RED, argv[0], RESET);
+            return 2;
+            }
+        }
 
     uint16_t port = (uint16_t)atoi(argv[1]);
+    // sendfile() has no MSG_NOSIGNAL , a closed peer must give EPIPE , not kill the server
+    signal(SIGPIPE, SIG_IGN);
     int listen_fd = make_listen_socket(port);
-    // to track active client [stores client file descriptor]
-    int clinets[FD_SETSIZE];
+    lowlat_socket(listen_fd);
 
     //client time 
     time_t connect_t;
-    time_t disconnect_t;
+    // spare fd , on EMFILE it is closed to accept and close one pending connection (else listener stays readable forever)
+    int spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
     //storing client data in a file 
     srand(time(NULL));
-    int cli_files[FD_SETSIZE];
-    FILE* f_ptr[FD_SETSIZE];
     int file_count = 0;
 
 
     //Run server in debug mode 
-    unsigned short int input;
-    while (1)
+    unsigned short int input = have_conf ? conf.debug : 0;
+    while (!have_conf)
         {
         printf("Run server in Debug mode [0- No 1- Normal Debug 2- Advance Debug]:\t");
         // %hu :- is a format specifier used for unsign short int  | %hd :- for sign short int 
@@ -114,48 +1413,113 @@ int main(int argc, char* argv[])
 
     // initilize server with name 
     char meta_d_Buffer[META_BUFFER_SIZE];
-    void* clinet_struct[FD_SETSIZE];
-    int s_name_len;
-    printf("Enter Server Name : ");
-    fflush(stdout);
-    scanf("%19s", &meta_d_Buffer);
+    size_t s_name_len;
+    if (have_conf) {
+        snprintf(meta_d_Buffer, sizeof(meta_d_Buffer), "%s", conf.name);
+        }
+    else {
+        printf("Enter Server Name : ");
+        fflush(stdout);
+        scanf("%19s", meta_d_Buffer);
+        }
     s_name_len = strlen(meta_d_Buffer);
+    if (!hs_name_ok(meta_d_Buffer, s_name_len)) {
+        fprintf(stderr, "[%sError%s] | Invalid server name\n", FG_RED, RESET);
+        return 2;
+        }
+
+    handshake_env hs_env = { meta_d_Buffer, s_name_len, &file_count, input };
 
     //initalize the client array with -1 
     for (int i = 0;i < FD_SETSIZE;i++) {
         clinets[i] = -1;
         cli_files[i] = -1;
+        cli_ready[i] = false;
         f_ptr[i] = NULL;
         clinet_struct[i] = NULL;
+        memset(&out_bufs[i], 0, sizeof(out_buffer));
+        memset(&ctrl_bufs[i], 0, sizeof(out_buffer));
+        uploads[i].active = false;
+        blob_jobs[i] = NULL;
+        log_idx[i] = NULL;
+        }
+    if (create_directory("client_files", input) == -1 || create_directory(BLOB_DIR, input) == -1) {
+        return 1;
+        }
+    stats.last_report = time(NULL);
+    dlv_init(&dlv);
+    // state of the last run : sessions , history , seqs (a SYNC from before the restart resumes)
+    snap_state snap_st = { &dlv, &room, &zroom, &file_count };
+    if (have_conf) {
+        snprintf(snapper.path, sizeof(snapper.path), "%s", conf.snapshot);
+        snapper.every = conf.snapshot_every;
+        snapper.next = time(NULL) + snapper.every;
+        if (snap_load(snapper.path, &snap_st) < 0) {
+            fprintf(stderr, "[%sError%s] | Snapshot %s is not valid , cold start\n", FG_RED, RESET, snapper.path);
+            }
         }
+    struct sigaction stop_sa = { .sa_handler = on_stop };
+    sigaction(SIGINT, &stop_sa, NULL);
+    sigaction(SIGTERM, &stop_sa, NULL);
 
     printf("%sListening to port %u (fd=%d)\n%s", FG_BGREEN, (unsigned)port, listen_fd, RESET);
     //event loop
-    while (1) {
+    while (!stop_requested) {
+        // previous tick ends here (slow tick log)
+        prof_tick();
         //sets the file descriptors in fd_set
         fd_set  rfds;
+        fd_set  wfds;
         FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
         FD_SET(listen_fd, &rfds);
         int maxfd = listen_fd;
+        if (udp.fd >= 0) {
+            FD_SET(udp.fd, &rfds);
+            maxfd = (udp.fd > maxfd) ? udp.fd : maxfd;
+            }
+        long long loop_now = now_us();
+        bool timer_joined = false;
         //marks the clients 
         for (int i = 0;i < FD_SETSIZE;i++)
             {
+            // coroutine timer (handshake timeout , settled hello without '\n')
+            if (coro_expired(&co_sched, i, loop_now)) {
+                prof_enter(PH_TIMERS, clinets[i]);
+                int cr = coro_resume(&co_sched, i, CORO_EV_TIMER);
+                if (cr == CORO_ERROR) {
+                    drop_client(i, input);
+                    }
+                timer_joined |= (cr == CORO_DONE);
+                prof_leave();
+                }
             if (clinets[i] != -1)
                 {
                 FD_SET(clinets[i], &rfds);
+                // left over output from last tick (or blob transfer) , wait until socket is writable
+                if (out_pending(&out_bufs[i]) > 0 || out_pending(&ctrl_bufs[i]) > 0 || blob_jobs[i]) {
+                    FD_SET(clinets[i], &wfds);
+                    }
                 if (clinets[i] > maxfd) {
                     maxfd = clinets[i];
                     }
                 }
             }
 
-        //time period 
+        //time period , shorter when a coroutine timer expires first
+        // a client which joined from the timer has a welcome / roster delta to flush , no wait
+        long long wait_us = timer_joined ? 0 : coro_wait_us(&co_sched, loop_now, 10 * 1000000LL);
         struct timeval tv;
-        tv.tv_sec = 10;
-        tv.tv_usec = 0;
+        tv.tv_sec = (time_t)(wait_us / 1000000);
+        tv.tv_usec = (suseconds_t)(wait_us % 1000000);
 
-        //blocks until a fd gets ready or time interval ends
-        int ready = select(maxfd + 1, &rfds, NULL, NULL, &tv);
+        //blocks until a fd gets ready or time interval ends (low latency mode spins a little first)
+        prof_enter(PH_WAIT, -1);
+        int ready = lowlat.enabled ? lowlat_spin(maxfd + 1, &rfds, &wfds) : 0;
+        if (ready == 0) {
+            ready = select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+            }
+        prof_leave();
         if (ready == -1) {
             if (errno == EINTR) {
                 continue;
@@ -164,10 +1528,31 @@ int main(int argc, char* argv[])
             perror("select");
             break;
             }
+        tick_no++;
+        tick_now = time(NULL);
         if (ready == 0) {
             puts("[Timeout]");
+            prof_enter(PH_TIMERS, -1);
+            heartbeat(input);
+            roster_flush(input);
+            delivery_flush(input);
+            tune_sockets();
+            zwire_tick();
+            udp_tick(input);
+            steer_sweep(&steering, tick_now);
+            snap_tick(&snapper, &snap_st, tick_now);
+            prof_leave();
+            prof_enter(PH_FLUSH, -1);
+            flush_dirty(input);
+            prof_leave();
+            prof_enter(PH_REPORT, -1);
+            if (stats_report(&stats, time(NULL))) {
+                mem_report();
+                }
+            prof_leave();
             continue;
             }
+        long long tick_start = now_us();
 
         //new connction ,when a new client wants to connects
 /*FD_ISSET: Checks if a specific file descriptor is present (set) in an fd_set.
@@ -176,108 +1561,111 @@ meaning a new connection is available.*/
 
 //why we used FD_ISSET(listen_fd, &rfds) check QUESTION.md
         if (FD_ISSET(listen_fd, &rfds)) {
-            struct sockaddr_in cli;
-            socklen_t len = sizeof(cli);
-
-            //checks multiple fd at same time and marks then the fd which are ready to read 
-            //accept creates the new socket(new conncetion) for data transfer 
-            int cli_fd = accept(listen_fd, (struct sockaddr*)&cli, &len);
-            if (cli_fd >= 0)
-                {
-                connect_t = time(NULL);
-                printf("\n[%sClient Conected%s] %-20s", FG_GREEN, RESET, ctime(&connect_t));
-
-                char ip[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &cli.sin_addr, ip, sizeof(ip));
-                printf("%sAccepted fd = %d from %s : %d%s\n", FG_BYELLOW, cli_fd, ip, ntohs(cli.sin_port), RESET);
-                //add clients
-                // if we have to send or to do task when , client is just connected. review this section
-                int placed = 0;
-                for (int i = 0; i < FD_SETSIZE;i++) {
-                    if (clinets[i] == -1) {
-                        clinets[i]   = cli_fd;
-                        cli_files[i] = cli_fd;
-                        placed = 1;
-
-                        // send and recieve meta data or client
-                        client_info* client_info_t = (client_info*)malloc(sizeof(client_info));
-                        clinet_struct[i] = client_info_t;
-                        char addr_buf[META_BUFFER_SIZE];
-                        ssize_t n;
-                        if ((n = recv(cli_fd, addr_buf, sizeof(addr_buf), 0)) > 0)
-                            {
-                            addr_buf[n] = '\0';
-                            break_meta_d(&client_info_t, addr_buf);
-                            printf("Client_name:%s\n", client_info_t->cli_name);
-                            printf("Clinet uuid key: %s\n", client_info_t->cli_uuid);
-                            // fflush(stdout);
-                            }
-                        else {
-                            fprintf(stderr, "Meta Data 'recv' Failed [fd=%d]:", cli_fd);
-                            }
-
-                        // send server name , send a random number to pick a color
-                        random_int();
-                        char color_code = '0' + random_int();
-                        if (!(combine_msg(meta_d_Buffer, &color_code))) {
-                            fprintf(stderr, "[%sError%s] | Combine_string_\n", FG_RED, RESET);
-                            }
-                        if (send(cli_fd, meta_d_Buffer, strlen(meta_d_Buffer), 0) < 0) {
-                            fprintf(stderr, "[%sError%s] | Meta Data 'send' Failed [To fd=%d]:", FG_RED, RESET, cli_fd);
-                            }
-                        meta_buffer_refresh(meta_d_Buffer, s_name_len);
-
-                        // ------------file creation part------------- 
-                        // 1. client_files/<client_uuid>
-                        snprintf(addr_buf, sizeof(addr_buf), "client_files/%s", client_info_t->cli_uuid);
-                        char* cli_directory_path = strdup(addr_buf);
-                        if (create_directory(addr_buf, input) == -1) { exit(-1); }
-
-                        // 2. client_files/<client_uuid>/<clinet_ip>
-                        snprintf(addr_buf, sizeof(addr_buf), "%s/%s", cli_directory_path, ip);
-                        if (create_directory(addr_buf, input) == -1) { exit(-1); }
-                        free(cli_directory_path);
-                        cli_directory_path = strdup(addr_buf);
-
-                        // 3. client_files/<client_uuid>/<clinet_ip>/cli_<no.of file>.txt
-                        snprintf(addr_buf, sizeof(addr_buf), "%s/cli_%d.txt", cli_directory_path, file_count++);
-                        free(cli_directory_path);
-                        f_ptr[i] = fopen(addr_buf, "w");
-                        
-                        if (!f_ptr[i]) {
-                            perror("Error opening file");
-                            return 1;
+            // drain the backlog (bounded) , every accept is one syscall , setup waits for the handshake
+            prof_enter(PH_ACCEPT, listen_fd);
+            int accepted = 0;
+            while (accepted < ACCEPT_BUDGET) {
+                struct sockaddr_in cli;
+                socklen_t len = sizeof(cli);
+                int cli_fd = accept4(listen_fd, (struct sockaddr*)&cli, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (cli_fd < 0) {
+                    //EINTR means , sys call interrupted by signal
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                        }
+                    if ((errno == EMFILE || errno == ENFILE) && spare_fd >= 0) {
+                        close(spare_fd);
+                        int drop_fd = accept(listen_fd, NULL, NULL);
+                        if (drop_fd >= 0) {
+                            close(drop_fd);
+                            stats.accept_rejects++;
                             }
-                        break;
+                        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                        continue;
                         }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        perror("Accept");
+                        }
+                    break;
+                    }
+                accepted++;
+                stats.accepts++;
+                int i = place_client(cli_fd, &cli);
+                if (i >= 0) {
+                    lowlat_socket(cli_fd);
                     }
-
                 //if max client limit reached
-                if (!placed) {
-                    fprintf(stderr, "%sToo many clients; closing fd=%d%s", FG_RED, cli_fd, RESET);
-                    close_client(NULL, cli_fd,input);
+                if (i < 0) {
+                    stats.accept_rejects++;
+                    fprintf(stderr, "%sToo many clients; closing fd=%d%s\n", FG_RED, cli_fd, RESET);
+                    continue;
                     }
-                //EINTR means , sys call interrupted by signal
-                else if (errno != EINTR)
-                    {
-                    perror("Accept");
+                connect_t = time(NULL);
+                printf("\n[%sClient Conected%s] %-20s", FG_GREEN, RESET, ctime(&connect_t));
+                char ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &cli.sin_addr, ip, sizeof(ip));
+                printf("%sAccepted fd = %d from %s : %d%s\n", FG_BYELLOW, cli_fd, ip, ntohs(cli.sin_port), RESET);
+                // deferred accept -> the handshake is normally already in the socket , first resume finishes it
+                coro_spawn(&co_sched, i, handshake_co, &hs_env);
+                prof_enter(PH_HANDSHAKE, cli_fd);
+                if (coro_resume(&co_sched, i, CORO_EV_START) == CORO_ERROR) {
+                    drop_client(i, input);
                     }
+                prof_leave();
                 }
-
+            if (accepted == ACCEPT_BUDGET) {
+                stats.accept_budget_hits++;
+                }
+            prof_leave();
+            }
+        // event datagrams , posted for the fan out at tick end
+        if (udp.fd >= 0 && FD_ISSET(udp.fd, &rfds)) {
+            prof_enter(PH_READ, udp.fd);
+            udp_input();
+            prof_leave();
             }
 
         for (int i = 0;i < FD_SETSIZE;i++) {
             int fd = clinets[i];
-            int file_number = i;
             if (fd == -1) {
                 continue;
                 }
+            // writable again , add it to this tick flush
+            if (FD_ISSET(fd, &wfds) && !out_bufs[i].dirty) {
+                out_bufs[i].dirty = true;
+                dirty_slots[dirty_count++] = i;
+                }
             if (!FD_ISSET(fd, &rfds)) {
                 continue;
                 }
+            // accepted without data (defer timeout) , handshake comes now
+            if (coro_running(&co_sched, i)) {
+                prof_enter(PH_HANDSHAKE, fd);
+                if (coro_resume(&co_sched, i, CORO_EV_READ) == CORO_ERROR) {
+                    drop_client(i, input);
+                    }
+                prof_leave();
+                continue;
+                }
+            // upload in progress , socket bytes go to the spool file (no read into buf)
+            if (uploads[i].active) {
+                cli_last_in[i] = tick_now;
+                prof_enter(PH_UPLOAD, fd);
+                if (blob_upload_splice(&uploads[i], fd) < 0) {
+                    fprintf(stderr, "[%sError%s] | Blob upload aborted [fd=%d]\n", FG_RED, RESET, fd);
+                    drop_client(i, input);
+                    }
+                else if (uploads[i].left == 0) {
+                    finish_upload(i, input);
+                    }
+                prof_leave();
+                continue;
+                }
             // In your read section, add detailed debugging:
             char buf[40960];
+            prof_enter(PH_READ, fd);
             ssize_t n = read(fd, buf, sizeof(buf));
+            prof_leave();
 
             //debug code , tells actually what we are recived from client in hexhump format
             if (input == 1)
@@ -315,56 +1703,98 @@ meaning a new connection is available.*/
                 }
 
 
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+                }
             if (n <= 0) {
                 if (n < 0) {
                     fprintf(stderr, "[%sError%s]", FG_BRED, RESET);
                     perror("read");
                     }
-                else {
-                    disconnect_t = time(NULL);
-                    printf("\n[%sClinet Disconnected%s] %s", FG_RED, RESET, ctime(&disconnect_t));
-                    }
-                close_client(clinet_struct[i],fd, input);
-
-                clinets[i] = -1;
-                cli_files[i] = -1;
-                file_close(&f_ptr[i],input);
-                // add f+closee f(x)
-                clinet_struct[i] = NULL;
+                drop_client(i, input);
                 continue;
                 }
+            cli_last_in[i] = tick_now;
 
-            //echo write back 
-            if (n > 0 && n < (ssize_t)sizeof(buf)) {
-                buf[n] = '\0';  // Add null terminator
-                }
-            fprintf(f_ptr[file_number], "%s", buf);
-
-            // broadcasting algorithm
-            for (int j = 0;j < 20;j++) {
-                int cli_fd = clinets[j];
-                if (cli_fd != -1 && cli_fd !=fd) {
-                    printf("client[%d] = %d\t", j, clinets[j]);
-                    ssize_t m = send(cli_fd, buf, n, 0);
-                
-                    printf("written ;%zd bytes\n", m);
-                    if (m < 0) {
-                        fprintf(stderr, "[%sError%s]", FG_BRED, RESET);
-                        perror("Send");
-                        close_client(clinet_struct[j],cli_fd, input);
-
-                        disconnect_t = time(NULL);
-                        printf("\n[%sClinet Disconnected%s] %s", FG_RED, RESET, ctime(&disconnect_t));
-                        clinets[j] = -1;
-                        file_close(&f_ptr[j],input);
-                        clinet_struct[j] = NULL;
-                        }
+            // continue the unfinished line of last read
+            const char* data = buf;
+            size_t len = (size_t)n;
+            if (partial_len[i] > 0) {
+                size_t had = partial_len[i];
+                if (!partial_reserve(i, had + (size_t)n)) {
+                    fprintf(stderr, "[%sError%s] | Receive memory limit reached [fd=%d]\n", FG_RED, RESET, fd);
+                    drop_client(i, input);
+                    continue;
                     }
+                memcpy(partial[i] + had, buf, (size_t)n);
+                data = partial[i];
+                len = had + (size_t)n;
+                }
+            prof_enter(PH_FANOUT, fd);
+            int pr = process_input(i, data, len, input);
+            prof_leave();
+            if (pr < 0) {
+                fprintf(stderr, "[%sError%s] | Bad control msg [fd=%d]\n", FG_RED, RESET, fd);
+                drop_client(i, input);
+                continue;
+                }
+
+            // long read phase , do not let queued msgs wait more than the latency cap
+            if (now_us() - tick_start > OUT_LATENCY_CAP_US) {
+                prof_enter(PH_FLUSH, -1);
+                flush_dirty(input);
+                prof_leave();
+                stats.early_flushes++;
+                tick_start = now_us();
                 }
             }
-        
+
+        // end of tick : one send() per dirty connection , then blob chunks , then chat freed by finished chunks
+        prof_enter(PH_TIMERS, -1);
+        heartbeat(input);
+        roster_flush(input);
+        delivery_flush(input);
+        tune_sockets();
+        zwire_tick();
+        udp_tick(input);
+        steer_sweep(&steering, tick_now);
+        snap_tick(&snapper, &snap_st, tick_now);
+        prof_leave();
+        prof_enter(PH_FLUSH, -1);
+        flush_dirty(input);
+        prof_leave();
+        prof_enter(PH_BLOB, -1);
+        pump_blobs(input);
+        prof_leave();
+        prof_enter(PH_FLUSH, -1);
+        flush_dirty(input);
+        prof_leave();
+        // logs first , then the index records which point into them
+        prof_enter(PH_DISK, -1);
+        fflush(NULL);
+        log_index_flush_all();
+        prof_leave();
+        prof_enter(PH_REPORT, -1);
+        if (stats_report(&stats, time(NULL))) {
+            mem_report();
+            }
+        prof_leave();
+        }
+    // live sessions : transcript first , then the index writer writes the terms segment of its records
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (f_ptr[i]) {
+            file_close(&f_ptr[i], input);
+            }
+        log_index_close(log_idx[i]);
+        log_idx[i] = NULL;
         }
+    snap_final(&snapper, &snap_st);
     //closing listening socket
     close(listen_fd);
+    if (udp.fd >= 0) {
+        close(udp.fd);
+        }
+    steer_sweep(&steering, 0);
+    filter_close_all(&filters);
     return 0;
     }
\ No newline at end of file
@@ -0,0 +1,239 @@
+#ifndef FILTER_H   // msg filter chain : shared objects (chat_filter.h ABI) between read and fan out
+#define FILTER_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "chat_filter.h"
+#include "buf_pool.h"
+
+/*
+"-M path.so[:arg]" (repeatable) loads filters , every chat line runs through them in that order :
+    1. no filter loaded : the line goes straight to deliver_msg , the chain is not even called
+    2. PASS keeps the view of the read buffer , nothing is copied
+    3. REWRITE writes into a buffer of rx_pool (two of them are swapped when several filters rewrite) ,
+       the next filter gets the new line as its view
+    4. DROP / ROUTE end the chain
+every call is timed (calls , ns , max , verdicts per filter) . a call over FILTER_BUDGET_NS is a strike ,
+FILTER_STRIKES strikes in a row switch the filter off (it can not be stopped inside a call , the
+loop thread runs it) . a bad rewrite (too long , '\n' inside) counts and the line goes on unchanged
+*/
+#define FILTER_MAX       8
+#define FILTER_BUDGET_NS 200000          // 0.2 ms per call
+#define FILTER_STRIKES   16
+#define FILTER_OUT_MAX   POOL_CONN_MAX   // rewrite buffer (largest pool class)
+
+typedef struct chat_filter {
+    const chat_filter_ops* ops;
+    void* state;
+    void* dl;
+    char path[256];
+    bool off;               // over budget too often
+    int strikes;
+    // counters since last report
+    unsigned long calls;
+    unsigned long drops;
+    unsigned long rewrites;
+    unsigned long routes;
+    unsigned long bad;
+    unsigned long over_budget;
+    long long ns;
+    long long max_ns;
+    }chat_filter;
+
+typedef struct filter_chain {
+    int count;
+    chat_filter f[FILTER_MAX];
+    unsigned long route_miss;   // ROUTE to a name which is not online
+    }filter_chain;
+
+static long long filter_now_ns()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+/*
+load "path.so[:arg]" at the end of the chain
+    return -1 : Error [dlopen / entry / abi / init]
+*/
+int filter_load(filter_chain* fc, const char* spec)
+    {
+    if (fc->count >= FILTER_MAX) {
+        fprintf(stderr, "[%sError%s] | Filter %s : at most %d filters\n", FG_RED, RESET, spec, FILTER_MAX);
+        return -1;
+        }
+    chat_filter* f = &fc->f[fc->count];
+    memset(f, 0, sizeof(*f));
+    snprintf(f->path, sizeof(f->path), "%s", spec);
+    const char* arg = "";
+    char* colon = strchr(f->path, ':');
+    if (colon) {
+        *colon = '\0';
+        arg = colon + 1;
+        }
+    f->dl = dlopen(f->path, RTLD_NOW | RTLD_LOCAL);
+    if (!f->dl) {
+        fprintf(stderr, "[%sError%s] | Filter %s : %s\n", FG_RED, RESET, f->path, dlerror());
+        return -1;
+        }
+    chat_filter_entry_fn entry;
+    // dlsym gives a data pointer , POSIX allows this cast for functions
+    *(void**)&entry = dlsym(f->dl, CHAT_FILTER_ENTRY);
+    f->ops = entry ? entry() : NULL;
+    if (!f->ops || f->ops->abi != CHAT_FILTER_ABI || !f->ops->filter) {
+        fprintf(stderr, "[%sError%s] | Filter %s : no %s() or abi %u (server has %d)\n", FG_RED, RESET, f->path,
+            CHAT_FILTER_ENTRY, f->ops ? f->ops->abi : 0, CHAT_FILTER_ABI);
+        dlclose(f->dl);
+        return -1;
+        }
+    if (f->ops->init) {
+        f->state = f->ops->init(arg);
+        if (!f->state) {
+            fprintf(stderr, "[%sError%s] | Filter %s : init(\"%s\") failed\n", FG_RED, RESET, f->path, arg);
+            dlclose(f->dl);
+            return -1;
+            }
+        }
+    fc->count++;
+    printf("%sFilter %d : %s (%s) arg \"%s\"%s\n", FG_BGREEN, fc->count, f->ops->name ? f->ops->name : "?", f->path, arg, RESET);
+    return 0;
+    }
+
+void filter_close_all(filter_chain* fc)
+    {
+    for (int k = 0;k < fc->count;k++) {
+        if (fc->f[k].ops->fini) {
+            fc->f[k].ops->fini(fc->f[k].state);
+            }
+        dlclose(fc->f[k].dl);
+        }
+    fc->count = 0;
+    }
+
+// time one call , switch the filter off after too many slow calls in a row
+static void filter_account(chat_filter* f, long long ns)
+    {
+    f->calls++;
+    f->ns += ns;
+    if (ns > f->max_ns) {
+        f->max_ns = ns;
+        }
+    if (ns <= FILTER_BUDGET_NS) {
+        f->strikes = 0;
+        return;
+        }
+    f->over_budget++;
+    if (++f->strikes >= FILTER_STRIKES) {
+        f->off = true;
+        fprintf(stderr, "[%sError%s] | Filter %s switched off : %d calls in a row over %.1f ms (last %.1f ms)\n",
+            FG_RED, RESET, f->ops->name ? f->ops->name : f->path, FILTER_STRIKES, FILTER_BUDGET_NS / 1e6, ns / 1e6);
+        }
+    }
+
+/*
+new line of a REWRITE / ROUTE in out
+    return false : bad (too long , '\n' inside) , counted
+*/
+static bool filter_take_out(chat_filter* f, chat_out* out, bool had_nl)
+    {
+    // one line , '\n' only at the end
+    size_t body = (out->len > 0 && out->buf[out->len - 1] == '\n') ? out->len - 1 : out->len;
+    if (!out->buf || out->len > out->cap || memchr(out->buf, '\n', body)) {
+        f->bad++;
+        return false;
+        }
+    if (had_nl && body == out->len) {
+        out->buf[out->len++] = '\n';
+        }
+    return true;
+    }
+
+/*
+run the chain over the line in fr (fr->data / fr->len are replaced by the result)
+    *pooled / *pooled_cap : rx_pool buffer which holds the result , NULL = result is the input view
+                            (caller gives it back with pool_put after delivery)
+    to                    : member name for CHAT_ROUTE (CHAT_ROUTE_NAME_MAX + 1 bytes)
+    return CHAT_PASS / CHAT_DROP / CHAT_ROUTE (a rewrite comes back as CHAT_PASS with the new line)
+*/
+int filter_run(filter_chain* fc, buf_pool* bp, chat_frame* fr, char** pooled, size_t* pooled_cap, char* to)
+    {
+    char* buf[2] = { NULL, NULL };
+    size_t cap[2] = { 0, 0 };
+    int cur = -1;              // buffer which holds fr->data , -1 = the read buffer
+    int verdict = CHAT_PASS;
+    bool had_nl = (fr->len > 0 && fr->data[fr->len - 1] == '\n');
+    for (int k = 0;k < fc->count && verdict == CHAT_PASS;k++) {
+        chat_filter* f = &fc->f[k];
+        if (f->off) {
+            continue;
+            }
+        // rewrite goes into the buffer which does not hold the current view
+        int nb = (cur == 0) ? 1 : 0;
+        if (!buf[nb]) {
+            buf[nb] = pool_get(bp, FILTER_OUT_MAX, &cap[nb]);
+            }
+        chat_out out = { .buf = buf[nb], .cap = buf[nb] ? cap[nb] - 1 : 0, .len = 0 };
+        long long t0 = filter_now_ns();
+        int v = f->ops->filter(f->state, fr, &out);
+        filter_account(f, filter_now_ns() - t0);
+        if (v == CHAT_DROP) {
+            f->drops++;
+            verdict = CHAT_DROP;
+            }
+        else if (v == CHAT_ROUTE && out.to[0] != '\0') {
+            f->routes++;
+            memcpy(to, out.to, CHAT_ROUTE_NAME_MAX + 1);
+            to[CHAT_ROUTE_NAME_MAX] = '\0';
+            verdict = CHAT_ROUTE;
+            // routed with a new text
+            if (out.len > 0 && filter_take_out(f, &out, had_nl)) {
+                fr->data = out.buf;
+                fr->len = out.len;
+                cur = nb;
+                }
+            }
+        else if (v == CHAT_REWRITE) {
+            if (!filter_take_out(f, &out, had_nl)) {
+                continue;
+                }
+            f->rewrites++;
+            fr->data = out.buf;
+            fr->len = out.len;
+            cur = nb;
+            }
+        else if (v != CHAT_PASS) {
+            f->bad++;
+            }
+        }
+    // the buffer of the result stays with the caller , the other one goes back
+    for (int b = 0;b < 2;b++) {
+        if (b != cur || verdict == CHAT_DROP) {
+            pool_put(bp, buf[b], cap[b]);
+            }
+        }
+    *pooled = (cur >= 0 && verdict != CHAT_DROP) ? buf[cur] : NULL;
+    *pooled_cap = (cur >= 0) ? cap[cur] : 0;
+    return verdict;
+    }
+
+void filter_report(filter_chain* fc)
+    {
+    for (int k = 0;k < fc->count;k++) {
+        chat_filter* f = &fc->f[k];
+        printf("[%sFilter%s] %d %s%s calls=%lu avg=%.2fus max=%.2fus over_budget=%lu drop=%lu rewrite=%lu route=%lu bad=%lu\n",
+            FG_BCYAN, RESET, k + 1, f->ops->name ? f->ops->name : f->path, f->off ? " [off]" : "", f->calls,
+            f->calls ? (double)f->ns / (double)f->calls / 1000.0 : 0.0, f->max_ns / 1000.0, f->over_budget,
+            f->drops, f->rewrites, f->routes, f->bad);
+        f->calls = f->drops = f->rewrites = f->routes = f->bad = f->over_budget = 0;
+        f->ns = f->max_ns = 0;
+        }
+    if (fc->route_miss) {
+        printf("[%sFilter%s] route to a name not online : %lu\n", FG_BCYAN, RESET, fc->route_miss);
+        fc->route_miss = 0;
+        }
+    }
+#endif
@@ -0,0 +1,42 @@
+#include <string.h>
+#include "../chat_filter.h"
+
+/*
+example filter : "@name text" goes only to member name (a direct msg) , as "(direct) text"
+    gcc -O2 -shared -fPIC filters/direct.c -o filters/direct.so
+    ./server <port> -M ./filters/direct.so
+every other line passes , the server drops a direct msg to a name which is not online
+*/
+static int direct_filter(void* state, const chat_frame* in, chat_out* out)
+    {
+    (void)state;
+    static const char tag[] = "(direct) ";
+    if (in->len < 3 || in->data[0] != '@') {
+        return CHAT_PASS;
+        }
+    const char* sp = memchr(in->data, ' ', in->len);
+    size_t name_len = sp ? (size_t)(sp - in->data) - 1 : 0;
+    if (name_len == 0 || name_len > CHAT_ROUTE_NAME_MAX) {
+        return CHAT_PASS;
+        }
+    memcpy(out->to, in->data + 1, name_len);
+    out->to[name_len] = '\0';
+    size_t text = in->len - name_len - 2;
+    if (sizeof(tag) - 1 + text <= out->cap) {
+        memcpy(out->buf, tag, sizeof(tag) - 1);
+        memcpy(out->buf + sizeof(tag) - 1, sp + 1, text);
+        out->len = sizeof(tag) - 1 + text;
+        }
+    return CHAT_ROUTE;
+    }
+
+static const chat_filter_ops ops = {
+    .abi = CHAT_FILTER_ABI,
+    .name = "direct",
+    .filter = direct_filter,
+    };
+
+const chat_filter_ops* chat_filter_entry(void)
+    {
+    return &ops;
+    }
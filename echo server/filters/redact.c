@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "../chat_filter.h"
+
+/*
+example filter : masks words (case does not matter) with '*'
+    gcc -O2 -shared -fPIC filters/redact.c -o filters/redact.so
+    ./server <port> -M ./filters/redact.so:secret,password
+a line without any of the words is passed on as it is (no copy) , only a hit writes the masked
+copy into the buffer of the server . a line which is nothing but masked words is dropped
+*/
+#define REDACT_WORDS 32
+
+typedef struct redact {
+    int count;
+    char* word[REDACT_WORDS];
+    size_t len[REDACT_WORDS];
+    char* list;    // arg copy , words point into it
+    }redact;
+
+static void* redact_init(const char* arg)
+    {
+    redact* r = calloc(1, sizeof(*r));
+    if (!r || !(r->list = strdup(arg))) {
+        free(r);
+        return NULL;
+        }
+    for (char* save = NULL, *w = strtok_r(r->list, ",", &save); w && r->count < REDACT_WORDS; w = strtok_r(NULL, ",", &save)) {
+        r->word[r->count] = w;
+        r->len[r->count++] = strlen(w);
+        }
+    return r;
+    }
+
+static void redact_fini(void* state)
+    {
+    redact* r = state;
+    free(r->list);
+    free(r);
+    }
+
+// word k starts at p (case does not matter)
+static size_t redact_hit(const redact* r, const char* p, size_t left)
+    {
+    for (int k = 0;k < r->count;k++) {
+        if (r->len[k] <= left && strncasecmp(p, r->word[k], r->len[k]) == 0) {
+            return r->len[k];
+            }
+        }
+    return 0;
+    }
+
+static int redact_filter(void* state, const chat_frame* in, chat_out* out)
+    {
+    const redact* r = state;
+    size_t i = 0, hit = 0;
+    // first hit , most lines end here
+    while (i < in->len && !(hit = redact_hit(r, in->data + i, in->len - i))) {
+        i++;
+        }
+    if (hit == 0) {
+        return CHAT_PASS;
+        }
+    if (in->len > out->cap) {
+        return CHAT_DROP;   // can not be masked , it must not go out as it is
+        }
+    memcpy(out->buf, in->data, in->len);
+    out->len = in->len;
+    size_t other = 0;   // visible chars which are not masked
+    for (size_t k = 0;k < i;k++) {
+        other += !isspace((unsigned char)in->data[k]);
+        }
+    while (i < in->len) {
+        hit = redact_hit(r, in->data + i, in->len - i);
+        if (hit) {
+            memset(out->buf + i, '*', hit);
+            i += hit;
+            continue;
+            }
+        other += !isspace((unsigned char)in->data[i]);
+        i++;
+        }
+    return other ? CHAT_REWRITE : CHAT_DROP;
+    }
+
+static const chat_filter_ops ops = {
+    .abi = CHAT_FILTER_ABI,
+    .name = "redact",
+    .init = redact_init,
+    .filter = redact_filter,
+    .fini = redact_fini,
+    };
+
+const chat_filter_ops* chat_filter_entry(void)
+    {
+    return &ops;
+    }
@@ -0,0 +1,188 @@
+#ifndef HANDSHAKE_H   // handshake codec , shared by server and client (no allocation)
+#define HANDSHAKE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+wire format :
+    client -> server : <name>!?!?<uuid>\n        (hello , the server also takes it without '\n' from
+                                                 old clients , after a short quiet wait)
+    server -> client : <server name>!?!?<digit>  (welcome , digit = display color 0..9)
+encode writes into a caller buffer , decode fills a fixed size struct ,
+every field is length checked , nothing is malloc'd and no strlen / strcat runs over the buffer
+*/
+#define HS_SEP      "!?!?"
+#define HS_SEP_LEN  4
+#define HS_NAME_MAX 63
+#define HS_UUID_MAX 63
+#define HS_MSG_MAX  (HS_NAME_MAX + HS_SEP_LEN + HS_UUID_MAX + 1)   // + the '\n' of the hello
+
+typedef struct hs_hello {
+    char name[HS_NAME_MAX + 1];
+    char uuid[HS_UUID_MAX + 1];
+    uint8_t name_len;
+    uint8_t uuid_len;
+    }hs_hello;
+
+typedef struct hs_welcome {
+    char server[HS_NAME_MAX + 1];
+    uint8_t server_len;
+    int color;
+    }hs_welcome;
+
+// first separator in buf[0..n) , -1 = none
+static inline long hs_find_sep(const char* buf, size_t n)
+    {
+    for (size_t k = 0;k + HS_SEP_LEN <= n;k++) {
+        const char* p = memchr(buf + k, '!', n - k - (HS_SEP_LEN - 1));
+        if (!p) {
+            return -1;
+            }
+        k = (size_t)(p - buf);
+        if (memcmp(p, HS_SEP, HS_SEP_LEN) == 0) {
+            return (long)k;
+            }
+        }
+    return -1;
+    }
+
+// char classes : 1 = allowed in a name (printable , utf-8 bytes) , 2 = allowed in a uuid
+#define HS_NAME_CH 1
+#define HS_UUID_CH 2
+// ranges do not overlap (no -Woverride-init) , printable 32 .. 126 in ascii order
+static const uint8_t hs_char_class[256] = {
+    [' ' ... ','] = HS_NAME_CH,
+    ['-'] = HS_NAME_CH | HS_UUID_CH,
+    ['.' ... '/'] = HS_NAME_CH,
+    ['0' ... '9'] = HS_NAME_CH | HS_UUID_CH,
+    [':' ... '@'] = HS_NAME_CH,
+    ['A' ... 'Z'] = HS_NAME_CH | HS_UUID_CH,
+    ['[' ... '`'] = HS_NAME_CH,
+    ['a' ... 'z'] = HS_NAME_CH | HS_UUID_CH,
+    ['{' ... '~'] = HS_NAME_CH,
+    [128 ... 255] = HS_NAME_CH,
+    };
+
+// every byte of s[0..n) has class bit cls (one table lookup per byte , no early exit branch)
+static inline bool hs_chars_ok(const char* s, size_t n, uint8_t cls)
+    {
+    uint8_t all = cls;
+    for (size_t k = 0;k < n;k++) {
+        all &= hs_char_class[(unsigned char)s[k]];
+        }
+    return all == cls;
+    }
+
+// name can be any printable text without the separator
+static inline bool hs_name_ok(const char* s, size_t n)
+    {
+    return n > 0 && n <= HS_NAME_MAX && hs_chars_ok(s, n, HS_NAME_CH) && hs_find_sep(s, n) < 0;
+    }
+
+// uuid becomes a directory name on the server : only [0-9a-zA-Z-]
+static inline bool hs_uuid_ok(const char* s, size_t n)
+    {
+    return n > 0 && n <= HS_UUID_MAX && hs_chars_ok(s, n, HS_UUID_CH);
+    }
+
+// a | SEP | b into out , return length or -1
+static inline int hs_join(char* out, size_t cap, const char* a, size_t a_len, const char* b, size_t b_len)
+    {
+    size_t total = a_len + HS_SEP_LEN + b_len;
+    if (total + 1 > cap) {
+        return -1;
+        }
+    memcpy(out, a, a_len);
+    memcpy(out + a_len, HS_SEP, HS_SEP_LEN);
+    memcpy(out + a_len + HS_SEP_LEN, b, b_len);
+    out[total] = '\0';
+    return (int)total;
+    }
+
+/*
+Meanings of return in hs_encode_* :
+    return -1 : Error [field too long / not allowed chars / out too small]
+    return n  : bytes written to out (also '\0' terminated)
+*/
+int hs_encode_hello(char* out, size_t cap, const char* name, size_t name_len, const char* uuid, size_t uuid_len)
+    {
+    if (!hs_name_ok(name, name_len) || !hs_uuid_ok(uuid, uuid_len)) {
+        return -1;
+        }
+    int len = hs_join(out, cap, name, name_len, uuid, uuid_len);
+    if (len < 0 || (size_t)len + 2 > cap) {
+        return -1;
+        }
+    // end of the hello , the server does not have to guess if more is coming
+    out[len++] = '\n';
+    out[len] = '\0';
+    return len;
+    }
+
+// server name is checked once with hs_name_ok() at startup , here only its length
+int hs_encode_welcome(char* out, size_t cap, const char* server, size_t server_len, int color)
+    {
+    if (server_len == 0 || server_len > HS_NAME_MAX || color < 0 || color > 9) {
+        return -1;
+        }
+    char digit = (char)('0' + color);
+    return hs_join(out, cap, server, server_len, &digit, 1);
+    }
+
+// trailing "\r\n" / spaces of a field (old clients sent the name with fgets newline)
+static inline size_t hs_trim(const char* s, size_t n)
+    {
+    while (n > 0 && (s[n - 1] == '\n' || s[n - 1] == '\r' || s[n - 1] == ' ')) {
+        n--;
+        }
+    return n;
+    }
+
+/*
+Meanings of return in hs_decode_* :
+    return -1 : Error [no separator / bad field]
+    return 0  : Success
+*/
+int hs_decode_hello(const char* buf, size_t n, hs_hello* out)
+    {
+    long sep = hs_find_sep(buf, n);
+    if (sep < 0) {
+        return -1;
+        }
+    size_t name_len = hs_trim(buf, (size_t)sep);
+    const char* uuid = buf + sep + HS_SEP_LEN;
+    size_t uuid_len = hs_trim(uuid, n - (size_t)sep - HS_SEP_LEN);
+    // name is in front of the first separator , so only its chars need a check
+    if (name_len == 0 || name_len > HS_NAME_MAX || !hs_chars_ok(buf, name_len, HS_NAME_CH) || !hs_uuid_ok(uuid, uuid_len)) {
+        return -1;
+        }
+    memcpy(out->name, buf, name_len);
+    out->name[name_len] = '\0';
+    out->name_len = (uint8_t)name_len;
+    memcpy(out->uuid, uuid, uuid_len);
+    out->uuid[uuid_len] = '\0';
+    out->uuid_len = (uint8_t)uuid_len;
+    return 0;
+    }
+
+int hs_decode_welcome(const char* buf, size_t n, hs_welcome* out)
+    {
+    long sep = hs_find_sep(buf, n);
+    if (sep < 0 || (size_t)sep + HS_SEP_LEN >= n) {
+        return -1;
+        }
+    size_t len = (size_t)sep;
+    if (len == 0 || len > HS_NAME_MAX) {
+        return -1;
+        }
+    char digit = buf[sep + HS_SEP_LEN];
+    memcpy(out->server, buf, len);
+    out->server[len] = '\0';
+    out->server_len = (uint8_t)len;
+    // unknown code -> default color (same as before)
+    out->color = (digit >= '0' && digit <= '9') ? digit - '0' : -1;
+    return 0;
+    }
+#endif
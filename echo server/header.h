@@ -1,5 +1,5 @@
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE   // splice , sendfile , pipe2 (includes POSIX 2008)
 #include <sys/stat.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -13,7 +13,10 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <time.h>
+#include <signal.h>
 #include <stdbool.h>
+#include "scan.h"
+#include "handshake.h"
 
 // Style macros
 #define RESET       "\033[0m"
@@ -107,9 +110,10 @@ int create_directory(const char* path,int debug)
         }
     }
 
+// fixed size fields , filled by hs_decode_hello() (no strdup per connection)
 typedef struct client_info {
-    char* cli_name;
-    char* cli_uuid;
+    char cli_name[HS_NAME_MAX + 1];
+    char cli_uuid[HS_UUID_MAX + 1];
     int cli_id;
     }client_info;
 
@@ -119,56 +123,17 @@ int random_int()
     return (int)(rand() % 7);
     }
 
-bool combine_msg(char* msg, char* new_msg)
-    {
-    // sequence : 1.server name is already present in msg
-    // 2.MSG_SEPERATE + (assume other msg) clolor_code
-   
-    int size_dest = strlen(msg), size_src = strlen(new_msg);
-
-    if (size_dest + size_src + 1 < META_BUFFER_SIZE) {
-        strcat(msg, MSG_SEPRATE);
-        strcat(msg, new_msg);
-        printf("%s\n", msg);
-
-        return true;
-        }
-    //Final sequence : server name + MSG_SEPERATE + color_code 
-    return false;
-    }
-
-// break meta_data_msg into particular sub_msg
-
-bool break_meta_d(client_info** cli__, char* buffer)
-    {
-    char* ptr;
-    short int size;
-    if ((ptr = strstr(buffer, MSG_SEPRATE)) != NULL) {
-        size = ptr - buffer;
-        // 1.name filling
-        (*cli__)->cli_name = strndup(buffer, size);
-        ptr = ptr + MSG_SEP_LEN;
-        // 2. color_code filling
-        (*cli__)->cli_uuid = strdup(ptr);
-        return true;
-        }
-    return false;
-    }
-
-// refresh the buffer [erase info except server name]
-void meta_buffer_refresh(char* buffer, int len)
-    {
-    buffer[len] = '\0';
-    }
-
 // free the client info when client disconnects
 void close_client(void* cli_,int fd, int debug)
     {
     client_info* clinet = (client_info*)cli_;
     close(fd);
-    free(clinet->cli_name);
-    free(clinet->cli_uuid);
-    free(clinet);
-    (debug == 3) ? puts("freed clinet info ") : (puts(""));
+    // client rejected before the meta data exchange
+    if (!clinet) {
+        return;
+        }
+    // slot storage , only cleared
+    memset(clinet, 0, sizeof(*clinet));
+    (debug == 3) ? puts("cleared clinet info ") : (puts(""));
     }
 
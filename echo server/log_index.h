@@ -0,0 +1,393 @@
+#ifndef LOG_INDEX_H   // index over stored transcripts (client_files/<uuid>/...)
+#define LOG_INDEX_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+files of one uuid (next to the <ip>/cli_N.txt folders) :
+
+1. client_files/<uuid>/msg.idx   -> time index , one fixed size log_record per message ,
+                                    appended in time order so it is sorted by ts_us .
+                                    record number (position in this file) is the message id
+2. client_files/<uuid>/terms_<first rec>.idx -> inverted index segment of up to LOG_SEG_MSGS msgs
+        log_seg_header
+        log_term_entry[n_terms]   sorted by term hash (binary search)
+        postings                  per term : varint of (rec - previous rec) , ascending
+
+the server builds both while it writes the logs (log_index_add) , the query tool
+(tools/log_query.c) mmaps them . term = lower case run of [a-z0-9] , 2..LOG_TERM_MAX chars ,
+stored as 64 bit FNV-1a hash (a hash collision is removed by checking the text itself)
+*/
+#define LOG_INDEX_FILE   "msg.idx"
+#define LOG_SEG_MAGIC    0x31584954u   // "TIX1"
+#define LOG_SEG_MSGS     4096          // msgs per terms segment
+#define LOG_TERM_MIN     2
+#define LOG_TERM_MAX     32
+#define LOG_PENDING_MAX  64            // time records buffered before one write()
+#define LOG_OPEN_MAX     1024          // uuids with an open writer (at most one per connection)
+
+typedef struct log_record {
+    int64_t ts_us;       // wall clock , micro seconds
+    uint32_t ip;         // network order , log is <uuid>/<ip>/cli_<file_no>.txt
+    uint32_t file_no;
+    uint64_t offset;     // byte offset of msg in that log file
+    uint32_t len;
+    uint32_t reserved;
+    }log_record;
+
+typedef struct log_seg_header {
+    uint32_t magic;
+    uint32_t n_terms;
+    uint64_t first_rec;
+    uint64_t last_rec;
+    uint64_t postings_len;
+    }log_seg_header;
+
+typedef struct log_term_entry {
+    uint64_t hash;
+    uint32_t off;        // from start of postings
+    uint32_t len;        // bytes of encoded postings
+    }log_term_entry;
+
+// postings of one term inside the segment being built (in memory)
+typedef struct log_posting {
+    uint64_t hash;
+    uint8_t* data;       // varint deltas
+    uint32_t len;
+    uint32_t cap;
+    uint64_t last_rec;
+    }log_posting;
+
+typedef struct log_index {
+    char uuid[40];
+    char dir[128];
+    int refs;
+    int idx_fd;
+    uint64_t n_recs;     // records in msg.idx (incl. pending)
+    int64_t last_ts;
+    log_record pending[LOG_PENDING_MAX];
+    int n_pending;
+    // terms segment being built
+    uint64_t seg_first;
+    uint32_t seg_msgs;
+    log_posting* terms;  // open addressing table
+    uint32_t terms_cap;
+    uint32_t terms_used;
+    }log_index;
+
+log_index* log_open_table[LOG_OPEN_MAX];
+
+uint64_t log_term_hash(const char* s, size_t n)
+    {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t k = 0;k < n;k++) {
+        h ^= (unsigned char)s[k];
+        h *= 1099511628211ULL;
+        }
+    return h ? h : 1;   // 0 marks an empty slot
+    }
+
+// varint : 7 bits per byte , high bit = more bytes follow
+size_t log_varint_put(uint8_t* out, uint64_t v)
+    {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+        }
+    out[n++] = (uint8_t)v;
+    return n;
+    }
+
+size_t log_varint_get(const uint8_t* in, size_t avail, uint64_t* v)
+    {
+    uint64_t r = 0;
+    size_t n = 0;
+    int shift = 0;
+    while (n < avail && shift < 64) {
+        uint8_t b = in[n++];
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return n;
+            }
+        shift += 7;
+        }
+    return 0;   // truncated
+    }
+
+/*
+split text into terms , calls fn(hash) for every term
+(same rules are used by the writer and the query tool)
+*/
+void log_terms(const char* text, size_t n, void (*fn)(void*, uint64_t), void* arg)
+    {
+    char term[LOG_TERM_MAX];
+    size_t t = 0;
+    bool too_long = false;
+    for (size_t k = 0;k <= n;k++) {
+        unsigned char c = (k < n) ? (unsigned char)text[k] : ' ';
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z')) {
+            if (t < LOG_TERM_MAX) {
+                term[t++] = (char)((c >= 'A' && c <= 'Z') ? c + 32 : c);
+                }
+            else {
+                too_long = true;
+                }
+            continue;
+            }
+        if (t >= LOG_TERM_MIN && !too_long) {
+            fn(arg, log_term_hash(term, t));
+            }
+        t = 0;
+        too_long = false;
+        }
+    }
+
+// ------------------------------- writer side -------------------------------
+
+static log_posting* log_posting_slot(log_index* li, uint64_t hash)
+    {
+    if (li->terms_used * 2 >= li->terms_cap) {
+        // grow the table (x2) and re insert
+        uint32_t old_cap = li->terms_cap;
+        log_posting* old = li->terms;
+        uint32_t cap = old_cap ? old_cap * 2 : 1024;
+        log_posting* t = (log_posting*)calloc(cap, sizeof(log_posting));
+        if (!t) {
+            return NULL;
+            }
+        for (uint32_t k = 0;k < old_cap;k++) {
+            if (old[k].hash) {
+                uint32_t pos = (uint32_t)old[k].hash & (cap - 1);
+                while (t[pos].hash) {
+                    pos = (pos + 1) & (cap - 1);
+                    }
+                t[pos] = old[k];
+                }
+            }
+        free(old);
+        li->terms = t;
+        li->terms_cap = cap;
+        }
+    uint32_t pos = (uint32_t)hash & (li->terms_cap - 1);
+    while (li->terms[pos].hash && li->terms[pos].hash != hash) {
+        pos = (pos + 1) & (li->terms_cap - 1);
+        }
+    if (!li->terms[pos].hash) {
+        li->terms[pos].hash = hash;
+        li->terms_used++;
+        }
+    return &li->terms[pos];
+    }
+
+static void log_add_term(void* arg, uint64_t hash)
+    {
+    log_index* li = (log_index*)arg;
+    uint64_t rec = li->n_recs - 1;
+    log_posting* p = log_posting_slot(li, hash);
+    if (!p) {
+        return;
+        }
+    // same term twice in one msg
+    if (p->len > 0 && p->last_rec == rec) {
+        return;
+        }
+    if (p->len + 10 > p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 16;
+        uint8_t* d = (uint8_t*)realloc(p->data, cap);
+        if (!d) {
+            return;
+            }
+        p->data = d;
+        p->cap = cap;
+        }
+    uint64_t delta = (p->len == 0) ? rec - li->seg_first : rec - p->last_rec;
+    p->len += (uint32_t)log_varint_put(p->data + p->len, delta);
+    p->last_rec = rec;
+    }
+
+static int log_cmp_term(const void* a, const void* b)
+    {
+    uint64_t x = ((const log_term_entry*)a)->hash, y = ((const log_term_entry*)b)->hash;
+    return (x > y) - (x < y);
+    }
+
+// write pending time records (one write() for many msgs)
+void log_index_flush(log_index* li)
+    {
+    if (li->n_pending == 0) {
+        return;
+        }
+    size_t bytes = sizeof(log_record) * (size_t)li->n_pending;
+    if (write(li->idx_fd, li->pending, bytes) != (ssize_t)bytes) {
+        fprintf(stderr, "[Error] | index write %s : %s\n", li->dir, strerror(errno));
+        }
+    li->n_pending = 0;
+    }
+
+/*
+write the in memory postings as terms_<first rec>.idx (tmp file + rename , so a reader
+never sees half a segment) and start a new segment
+*/
+void log_segment_write(log_index* li)
+    {
+    if (li->seg_msgs == 0) {
+        return;
+        }
+    log_index_flush(li);
+    log_term_entry* ents = (log_term_entry*)malloc(sizeof(log_term_entry) * (li->terms_used + 1));
+    log_seg_header h = { LOG_SEG_MAGIC, 0, li->seg_first, li->n_recs - 1, 0 };
+    if (ents) {
+        for (uint32_t k = 0;k < li->terms_cap;k++) {
+            if (li->terms[k].hash) {
+                ents[h.n_terms].hash = li->terms[k].hash;
+                ents[h.n_terms].len = li->terms[k].len;
+                h.n_terms++;
+                }
+            }
+        qsort(ents, h.n_terms, sizeof(log_term_entry), log_cmp_term);
+        for (uint32_t e = 0;e < h.n_terms;e++) {
+            ents[e].off = (uint32_t)h.postings_len;
+            h.postings_len += ents[e].len;
+            }
+        char tmp[192], path[192];
+        snprintf(tmp, sizeof(tmp), "%s/terms.tmp", li->dir);
+        snprintf(path, sizeof(path), "%s/terms_%llu.idx", li->dir, (unsigned long long)li->seg_first);
+        FILE* f = fopen(tmp, "wb");
+        if (f) {
+            fwrite(&h, sizeof(h), 1, f);
+            fwrite(ents, sizeof(log_term_entry), h.n_terms, f);
+            // postings in the same (sorted) order as the table entries
+            for (uint32_t e = 0;e < h.n_terms;e++) {
+                log_posting* p = log_posting_slot(li, ents[e].hash);
+                fwrite(p->data, 1, p->len, f);
+                }
+            fclose(f);
+            rename(tmp, path);
+            }
+        free(ents);
+        }
+    for (uint32_t k = 0;k < li->terms_cap;k++) {
+        free(li->terms[k].data);
+        }
+    free(li->terms);
+    li->terms = NULL;
+    li->terms_cap = li->terms_used = 0;
+    li->seg_first = li->n_recs;
+    li->seg_msgs = 0;
+    }
+
+/*
+open (or share) the index writer of a uuid
+    dir : client_files/<uuid>
+    return NULL : Error
+*/
+log_index* log_index_open(const char* dir, const char* uuid)
+    {
+    int free_slot = -1;
+    for (int k = 0;k < LOG_OPEN_MAX;k++) {
+        if (log_open_table[k] && strcmp(log_open_table[k]->uuid, uuid) == 0) {
+            log_open_table[k]->refs++;
+            return log_open_table[k];
+            }
+        if (!log_open_table[k] && free_slot == -1) {
+            free_slot = k;
+            }
+        }
+    if (free_slot == -1) {
+        return NULL;
+        }
+    log_index* li = (log_index*)calloc(1, sizeof(log_index));
+    if (!li) {
+        return NULL;
+        }
+    snprintf(li->uuid, sizeof(li->uuid), "%s", uuid);
+    snprintf(li->dir, sizeof(li->dir), "%s", dir);
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", dir, LOG_INDEX_FILE);
+    li->idx_fd = open(path, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
+    if (li->idx_fd < 0) {
+        free(li);
+        return NULL;
+        }
+    struct stat st;
+    fstat(li->idx_fd, &st);
+    // drop a torn last record (server crash in the middle of a write)
+    if (st.st_size % sizeof(log_record)) {
+        if (ftruncate(li->idx_fd, st.st_size - st.st_size % (off_t)sizeof(log_record)) < 0) {
+            perror("index truncate");
+            }
+        }
+    li->n_recs = (uint64_t)st.st_size / sizeof(log_record);
+    li->seg_first = li->n_recs;
+    li->refs = 1;
+    log_open_table[free_slot] = li;
+    return li;
+    }
+
+// index one stored msg
+void log_index_add(log_index* li, uint32_t ip, uint32_t file_no, uint64_t offset, const char* text, size_t len)
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    // keep msg.idx sorted even if wall clock steps back
+    if (now < li->last_ts) {
+        now = li->last_ts;
+        }
+    li->last_ts = now;
+    log_record* r = &li->pending[li->n_pending++];
+    r->ts_us = now;
+    r->ip = ip;
+    r->file_no = file_no;
+    r->offset = offset;
+    r->len = (uint32_t)len;
+    r->reserved = 0;
+    li->n_recs++;
+    log_terms(text, len, log_add_term, li);
+    li->seg_msgs++;
+    if (li->n_pending == LOG_PENDING_MAX) {
+        log_index_flush(li);
+        }
+    if (li->seg_msgs >= LOG_SEG_MSGS) {
+        log_segment_write(li);
+        }
+    }
+
+// called at the end of a loop tick
+void log_index_flush_all()
+    {
+    for (int k = 0;k < LOG_OPEN_MAX;k++) {
+        if (log_open_table[k]) {
+            log_index_flush(log_open_table[k]);
+            }
+        }
+    }
+
+// client disconnected , last user of the uuid writes the segment and frees the writer
+void log_index_close(log_index* li)
+    {
+    if (!li || --li->refs > 0) {
+        return;
+        }
+    log_segment_write(li);
+    log_index_flush(li);
+    close(li->idx_fd);
+    for (int k = 0;k < LOG_OPEN_MAX;k++) {
+        if (log_open_table[k] == li) {
+            log_open_table[k] = NULL;
+            }
+        }
+    free(li);
+    }
+#endif
@@ -0,0 +1,289 @@
+#ifndef LOOP_PROF_H   // event loop profiler : phase histograms , slow tick log , folded stack samples
+#define LOOP_PROF_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+/*
+every loop tick is cut into phases (select wait , accept , reads , fan out , flush , disk ...) :
+    prof_enter(phase , fd) ... prof_leave()   (can nest , up to PROF_DEPTH)
+    1. every phase span goes into a log2 histogram of micro seconds (count , p50 / p99 , max)
+    2. a tick whose busy time (without the select wait) is over prof.slow_us is logged with its
+       phase times and the single longest span (phase + fd) , that is the handler which stalled it
+    3. optional (-F <file>) : SIGPROF every PROF_SAMPLE_US of cpu time counts the current phase
+       stack , the file gets one "loop;accept;handshake <samples>" line per stack (flamegraph.pl input)
+phase stack lives in one integer (4 bits per level) , so the signal handler only reads a word
+and bumps a counter in a fixed table (no malloc , no locks)
+*/
+#define PROF_BUCKETS   24      // [0,1) [1,2) [2,4) ... us , last one = everything above
+#define PROF_DEPTH     6
+#define PROF_STACKS    256     // distinct stacks kept for the folded export (power of 2)
+#define PROF_SAMPLE_US 997     // sample period (prime , does not beat with the 1 ms timers)
+#define PROF_SLOW_US   20000   // default slow tick threshold (-P <ms>)
+
+enum prof_phase {
+    PH_LOOP = 0,
+    PH_WAIT,        // select() / low latency spin
+    PH_ACCEPT,      // accept4 drain
+    PH_HANDSHAKE,   // handshake coroutine (transcript files are opened here)
+    PH_READ,        // read() of one client
+    PH_FANOUT,      // parse + queue for every recipient + transcript fwrite
+    PH_FILTER,      // msg filter chain (-M) , inside fanout
+    PH_UPLOAD,      // blob upload splice
+    PH_TIMERS,      // coroutine timers , heartbeat , roster deltas , acks , socket tuning
+    PH_FLUSH,       // sendmsg of dirty connections
+    PH_BLOB,        // blob chunks (sendfile)
+    PH_DISK,        // fflush of transcripts + index flush
+    PH_REPORT,      // stats to stdout
+    PH_COUNT
+    };
+
+static const char* const prof_names[PH_COUNT] = {
+    "loop", "wait", "accept", "handshake", "read", "fanout", "filter", "upload", "timers", "flush", "blob", "disk", "report"
+    };
+
+typedef struct prof_hist {
+    unsigned long count;
+    unsigned long bucket[PROF_BUCKETS];
+    long long sum_us;
+    long long max_us;
+    }prof_hist;
+
+typedef struct loop_prof {
+    long long slow_us;
+    prof_hist hist[PH_COUNT];
+    // current tick
+    long long tick_t0;
+    long long tick_us[PH_COUNT];     // self time per phase (nested spans count in the inner phase)
+    int worst_phase;
+    int worst_fd;
+    long long worst_us;
+    // nesting
+    int depth;
+    int st_phase[PROF_DEPTH];
+    int st_fd[PROF_DEPTH];
+    long long st_t0[PROF_DEPTH];
+    long long st_child[PROF_DEPTH];  // time of nested spans
+    volatile uint32_t stack_key;     // read by the SIGPROF handler
+    // totals since last report
+    unsigned long ticks;
+    unsigned long slow_ticks;
+    long long busy_max_us;
+    // sampling
+    const char* fold_path;
+    uint32_t sample_key[PROF_STACKS];
+    volatile unsigned long sample_count[PROF_STACKS];
+    volatile unsigned long samples_lost;
+    }loop_prof;
+
+loop_prof prof = { .slow_us = PROF_SLOW_US };
+
+static long long prof_now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+static void prof_hist_add(prof_hist* h, long long us)
+    {
+    int b = 0;
+    while (b < PROF_BUCKETS - 1 && (1LL << b) <= us) {
+        b++;
+        }
+    h->bucket[b]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) {
+        h->max_us = us;
+        }
+    }
+
+// upper bound (us) of the bucket which holds the q quantile
+static long long prof_hist_quantile(const prof_hist* h, double q)
+    {
+    unsigned long want = (unsigned long)(q * (double)h->count);
+    unsigned long seen = 0;
+    for (int b = 0;b < PROF_BUCKETS;b++) {
+        seen += h->bucket[b];
+        if (seen > want) {
+            return (b == PROF_BUCKETS - 1 || (1LL << b) > h->max_us) ? h->max_us : (1LL << b);
+            }
+        }
+    return h->max_us;
+    }
+
+void prof_enter(int phase, int fd)
+    {
+    if (prof.depth >= PROF_DEPTH) {
+        return;
+        }
+    int d = prof.depth++;
+    prof.st_phase[d] = phase;
+    prof.st_fd[d] = fd;
+    prof.st_t0[d] = prof_now_us();
+    prof.st_child[d] = 0;
+    prof.stack_key = (prof.stack_key << 4) | (uint32_t)phase;
+    }
+
+void prof_leave()
+    {
+    if (prof.depth == 0) {
+        return;
+        }
+    int d = --prof.depth;
+    int phase = prof.st_phase[d];
+    long long us = prof_now_us() - prof.st_t0[d];
+    long long self = us - prof.st_child[d];
+    prof.stack_key >>= 4;
+    if (d > 0) {
+        prof.st_child[d - 1] += us;
+        }
+    prof_hist_add(&prof.hist[phase], us);
+    prof.tick_us[phase] += self;
+    // the wait is not a handler , it never makes a tick slow
+    if (phase != PH_WAIT && self > prof.worst_us) {
+        prof.worst_us = self;
+        prof.worst_phase = phase;
+        prof.worst_fd = prof.st_fd[d];
+        }
+    }
+
+// SIGPROF : count the phase stack which is running now
+static void prof_sample(int sig)
+    {
+    (void)sig;
+    uint32_t key = prof.stack_key;
+    uint32_t h = (key * 2654435761u) & (PROF_STACKS - 1);
+    for (int probe = 0;probe < PROF_STACKS;probe++) {
+        uint32_t k = (h + (uint32_t)probe) & (PROF_STACKS - 1);
+        if (prof.sample_count[k] == 0) {
+            prof.sample_key[k] = key;
+            }
+        if (prof.sample_key[k] == key) {
+            prof.sample_count[k]++;
+            return;
+            }
+        }
+    prof.samples_lost++;
+    }
+
+/*
+turn on the folded stack export (-F <path>)
+    return -1 : Error [timer / signal]
+*/
+int prof_sampling_start(const char* path)
+    {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = prof_sample;
+    // restart read / write / accept , a sample must not turn into EINTR in the middle of stdio
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) < 0) {
+        perror("sigaction");
+        return -1;
+        }
+    struct itimerval it = { { 0, PROF_SAMPLE_US }, { 0, PROF_SAMPLE_US } };
+    if (setitimer(ITIMER_PROF, &it, NULL) < 0) {
+        perror("setitimer");
+        return -1;
+        }
+    prof.fold_path = path;
+    printf("%sProfiler : sampling every %d us of cpu , folded stacks -> %s%s\n", FG_BGREEN, PROF_SAMPLE_US, path, RESET);
+    return 0;
+    }
+
+/*
+end of one loop tick (called at the top of the next one) , logs it when it was slow
+*/
+void prof_tick()
+    {
+    long long now = prof_now_us();
+    if (prof.tick_t0 != 0) {
+        long long busy = now - prof.tick_t0 - prof.tick_us[PH_WAIT];
+        prof_hist_add(&prof.hist[PH_LOOP], busy);
+        prof.ticks++;
+        if (busy > prof.busy_max_us) {
+            prof.busy_max_us = busy;
+            }
+        if (busy > prof.slow_us) {
+            prof.slow_ticks++;
+            char parts[512];
+            size_t len = 0;
+            for (int p = PH_ACCEPT;p < PH_COUNT;p++) {
+                // phases under 0.05 ms are noise in this line
+                if (prof.tick_us[p] >= 50 && len < sizeof(parts)) {
+                    len += (size_t)snprintf(parts + len, sizeof(parts) - len, " %s=%.1f", prof_names[p], prof.tick_us[p] / 1000.0);
+                    }
+                }
+            fprintf(stderr, "[%sSlow%s] tick busy %.1f ms (limit %.1f) : longest %s %.1f ms [fd=%d] |%s\n",
+                FG_YELLOW, RESET, busy / 1000.0, prof.slow_us / 1000.0, prof_names[prof.worst_phase],
+                prof.worst_us / 1000.0, prof.worst_fd, len ? parts : "");
+            }
+        }
+    memset(prof.tick_us, 0, sizeof(prof.tick_us));
+    prof.worst_us = 0;
+    prof.worst_phase = PH_LOOP;
+    prof.worst_fd = -1;
+    prof.tick_t0 = now;
+    }
+
+// folded stacks , one line per stack : "loop;fanout 42" (cumulative , file is rewritten)
+static void prof_write_folded()
+    {
+    if (!prof.fold_path) {
+        return;
+        }
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", prof.fold_path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "[%sError%s] | Profiler export %s : %s\n", FG_RED, RESET, tmp, strerror(errno));
+        return;
+        }
+    for (int k = 0;k < PROF_STACKS;k++) {
+        unsigned long n = prof.sample_count[k];
+        if (n == 0) {
+            continue;
+            }
+        // key holds the innermost phase in the low 4 bits , print from the outermost
+        int frames[8];
+        int depth = 0;
+        for (uint32_t key = prof.sample_key[k];key != 0 && depth < 8;key >>= 4) {
+            frames[depth++] = (int)(key & 15);
+            }
+        fputs("loop", f);
+        for (int d = depth - 1;d >= 0;d--) {
+            fprintf(f, ";%s", prof_names[frames[d]]);
+            }
+        fprintf(f, " %lu\n", n);
+        }
+    fclose(f);
+    rename(tmp, prof.fold_path);
+    }
+
+void prof_report()
+    {
+    printf("[%sProf%s] ticks=%lu slow=%lu (> %.1f ms) busy_max=%.1f ms\n", FG_BCYAN, RESET,
+        prof.ticks, prof.slow_ticks, prof.slow_us / 1000.0, prof.busy_max_us / 1000.0);
+    for (int p = 0;p < PH_COUNT;p++) {
+        prof_hist* h = &prof.hist[p];
+        if (h->count == 0) {
+            continue;
+            }
+        printf("[%sProf%s]   %-9s n=%-8lu avg=%6.1fus p50<=%lldus p99<=%lldus max=%lldus\n", FG_BCYAN, RESET,
+            (p == PH_LOOP) ? "tick" : prof_names[p], h->count, (double)h->sum_us / (double)h->count,
+            prof_hist_quantile(h, 0.50), prof_hist_quantile(h, 0.99), h->max_us);
+        }
+    memset(prof.hist, 0, sizeof(prof.hist));
+    prof.ticks = prof.slow_ticks = 0;
+    prof.busy_max_us = 0;
+    prof_write_folded();
+    }
+#endif
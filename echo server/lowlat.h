@@ -0,0 +1,139 @@
+#ifndef LOWLAT_H   // opt-in low latency mode (server <port> -L <cpu>)
+#define LOWLAT_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+/*
+the server has one reactor (the main thread) , in low latency mode :
+    1. the reactor is pinned to one cpu , so its cache stays warm and the scheduler never moves it
+    2. memory policy of the thread is MPOL_LOCAL , every page touched later (slot arrays , pool
+       buffers , out buffers) comes from the NUMA node of that cpu . it is set before the slot
+       arrays are initialised so their first touch is on the right node too
+    3. sockets get SO_BUSY_POLL / SO_PREFER_BUSY_POLL , a read on an empty socket polls the
+       device queue for a few micro seconds instead of waiting for the interrupt
+    4. before select() sleeps the loop polls with a zero timeout for LOWLAT_SPIN_US ,
+       a msg which arrives in that window is handled without a wakeup
+cost : one cpu at 100% while traffic is flowing , so it is off by default
+*/
+#define LOWLAT_SPIN_US      50    // spin before sleeping in select()
+#define LOWLAT_BUSY_POLL_US 50    // SO_BUSY_POLL value
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+
+typedef struct lowlat_state {
+    bool enabled;
+    int cpu;
+    bool busy_poll_ok;          // false after the first EPERM (needs CAP_NET_ADMIN above net.core.busy_read)
+    unsigned long spin_wakeups; // ticks served by the spin
+    unsigned long sleep_wakeups;
+    }lowlat_state;
+
+lowlat_state lowlat = { .enabled = false, .cpu = -1, .busy_poll_ok = true };
+
+static inline void lowlat_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    }
+
+static long long lowlat_now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+/*
+pin the calling thread to cpu and make its memory node local
+    return -1 : Error [bad cpu]
+*/
+int lowlat_init(int cpu)
+    {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        fprintf(stderr, "[%sError%s] | Pin to cpu %d : %s\n", FG_RED, RESET, cpu, strerror(errno));
+        return -1;
+        }
+    // no libnuma needed , set_mempolicy is a plain syscall
+    if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) < 0) {
+        fprintf(stderr, "[%sWarning%s] | set_mempolicy(MPOL_LOCAL) : %s\n", FG_YELLOW, RESET, strerror(errno));
+        }
+    lowlat.enabled = true;
+    lowlat.cpu = cpu;
+    printf("%sLow latency mode : cpu %d , spin %d us , busy poll %d us%s\n", FG_BGREEN, cpu, LOWLAT_SPIN_US, LOWLAT_BUSY_POLL_US, RESET);
+    return 0;
+    }
+
+// busy poll options of one socket (listener and every client)
+void lowlat_socket(int fd)
+    {
+    if (!lowlat.enabled || !lowlat.busy_poll_ok) {
+        return;
+        }
+    int us = LOWLAT_BUSY_POLL_US, one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0) {
+        fprintf(stderr, "[%sWarning%s] | SO_BUSY_POLL : %s (spin and pinning stay on)\n", FG_YELLOW, RESET, strerror(errno));
+        lowlat.busy_poll_ok = false;
+        return;
+        }
+    // older kernels do not have it , busy poll still works without
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+    }
+
+/*
+poll the fd sets without sleeping for up to LOWLAT_SPIN_US
+    return 0  : nothing ready , caller sleeps in select()
+    return n  : ready count , sets hold the result like after select()
+    return -1 : Error (errno from select)
+*/
+int lowlat_spin(int nfds, fd_set* rfds, fd_set* wfds)
+    {
+    long long end = lowlat_now_us() + LOWLAT_SPIN_US;
+    do {
+        fd_set r = *rfds, w = *wfds;
+        struct timeval zero = { 0, 0 };
+        int n = select(nfds, &r, &w, NULL, &zero);
+        if (n != 0) {
+            if (n > 0) {
+                *rfds = r;
+                *wfds = w;
+                lowlat.spin_wakeups++;
+                }
+            return n;
+            }
+        lowlat_relax();
+        } while (lowlat_now_us() < end);
+    lowlat.sleep_wakeups++;
+    return 0;
+    }
+
+void lowlat_report()
+    {
+    if (!lowlat.enabled) {
+        return;
+        }
+    unsigned long total = lowlat.spin_wakeups + lowlat.sleep_wakeups;
+    printf("[%sLowLat%s] cpu=%d spin_wakeups=%lu sleep_wakeups=%lu (%.1f%% served by spin) busy_poll=%s\n",
+        FG_BCYAN, RESET, lowlat.cpu, lowlat.spin_wakeups, lowlat.sleep_wakeups,
+        total ? 100.0 * (double)lowlat.spin_wakeups / (double)total : 0.0, lowlat.busy_poll_ok ? "on" : "off");
+    lowlat.spin_wakeups = lowlat.sleep_wakeups = 0;
+    }
+#endif
@@ -0,0 +1,176 @@
+#ifndef MEMBERS_H   // room membership as immutable versioned sets , read without locks , freed by epochs
+#define MEMBERS_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/*
+fan out reads the member list of the room for every msg , joins / leaves change it . the list is a
+member_set which is never changed after it is published :
+    reader : s = mset_enter(r , reader) ... walk s->slot[] (plain loads) ... mset_leave(r , reader)
+             enter = one store of the global epoch into the reader's own cell + one load of the set ,
+             leave = one store , nothing per member
+    writer : builds the next set , mset_publish() swaps it in and retires the old one with the epoch
+             it was unlinked at , then bumps the epoch
+    reclaim: a retired set is freed once no reader is inside with an epoch at or before its retire
+             epoch (a reader which entered later can only have loaded the new set)
+writers are serialized by the caller (the loop , or a writer lock) , readers never wait for a writer
+and a writer never waits for a reader : a set a slow reader holds just stays on the retired list .
+freed sets are poisoned first (magic + slots) , so a reader which got one shows it (bench/member_bench)
+*/
+#define MSET_READERS     64
+#define MSET_RETIRED_MAX 1024
+#define MSET_LIVE        0x4d534554u   // "MSET"
+#define MSET_DEAD        0xdeadbeefu
+
+typedef struct member_set {
+    uint32_t magic;
+    int count;
+    unsigned long long version;   // room epoch it was built at
+    uint64_t sum;                 // of the slots , a reader can check the set is whole
+    int slot[];                   // member slots , ascending
+    }member_set;
+
+// own cache line per reader , enter / leave of one thread do not bounce the line of another
+typedef struct mset_reader {
+    _Alignas(64) atomic_ullong epoch;
+    }mset_reader;
+
+typedef struct member_rcu {
+    _Atomic(member_set*) cur;
+    atomic_ullong epoch;                          // starts at 1 , 0 in a reader cell = not inside
+    mset_reader reader[MSET_READERS];
+    // writer side
+    member_set* retired[MSET_RETIRED_MAX];
+    unsigned long long retired_epoch[MSET_RETIRED_MAX];
+    int retired_count;
+    // counters since last report
+    unsigned long publishes;
+    unsigned long reclaims;
+    unsigned long reclaim_waits;   // retired sets a reclaim had to leave for later
+    }member_rcu;
+
+/*
+new set of n slots (ascending) at version
+    return NULL : Error [memory]
+*/
+member_set* mset_build(unsigned long long version, const int* slots, int n)
+    {
+    member_set* s = malloc(sizeof(member_set) + (size_t)n * sizeof(int));
+    if (!s) {
+        return NULL;
+        }
+    s->magic = MSET_LIVE;
+    s->count = n;
+    s->version = version;
+    s->sum = 0;
+    for (int k = 0;k < n;k++) {
+        s->slot[k] = slots[k];
+        s->sum += (uint64_t)slots[k];
+        }
+    return s;
+    }
+
+static void mset_free(member_set* s)
+    {
+    s->magic = MSET_DEAD;
+    for (int k = 0;k < s->count;k++) {
+        s->slot[k] = -1;
+        }
+    free(s);
+    }
+
+// empty set at version 0
+int mset_init(member_rcu* r)
+    {
+    memset(r, 0, sizeof(*r));
+    member_set* s = mset_build(0, NULL, 0);
+    if (!s) {
+        return -1;
+        }
+    atomic_init(&r->cur, s);
+    atomic_init(&r->epoch, 1);
+    for (int k = 0;k < MSET_READERS;k++) {
+        atomic_init(&r->reader[k].epoch, 0);
+        }
+    return 0;
+    }
+
+// reader (0 .. MSET_READERS - 1 , one per thread) starts to use the current set
+static inline const member_set* mset_enter(member_rcu* r, int reader)
+    {
+    // seq_cst store then load : either the writer sees this cell , or this load sees its new set .
+    // an epoch past a publish (acquire) also means the set of that publish or a newer one
+    atomic_store(&r->reader[reader].epoch, atomic_load_explicit(&r->epoch, memory_order_acquire));
+    return atomic_load(&r->cur);
+    }
+
+static inline void mset_leave(member_rcu* r, int reader)
+    {
+    atomic_store_explicit(&r->reader[reader].epoch, 0, memory_order_release);
+    }
+
+// writer side , the set of the latest publish (no enter needed)
+static inline const member_set* mset_current(member_rcu* r)
+    {
+    return atomic_load_explicit(&r->cur, memory_order_relaxed);
+    }
+
+// free retired sets no reader can hold any more
+void mset_reclaim(member_rcu* r)
+    {
+    unsigned long long oldest = ~0ULL;
+    for (int k = 0;k < MSET_READERS;k++) {
+        unsigned long long e = atomic_load(&r->reader[k].epoch);
+        if (e != 0 && e < oldest) {
+            oldest = e;
+            }
+        }
+    int keep = 0;
+    for (int k = 0;k < r->retired_count;k++) {
+        if (r->retired_epoch[k] < oldest) {
+            mset_free(r->retired[k]);
+            r->reclaims++;
+            continue;
+            }
+        r->retired[keep] = r->retired[k];
+        r->retired_epoch[keep++] = r->retired_epoch[k];
+        }
+    r->reclaim_waits += (unsigned long)keep;
+    r->retired_count = keep;
+    }
+
+/*
+swap in next (built by mset_build) , the old set is freed when its readers left
+    return false : retired list full (readers stuck) , next is not published and still the caller's
+*/
+bool mset_publish(member_rcu* r, member_set* next)
+    {
+    if (r->retired_count == MSET_RETIRED_MAX) {
+        mset_reclaim(r);
+        if (r->retired_count == MSET_RETIRED_MAX) {
+            return false;
+            }
+        }
+    member_set* old = atomic_exchange(&r->cur, next);
+    r->retired[r->retired_count] = old;
+    r->retired_epoch[r->retired_count++] = atomic_fetch_add(&r->epoch, 1);
+    r->publishes++;
+    mset_reclaim(r);
+    return true;
+    }
+
+// no reader left (shutdown / end of bench)
+void mset_destroy(member_rcu* r)
+    {
+    for (int k = 0;k < r->retired_count;k++) {
+        mset_free(r->retired[k]);
+        }
+    r->retired_count = 0;
+    mset_free(atomic_load(&r->cur));
+    atomic_store(&r->cur, NULL);
+    }
+#endif
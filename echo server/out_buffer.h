@@ -0,0 +1,321 @@
+#ifndef OUT_BUFFER_H   // per connection output buffer (write coalescing)
+#define OUT_BUFFER_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+
+/*
+how it works :
+  1. during the read phase of a loop tick , broadcast msgs are only appended to the
+     out_buffer of every recipient (no send() yet) and the slot is marked dirty
+  2. at the end of the tick every dirty connection is flushed with ONE send()
+     so syscalls scale with recipients , not with messages
+  3. if one buffer grows past OUT_FLUSH_HIGH_WATER inside the tick , it is flushed early
+     with MSG_MORE (kernel keeps it corked because more data is coming this tick)
+  4. OUT_LATENCY_CAP_US bounds how long a byte can wait in user space during a long tick
+*/
+#define OUT_FLUSH_HIGH_WATER 16384      // early flush (with MSG_MORE) above this
+#define OUT_BUFFER_MAX       (1 << 20)  // slow consumer limit , client is dropped above this
+#define OUT_LATENCY_CAP_US   2000       // max delay added by coalescing inside one tick
+#define OUT_INITIAL_CAP      1024
+
+/*
+priority lanes of one connection :
+    LANE_CTRL : heartbeats , blob announce / errors , presence , acks -> always sent first
+    LANE_DATA : chat -> after control , at most OUT_DATA_QUANTUM bytes per tick (deficit counter)
+both lanes go out in ONE sendmsg() with the control iovec first . the quantum keeps the kernel
+send queue short , so a control frame queued in the next tick does not wait behind megabytes of chat
+the data lane knows where its frames end (lane_frame_end) , a FROM mark + its line or a ZDICT + Z
+frame is one frame . control only goes in front of the data lane between two frames and the
+quantum is only cut at a frame end , so a frame which did not fit the credit goes out whole
+*/
+#define LANE_CTRL 0
+#define LANE_DATA 1
+#define LANES     2
+#define OUT_DATA_QUANTUM (256 * 1024)
+
+typedef struct out_buffer {
+    char* data;
+    size_t len;      // bytes queued
+    size_t sent;     // bytes of data[] already accepted by kernel
+    size_t cap;
+    bool dirty;      // is in the dirty list of current tick
+    bool corked;     // last send used MSG_MORE , needs uncork at tick end
+    long long since_us;   // when the buffer went from empty to non empty (lane latency)
+    size_t* ends;    // data lane : offsets in data[] where a frame ends , [ends_head , ends_len) not sent yet
+    size_t ends_head;
+    size_t ends_len;
+    size_t ends_cap;
+    bool mid;        // data lane : the kernel took part of a frame , control waits until it is finished
+    }out_buffer;
+
+typedef struct lane_stats {
+    unsigned long frames;
+    unsigned long bytes;
+    size_t depth_max;          // most bytes waiting in one connection
+    unsigned long lat_samples;
+    long long lat_sum_us;      // queue latency = first queued byte until the lane is empty again
+    long long lat_max_us;
+    }lane_stats;
+
+lane_stats lane_st[LANES];
+
+// monotonic clock in micro seconds (wall clock can jump)
+long long now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+size_t out_pending(const out_buffer* ob)
+    {
+    return ob->len - ob->sent;
+    }
+
+// append msg to the buffer , false when the client is too slow (buffer limit)
+bool out_append(out_buffer* ob, const char* msg, size_t n)
+    {
+    if (out_pending(ob) + n > OUT_BUFFER_MAX) {
+        return false;
+        }
+    // reuse the already sent part of buffer before growing it
+    if (ob->sent > 0 && ob->len + n > ob->cap) {
+        memmove(ob->data, ob->data + ob->sent, ob->len - ob->sent);
+        for (size_t k = ob->ends_head;k < ob->ends_len;k++) {
+            ob->ends[k] -= ob->sent;
+            }
+        ob->len -= ob->sent;
+        ob->sent = 0;
+        }
+    if (ob->len + n > ob->cap) {
+        size_t new_cap = ob->cap ? ob->cap : OUT_INITIAL_CAP;
+        while (new_cap < ob->len + n) {
+            new_cap *= 2;
+            }
+        char* p = (char*)realloc(ob->data, new_cap);
+        if (!p) {
+            return false;
+            }
+        ob->data = p;
+        ob->cap = new_cap;
+        }
+    if (out_pending(ob) == 0) {
+        ob->since_us = now_us();
+        }
+    memcpy(ob->data + ob->len, msg, n);
+    ob->len += n;
+    return true;
+    }
+
+// append to a lane and count it
+bool lane_append(out_buffer* ob, int lane, const char* msg, size_t n)
+    {
+    if (!out_append(ob, msg, n)) {
+        return false;
+        }
+    lane_st[lane].frames++;
+    lane_st[lane].bytes += n;
+    if (out_pending(ob) > lane_st[lane].depth_max) {
+        lane_st[lane].depth_max = out_pending(ob);
+        }
+    return true;
+    }
+
+// everything appended since the last frame end is one whole frame , false when out of memory
+bool lane_frame_end(out_buffer* ob)
+    {
+    // the frame went out already , control may follow it
+    if (ob->len == ob->sent) {
+        ob->mid = false;
+        return true;
+        }
+    if (ob->ends_len > ob->ends_head && ob->ends[ob->ends_len - 1] == ob->len) {
+        return true;
+        }
+    if (ob->ends_len == ob->ends_cap && ob->ends_head > 0) {
+        memmove(ob->ends, ob->ends + ob->ends_head, (ob->ends_len - ob->ends_head) * sizeof(size_t));
+        ob->ends_len -= ob->ends_head;
+        ob->ends_head = 0;
+        }
+    if (ob->ends_len == ob->ends_cap) {
+        size_t new_cap = ob->ends_cap ? ob->ends_cap * 2 : 64;
+        size_t* p = (size_t*)realloc(ob->ends, new_cap * sizeof(size_t));
+        if (!p) {
+            return false;
+            }
+        ob->ends = p;
+        ob->ends_cap = new_cap;
+        }
+    ob->ends[ob->ends_len++] = ob->len;
+    return true;
+    }
+
+/*
+data bytes for the next sendmsg() of the data lane
+    1. inside a frame : the rest of that frame , whatever the credit is
+    2. between frames : whole frames up to credit , the first one even when it is bigger
+*/
+static size_t lane_frame_cut(const out_buffer* ob, size_t credit)
+    {
+    if (out_pending(ob) == 0 || (!ob->mid && credit == 0)) {
+        return 0;
+        }
+    size_t lo = ob->ends_head, hi = ob->ends_len;
+    size_t first = (lo < hi) ? ob->ends[lo] : ob->len;   // end of the next frame
+    size_t limit = ob->sent + credit;
+    if (ob->mid || first >= limit) {
+        return first - ob->sent;
+        }
+    // a frame not closed yet (all ends are below) goes too when it fits
+    if (ob->len <= limit) {
+        return ob->len - ob->sent;
+        }
+    // last end inside the credit , ends[lo] <= limit < ends[hi] (or len)
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ob->ends[mid] <= limit) {
+            lo = mid;
+            }
+        else {
+            hi = mid;
+            }
+        }
+    return ob->ends[lo] - ob->sent;
+    }
+
+// lane fully sent , reset it and take a latency sample
+static void lane_drained(out_buffer* ob, int lane)
+    {
+    if (ob->len == 0) {
+        return;
+        }
+    long long lat = now_us() - ob->since_us;
+    lane_st[lane].lat_samples++;
+    lane_st[lane].lat_sum_us += lat;
+    if (lat > lane_st[lane].lat_max_us) {
+        lane_st[lane].lat_max_us = lat;
+        }
+    ob->len = 0;
+    ob->sent = 0;
+    ob->ends_head = 0;
+    ob->ends_len = 0;
+    }
+
+/*
+control lane , then whole data frames up to *credit bytes , in one sendmsg() per round
+a data frame the kernel took only in part is finished first , without control in front
+Meanings of return in out_flush_lanes :
+    return -1 : Error [connection is broken , close it]
+    return 0  : Success [both lanes empty]
+    return 1  : data left [kernel buffer full or credit used up]
+*/
+int out_flush_lanes(int fd, out_buffer* ctrl, out_buffer* data, size_t* credit, int flags, unsigned long* send_calls)
+    {
+    for (;;) {
+        size_t c = data->mid ? 0 : out_pending(ctrl);
+        size_t d = lane_frame_cut(data, *credit);
+        if (c + d == 0) {
+            break;
+            }
+        struct iovec iov[2];
+        int cnt = 0;
+        if (c > 0) {
+            iov[cnt].iov_base = ctrl->data + ctrl->sent;
+            iov[cnt++].iov_len = c;
+            }
+        if (d > 0) {
+            iov[cnt].iov_base = data->data + data->sent;
+            iov[cnt++].iov_len = d;
+            }
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        mh.msg_iovlen = (size_t)cnt;
+        // MSG_NOSIGNAL : a closed peer gives EPIPE instead of killing the server with SIGPIPE
+        ssize_t m = sendmsg(fd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL | flags);
+        (*send_calls)++;
+        if (m < 0) {
+            if (errno == EINTR) {
+                continue;
+                }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 1;
+                }
+            return -1;
+            }
+        size_t mc = ((size_t)m < c) ? (size_t)m : c;
+        size_t md = (size_t)m - mc;
+        ctrl->sent += mc;
+        if (md > 0) {
+            data->sent += md;
+            bool at_end = false;
+            while (data->ends_head < data->ends_len && data->ends[data->ends_head] <= data->sent) {
+                at_end = (data->ends[data->ends_head++] == data->sent);
+                }
+            data->mid = !at_end;
+            *credit = (md < *credit) ? *credit - md : 0;
+            }
+        }
+    if (ctrl->sent == ctrl->len) {
+        lane_drained(ctrl, LANE_CTRL);
+        }
+    if (data->sent == data->len) {
+        lane_drained(data, LANE_DATA);
+        }
+    data->corked = (flags & MSG_MORE) != 0;
+    return (out_pending(ctrl) > 0 || out_pending(data) > 0) ? 1 : 0;
+    }
+
+void lanes_report()
+    {
+    static const char* names[LANES] = { "ctrl", "data" };
+    for (int l = 0;l < LANES;l++) {
+        lane_stats* ls = &lane_st[l];
+        printf("[%sLane%s] %s frames=%lu bytes=%lu depth_max=%zu latency avg=%lldus max=%lldus\n",
+            FG_BCYAN, RESET, names[l], ls->frames, ls->bytes, ls->depth_max,
+            ls->lat_samples ? ls->lat_sum_us / (long long)ls->lat_samples : 0, ls->lat_max_us);
+        memset(ls, 0, sizeof(*ls));
+        }
+    }
+
+// push out the data which is held back by a previous MSG_MORE
+void out_uncork(int fd, out_buffer* ob)
+    {
+    int zero = 0;
+    if (ob->corked) {
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero));
+        ob->corked = false;
+        }
+    }
+
+void out_free(out_buffer* ob)
+    {
+    free(ob->data);
+    free(ob->ends);
+    memset(ob, 0, sizeof(*ob));
+    }
+
+/*
+socket setup of accepted client
+    1. non-blocking , a full send buffer must never stall the event loop (send , sendfile)
+    2. TCP_NODELAY , we coalesce in user space so Nagle only adds delay
+*/
+void tune_client_socket(int fd)
+    {
+    int flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+    int one = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+        perror("setsockopt TCP_NODELAY");
+        }
+    }
+#endif
@@ -0,0 +1,180 @@
+#ifndef ROSTER_H   // presence : who is online , pushed to clients as deltas
+#define ROSTER_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/select.h>
+#include "handshake.h"
+#include "out_buffer.h"
+#include "members.h"
+
+/*
+one room (every ready client of the server) , a client subscribes with "!?!?ROSTER <epoch>\n" :
+    epoch 0 or an epoch the client missed something after -> one SNAP , then deltas only
+    every change bumps the room epoch and becomes ONE delta line :
+        !?!?JOIN <epoch> <id> <name>
+        !?!?LEFT <epoch> <id>
+        !?!?NICK <epoch> <id> <name>
+    snapshot :
+        !?!?SNAP <epoch> <count>   then count x   !?!?MEMB <id> <name>
+deltas of one loop tick are collected in one buffer and appended once per subscriber at tick end ,
+so a churning room costs (changes x subscribers) bytes , never a member list per change .
+a client which sees epoch != its epoch + 1 asks again (gap -> SNAP) .
+chat to a subscriber gets "!?!?FROM <id>\n" on the data lane , only when the sender changed (delivery.h) .
+member id = generation << ROSTER_SLOT_BITS | slot , a reused slot gets a new id
+fan out walks the member set (members.h) : slots of the members , rebuilt on the first fan out after a
+join / leave , so a msg costs members instead of a scan of every slot and the set a fan out walks stays
+as it is while members are dropped under it
+*/
+#define ROSTER_SLOT_BITS 10
+#define ROSTER_SLOT_MASK ((1u << ROSTER_SLOT_BITS) - 1)
+#define ROSTER_LINE_MAX  (HS_NAME_MAX + 64)
+
+_Static_assert(FD_SETSIZE <= (1 << ROSTER_SLOT_BITS), "roster id has no room for every slot");
+
+typedef struct roster_member {
+    uint32_t id;          // 0 = slot not in the room
+    bool subscribed;      // gets deltas and FROM marks
+    char name[HS_NAME_MAX + 1];
+    }roster_member;
+
+typedef struct roster {
+    unsigned long long epoch;
+    int count;
+    uint32_t gen[FD_SETSIZE];
+    roster_member m[FD_SETSIZE];
+    out_buffer delta;                 // deltas of current tick
+    out_buffer snap;                  // cached snapshot
+    unsigned long long snap_epoch;    // epoch of the cached snapshot (0 = none)
+    member_rcu members;               // member slots for the fan out , version = changes
+    unsigned long long changes;       // joins + leaves
+    unsigned long deltas;
+    unsigned long delta_bytes;        // after fan out
+    unsigned long snaps;
+    unsigned long snap_bytes;
+    unsigned long snap_builds;
+    }roster;
+
+static bool roster_delta(roster* r, const char* line, int len)
+    {
+    if (len < 0 || !out_append(&r->delta, line, (size_t)len)) {
+        return false;
+        }
+    r->deltas++;
+    return true;
+    }
+
+// slot i finished the handshake , return its member id
+uint32_t roster_join(roster* r, int i, const char* name)
+    {
+    roster_member* mb = &r->m[i];
+    r->gen[i]++;
+    mb->id = (r->gen[i] << ROSTER_SLOT_BITS) | (uint32_t)i;
+    mb->subscribed = false;
+    snprintf(mb->name, sizeof(mb->name), "%s", name);
+    r->count++;
+    r->changes++;
+    char line[ROSTER_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "!?!?JOIN %llu %x %s\n", ++r->epoch, mb->id, mb->name);
+    roster_delta(r, line, len);
+    return mb->id;
+    }
+
+void roster_leave(roster* r, int i)
+    {
+    roster_member* mb = &r->m[i];
+    if (mb->id == 0) {
+        return;
+        }
+    char line[ROSTER_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "!?!?LEFT %llu %x\n", ++r->epoch, mb->id);
+    roster_delta(r, line, len);
+    mb->id = 0;
+    mb->subscribed = false;
+    r->count--;
+    r->changes++;
+    }
+
+/*
+Meanings of return in roster_nick :
+    return false : Error [not a valid name]
+    return true  : Success
+*/
+bool roster_nick(roster* r, int i, const char* name, size_t n)
+    {
+    roster_member* mb = &r->m[i];
+    if (mb->id == 0 || !hs_name_ok(name, n)) {
+        return false;
+        }
+    memcpy(mb->name, name, n);
+    mb->name[n] = '\0';
+    char line[ROSTER_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "!?!?NICK %llu %x %s\n", ++r->epoch, mb->id, mb->name);
+    roster_delta(r, line, len);
+    return true;
+    }
+
+// snapshot of current epoch , rebuilt only when the room changed since the last one
+const out_buffer* roster_snapshot(roster* r)
+    {
+    if (r->snap_epoch == r->epoch && r->snap.len > 0) {
+        return &r->snap;
+        }
+    r->snap.len = r->snap.sent = 0;
+    char line[ROSTER_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "!?!?SNAP %llu %d\n", r->epoch, r->count);
+    out_append(&r->snap, line, (size_t)len);
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (r->m[i].id != 0) {
+            len = snprintf(line, sizeof(line), "!?!?MEMB %x %s\n", r->m[i].id, r->m[i].name);
+            out_append(&r->snap, line, (size_t)len);
+            }
+        }
+    r->snap_epoch = r->epoch;
+    r->snap_builds++;
+    return &r->snap;
+    }
+
+/*
+member set for a fan out of the loop (reader 0) , valid until roster_members_done() , not nested
+a set which can not be rebuilt (no memory) is used as it is , the msg misses the newest members
+*/
+const member_set* roster_members(roster* r)
+    {
+    member_rcu* mr = &r->members;
+    if (!atomic_load_explicit(&mr->cur, memory_order_relaxed) && mset_init(mr) < 0) {
+        fprintf(stderr, "[%sError%s] | Member set not created\n", FG_RED, RESET);
+        exit(1);
+        }
+    if (mset_current(mr)->version != r->changes) {
+        int slots[FD_SETSIZE];
+        int n = 0;
+        for (int i = 0;i < FD_SETSIZE;i++) {
+            if (r->m[i].id != 0) {
+                slots[n++] = i;
+                }
+            }
+        member_set* next = mset_build(r->changes, slots, n);
+        if (!next || !mset_publish(mr, next)) {
+            fprintf(stderr, "[%sError%s] | Member set not rebuilt\n", FG_RED, RESET);
+            free(next);
+            }
+        }
+    return mset_enter(mr, 0);
+    }
+
+void roster_members_done(roster* r)
+    {
+    mset_leave(&r->members, 0);
+    }
+
+void roster_report(roster* r)
+    {
+    printf("[%sRoster%s] members=%d epoch=%llu deltas=%lu delta_bytes=%lu snapshots=%lu (built %lu) snap_bytes=%lu member_sets=%lu freed=%lu\n",
+        FG_BCYAN, RESET, r->count, r->epoch, r->deltas, r->delta_bytes, r->snaps, r->snap_builds, r->snap_bytes,
+        r->members.publishes, r->members.reclaims);
+    r->deltas = r->delta_bytes = r->snaps = r->snap_bytes = r->snap_builds = 0;
+    r->members.publishes = r->members.reclaims = r->members.reclaim_waits = 0;
+    }
+#endif
@@ -0,0 +1,232 @@
+#ifndef SCAN_H   // receive path scanner : line boundaries , separator , utf-8 check
+#define SCAN_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*
+one pass over the receive buffer in 64 byte blocks :
+    1. SIMD compares give 3 bit masks per block : '\n' , '!' (first char of MSG_SEPRATE) , high bit (non ascii)
+       (AVX2 = 2 x 32 byte , SSE2 = 4 x 16 byte , scalar fallback builds the same masks)
+    2. line ends are taken from the '\n' mask with ctz (no per byte compare)
+    3. a pure ascii block is valid utf-8 by itself , only blocks with high bits (or a sequence
+       running over from previous block) go through the utf-8 DFA , which is a table lookup
+       per byte without branches
+    4. a '!' bit is checked with one memcmp for the full "!?!?" , '!' is rare in chat
+*/
+#define SCAN_BLOCK 64
+
+typedef struct scan_line {
+    uint32_t start;      // offset in buffer
+    uint32_t len;        // length including '\n'
+    int32_t sep;         // offset of first MSG_SEPRATE from start , -1 = none
+    bool utf8_ok;
+    }scan_line;
+
+typedef struct scan_masks {
+    uint64_t nl;
+    uint64_t bang;
+    uint64_t high;
+    }scan_masks;
+
+// ------------------------------ utf-8 DFA ------------------------------
+/*
+byte classes : 0 ascii | 1 80..8F | 2 90..9F | 3 A0..BF | 4 invalid (C0 C1 F5..FF) | 5 C2..DF
+               6 E0 | 7 E1..EC EE EF | 8 ED | 9 F0 | 10 F1..F3 | 11 F4
+states : 0 accept | 1 reject | 2 need 1 | 3 need 2 | 4 after E0 | 5 after ED | 6 need 3 | 7 after F0 | 8 after F4
+*/
+static const uint8_t scan_utf8_next[9][12] = {
+    { 0, 1, 1, 1, 1, 2, 4, 3, 5, 7, 6, 8 },
+    { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 3, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 1, 3, 3, 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+    };
+static uint8_t scan_utf8_class[256];
+
+static void (*scan_masks_fn)(const uint8_t*, scan_masks*) = NULL;
+
+// scalar fallback , same masks as the SIMD versions
+static void scan_masks_scalar(const uint8_t* p, scan_masks* m)
+    {
+    uint64_t nl = 0, bang = 0, high = 0;
+    for (int k = 0;k < SCAN_BLOCK;k++) {
+        nl |= (uint64_t)(p[k] == '\n') << k;
+        bang |= (uint64_t)(p[k] == '!') << k;
+        high |= (uint64_t)(p[k] >> 7) << k;
+        }
+    m->nl = nl;
+    m->bang = bang;
+    m->high = high;
+    }
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static void scan_masks_sse2(const uint8_t* p, scan_masks* m)
+    {
+    const __m128i vnl = _mm_set1_epi8('\n');
+    const __m128i vbang = _mm_set1_epi8('!');
+    uint64_t nl = 0, bang = 0, high = 0;
+    for (int k = 0;k < 4;k++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+        nl |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vnl)) << (16 * k);
+        bang |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vbang)) << (16 * k);
+        high |= (uint64_t)(uint16_t)_mm_movemask_epi8(v) << (16 * k);
+        }
+    m->nl = nl;
+    m->bang = bang;
+    m->high = high;
+    }
+
+__attribute__((target("avx2")))
+static void scan_masks_avx2(const uint8_t* p, scan_masks* m)
+    {
+    const __m256i vnl = _mm256_set1_epi8('\n');
+    const __m256i vbang = _mm256_set1_epi8('!');
+    __m256i lo = _mm256_loadu_si256((const __m256i*)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+    m->nl = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vnl))
+        | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vnl)) << 32);
+    m->bang = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vbang))
+        | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vbang)) << 32);
+    m->high = (uint64_t)(uint32_t)_mm256_movemask_epi8(lo)
+        | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+    }
+#endif
+
+// pick the best mask function for this cpu and build the utf-8 class table (once)
+const char* scan_init()
+    {
+    for (int c = 0;c < 256;c++) {
+        uint8_t k;
+        if (c < 0x80) k = 0;
+        else if (c < 0x90) k = 1;
+        else if (c < 0xA0) k = 2;
+        else if (c < 0xC0) k = 3;
+        else if (c < 0xC2) k = 4;
+        else if (c < 0xE0) k = 5;
+        else if (c == 0xE0) k = 6;
+        else if (c == 0xED) k = 8;
+        else if (c < 0xF0) k = 7;
+        else if (c == 0xF0) k = 9;
+        else if (c < 0xF4) k = 10;
+        else if (c == 0xF4) k = 11;
+        else k = 4;
+        scan_utf8_class[c] = k;
+        }
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_masks_fn = scan_masks_avx2;
+        return "avx2";
+        }
+    if (__builtin_cpu_supports("sse2")) {
+        scan_masks_fn = scan_masks_sse2;
+        return "sse2";
+        }
+#endif
+    scan_masks_fn = scan_masks_scalar;
+    return "scalar";
+    }
+
+// run the DFA over p[0..n) , branch free (one table lookup per byte)
+static inline uint8_t scan_utf8_run(uint8_t state, const uint8_t* p, size_t n)
+    {
+    for (size_t k = 0;k < n;k++) {
+        state = scan_utf8_next[state][scan_utf8_class[p[k]]];
+        }
+    return state;
+    }
+
+// check '!' bits of one block in [from , to) for a full separator
+static inline void scan_sep_range(const uint8_t* p, size_t n, size_t base, uint64_t bangs, size_t from, size_t to, size_t line_start, int32_t* sep)
+    {
+    size_t lo = from - base, hi = to - base;
+    uint64_t range = (hi >= 64) ? ~0ULL : ((1ULL << hi) - 1);
+    range &= (lo >= 64) ? 0 : ~((1ULL << lo) - 1);
+    bangs &= range;
+    while (bangs) {
+        size_t pos = base + (size_t)__builtin_ctzll(bangs);
+        bangs &= bangs - 1;
+        if (pos + 4 <= n && memcmp(p + pos, "!?!?", 4) == 0) {
+            *sep = (int32_t)(pos - line_start);
+            return;
+            }
+        }
+    }
+
+/*
+split buf[0..n) into complete lines
+    out      : line info (max entries)
+    consumed : bytes up to the end of the last complete line (rest is a partial line)
+    return   : number of lines in out
+*/
+size_t scan_lines(const char* buf, size_t n, scan_line* out, size_t max, size_t* consumed)
+    {
+    const uint8_t* p = (const uint8_t*)buf;
+    size_t count = 0;
+    size_t line_start = 0;
+    int32_t sep = -1;
+    uint8_t state = 0;       // utf-8 DFA state of current line (reject is sticky)
+    *consumed = 0;
+    if (!scan_masks_fn) {
+        scan_init();
+        }
+    for (size_t base = 0;base < n && count < max;base += SCAN_BLOCK) {
+        scan_masks m;
+        size_t blen = (n - base < SCAN_BLOCK) ? n - base : SCAN_BLOCK;
+        if (blen == SCAN_BLOCK) {
+            scan_masks_fn(p + base, &m);
+            }
+        else {
+            // tail block , zero padding is ascii and matches nothing
+            uint8_t tail[SCAN_BLOCK] = { 0 };
+            memcpy(tail, p + base, blen);
+            scan_masks_fn(tail, &m);
+            }
+        // ascii block and no open sequence -> DFA is skipped for the whole block
+        bool check_utf8 = m.high != 0 || state != 0;
+        size_t cursor = base;    // bytes of block before cursor are done
+        uint64_t nls = m.nl;
+        while (nls && count < max) {
+            size_t pos = base + (size_t)__builtin_ctzll(nls);
+            nls &= nls - 1;
+            if (sep < 0 && m.bang) {
+                scan_sep_range(p, n, base, m.bang, cursor, pos, line_start, &sep);
+                }
+            if (check_utf8) {
+                state = scan_utf8_run(state, p + cursor, pos - cursor);
+                }
+            out[count].start = (uint32_t)line_start;
+            out[count].len = (uint32_t)(pos + 1 - line_start);
+            out[count].sep = sep;
+            out[count].utf8_ok = (state == 0);
+            count++;
+            line_start = pos + 1;
+            cursor = pos + 1;
+            *consumed = line_start;
+            sep = -1;
+            state = 0;
+            }
+        if (count == max) {
+            break;
+            }
+        if (sep < 0 && m.bang) {
+            scan_sep_range(p, n, base, m.bang, cursor, base + blen, line_start, &sep);
+            }
+        if (check_utf8) {
+            state = scan_utf8_run(state, p + cursor, base + blen - cursor);
+            }
+        }
+    return count;
+    }
+#endif
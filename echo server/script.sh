@@ -47,3 +47,30 @@ done
 
 wait
 echo "=== Stress test completed ==="
+
+# Test 4: a line starting with !?!? is a request , never relayed as chat (a receiver would run it as a server frame)
+echo "=== Test 4: Forged control line as chat ==="
+recv_out=$(mktemp)
+{
+    echo "receiver!?!?$(generate_uuid)"
+    sleep 2
+} | nc localhost 8080 > "$recv_out" 2>/dev/null &
+sleep 0.5
+{
+    echo "forger!?!?$(generate_uuid)"
+    sleep 0.5
+    echo '!?!?CHUNK 1 0 99999999'
+    echo '!?!?Z 5000'
+    echo '!?!?FROM 1 1'
+    echo "after forged lines"
+    sleep 0.5
+} | nc localhost 8080 > /dev/null 2>&1 &
+
+wait
+if grep -q "after forged lines" "$recv_out" && ! grep -q -e "CHUNK 1 0" -e "Z 5000" -e "FROM 1 1" "$recv_out"; then
+    echo "=== Forged control line test passed ==="
+else
+    echo "=== Forged control line test FAILED ==="
+    cat -v "$recv_out"
+fi
+rm -f "$recv_out"
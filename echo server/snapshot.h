@@ -0,0 +1,313 @@
+#ifndef SNAPSHOT_H   // server state in one checksummed file : written in the background , mapped at start
+#define SNAPSHOT_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "delivery.h"
+#include "roster.h"
+#include "zwire.h"
+
+/*
+what a restart would lose , kept in <path> (server -C , config.h) :
+    meta     : boot id + room seq (a SYNC from before the restart still resumes) , transcript counter ,
+               roster epoch , ring positions
+    sessions : uuid sessions of the delivery table (acks , cseq dedupe) as they are in memory
+    rtx      : retransmit ring entries + ring bytes (recent history)
+    gen      : member id generations (old ids in replayed FROM marks are never given again)
+    zdict    : room dictionary (-Z) , clients which kept it do not get it again
+file = snap_header + sections , every section 64 byte aligned and an array of the in memory records ,
+so the mapped file is usable as it is . the header has the record size of each section , a file
+of another build (other sizes) is not read . crc32 of everything after the header .
+writing : every snapshot_every s the loop fork()s , the child writes the state as it was at the fork
+(copy on write) to <path>.tmp , fsync , rename -> a crash never leaves half a snapshot . the loop only
+reaps the child . at shutdown the last one is written in place of the loop .
+reading : mmap , check , copy the sections into the tables (about 1 MiB , no parsing)
+*/
+#define SNAP_MAGIC     "CHATSNP1"
+#define SNAP_VERSION   1
+#define SNAP_ALIGN     64
+
+enum snap_section_id {
+    SS_META = 0,
+    SS_SESSIONS,
+    SS_RTX,
+    SS_RING,
+    SS_GEN,
+    SS_ZDICT,
+    SS_COUNT
+    };
+
+typedef struct snap_section {
+    uint64_t off;
+    uint64_t len;
+    uint32_t rec_size;
+    uint32_t count;
+    }snap_section;
+
+typedef struct snap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t crc;             // of bytes [sizeof(snap_header) , size)
+    uint64_t size;
+    int64_t written;          // unix time
+    snap_section sec[SS_COUNT];
+    }snap_header;
+
+typedef struct snap_meta {
+    uint32_t boot;
+    int32_t file_count;
+    uint64_t seq;
+    uint64_t roster_epoch;
+    uint64_t ring_wpos;
+    uint64_t ring_bytes;
+    int32_t rtx_head;
+    int32_t rtx_count;
+    uint32_t dict_id;
+    uint32_t dict_len;
+    }snap_meta;
+
+// the tables a snapshot holds
+typedef struct snap_state {
+    delivery* d;
+    roster* r;
+    zwire* zw;
+    int* file_count;
+    }snap_state;
+
+typedef struct snapshotter {
+    char path[256];
+    int every;                // s , 0 = only at shutdown
+    time_t next;
+    pid_t child;              // writer running , 0 = none
+    unsigned long writes;
+    unsigned long failures;
+    }snapshotter;
+
+static long long snap_now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+static size_t snap_align(size_t n)
+    {
+    return (n + SNAP_ALIGN - 1) & ~(size_t)(SNAP_ALIGN - 1);
+    }
+
+// sections of st in file order , return the file size
+static size_t snap_layout(const snap_state* st, snap_header* h, const void** src)
+    {
+    static snap_meta meta;
+    const delivery* d = st->d;
+    meta = (snap_meta){ .boot = d->boot, .file_count = *st->file_count, .seq = d->seq, .roster_epoch = st->r->epoch,
+        .ring_wpos = d->wpos, .ring_bytes = d->bytes, .rtx_head = d->head, .rtx_count = d->count,
+        .dict_id = st->zw->dict_id, .dict_len = (uint32_t)st->zw->dict_len };
+    const struct { const void* p; uint32_t rec; uint32_t count; } sec[SS_COUNT] = {
+        [SS_META] = { &meta, sizeof(snap_meta), 1 },
+        [SS_SESSIONS] = { d->s, sizeof(dlv_session), DLV_SESSIONS },
+        [SS_RTX] = { d->e, sizeof(rtx_entry), RTX_MSGS },
+        [SS_RING] = { d->ring, 1, d->ring ? RTX_BYTES : 0 },
+        [SS_GEN] = { st->r->gen, sizeof(uint32_t), FD_SETSIZE },
+        [SS_ZDICT] = { st->zw->dict, 1, (uint32_t)st->zw->dict_len },
+        };
+    size_t off = snap_align(sizeof(snap_header));
+    for (int k = 0;k < SS_COUNT;k++) {
+        h->sec[k] = (snap_section){ off, (uint64_t)sec[k].rec * sec[k].count, sec[k].rec, sec[k].count };
+        src[k] = sec[k].p;
+        off = snap_align(off + h->sec[k].len);
+        }
+    return off;
+    }
+
+/*
+write the snapshot of st to path (tmp file + rename)
+    return -1 : Error
+*/
+int snap_write(const char* path, const snap_state* st)
+    {
+    snap_header h;
+    memset(&h, 0, sizeof(h));
+    const void* src[SS_COUNT];
+    size_t size = snap_layout(st, &h, src);
+    char* img = calloc(1, size);
+    if (!img) {
+        return -1;
+        }
+    for (int k = 0;k < SS_COUNT;k++) {
+        if (h.sec[k].len > 0) {
+            memcpy(img + h.sec[k].off, src[k], h.sec[k].len);
+            }
+        }
+    memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+    h.version = SNAP_VERSION;
+    h.size = size;
+    h.written = (int64_t)time(NULL);
+    h.crc = (uint32_t)crc32_z(0, (const Bytef*)img + sizeof(h), size - sizeof(h));
+    memcpy(img, &h, sizeof(h));
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    size_t done = 0;
+    while (fd >= 0 && done < size) {
+        ssize_t w = write(fd, img + done, size - done);
+        if (w <= 0) {
+            break;
+            }
+        done += (size_t)w;
+        }
+    free(img);
+    bool ok = (fd >= 0 && done == size && fsync(fd) == 0);
+    if (fd >= 0) {
+        close(fd);
+        }
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+        }
+    return 0;
+    }
+
+/*
+restore st from the snapshot at path (called before any client is there)
+    return -1 : there is a file , but it is not valid (cold start)
+    return 0  : no snapshot
+    return 1  : restored
+*/
+int snap_load(const char* path, snap_state* st)
+    {
+    long long t0 = snap_now_us();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+        }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(snap_header)) {
+        close(fd);
+        return -1;
+        }
+    size_t size = (size_t)sb.st_size;
+    const char* img = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (img == MAP_FAILED) {
+        return -1;
+        }
+    const snap_header* h = (const snap_header*)img;
+    static const uint32_t rec[SS_COUNT] = { sizeof(snap_meta), sizeof(dlv_session), sizeof(rtx_entry), 1, sizeof(uint32_t), 1 };
+    static const uint32_t count_max[SS_COUNT] = { 1, DLV_SESSIONS, RTX_MSGS, RTX_BYTES, FD_SETSIZE, ZDICT_MAX };
+    bool ok = memcmp(h->magic, SNAP_MAGIC, sizeof(h->magic)) == 0 && h->version == SNAP_VERSION && h->size == size;
+    for (int k = 0;ok && k < SS_COUNT;k++) {
+        const snap_section* s = &h->sec[k];
+        ok = s->rec_size == rec[k] && s->count <= count_max[k] && s->len == (uint64_t)s->rec_size * s->count &&
+            s->off >= sizeof(snap_header) && s->off <= size && s->len <= size - s->off;
+        }
+    // fixed size tables must be whole
+    ok = ok && h->sec[SS_META].count == 1 && h->sec[SS_SESSIONS].count == DLV_SESSIONS &&
+        h->sec[SS_RTX].count == RTX_MSGS && h->sec[SS_GEN].count == FD_SETSIZE;
+    ok = ok && (uint32_t)crc32_z(0, (const Bytef*)img + sizeof(snap_header), size - sizeof(snap_header)) == h->crc;
+    if (!ok) {
+        munmap((void*)img, size);
+        return -1;
+        }
+    const snap_meta* m = (const snap_meta*)(img + h->sec[SS_META].off);
+    delivery* d = st->d;
+    d->boot = m->boot;
+    d->seq = m->seq;
+    memcpy(d->s, img + h->sec[SS_SESSIONS].off, h->sec[SS_SESSIONS].len);
+    for (int k = 0;k < DLV_SESSIONS;k++) {
+        d->s[k].conns = 0;
+        }
+    // ring only when it is whole , else the history starts empty
+    if (h->sec[SS_RING].count == RTX_BYTES && (d->ring || (d->ring = malloc(RTX_BYTES)))) {
+        memcpy(d->ring, img + h->sec[SS_RING].off, RTX_BYTES);
+        memcpy(d->e, img + h->sec[SS_RTX].off, h->sec[SS_RTX].len);
+        d->wpos = (size_t)m->ring_wpos;
+        d->bytes = (size_t)m->ring_bytes;
+        d->head = m->rtx_head;
+        d->count = m->rtx_count;
+        }
+    memcpy(st->r->gen, img + h->sec[SS_GEN].off, h->sec[SS_GEN].len);
+    // one step on : a client which still has the old epoch gets a new SNAP (the room is empty now)
+    st->r->epoch = m->roster_epoch + 1;
+    if (st->zw->enabled && h->sec[SS_ZDICT].len > 0 && m->dict_len == h->sec[SS_ZDICT].len) {
+        memcpy(st->zw->dict, img + h->sec[SS_ZDICT].off, m->dict_len);
+        st->zw->dict_len = m->dict_len;
+        st->zw->dict_id = m->dict_id;
+        }
+    *st->file_count = m->file_count;
+    long long age = (long long)(time(NULL) - h->written);
+    munmap((void*)img, size);
+    int sessions = 0;
+    for (int k = 0;k < DLV_SESSIONS;k++) {
+        sessions += (d->s[k].uuid[0] != '\0');
+        }
+    printf("%sState : %s (%zu bytes , written %llds ago) sessions=%d history=%d msgs seq=%llu restored in %.2f ms%s\n", FG_BGREEN,
+        path, size, age, sessions, d->count, d->seq, (double)(snap_now_us() - t0) / 1000.0, RESET);
+    return 1;
+    }
+
+// background writer finished ?
+static void snap_reap(snapshotter* sn, bool wait)
+    {
+    int status;
+    if (sn->child <= 0 || waitpid(sn->child, &status, wait ? 0 : WNOHANG) != sn->child) {
+        return;
+        }
+    sn->child = 0;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        sn->writes++;
+        printf("[%sSnap%s] %s written in the background\n", FG_BCYAN, RESET, sn->path);
+        }
+    else {
+        sn->failures++;
+        fprintf(stderr, "[%sError%s] | Snapshot %s not written\n", FG_RED, RESET, sn->path);
+        }
+    }
+
+// loop timer : reap a finished writer , fork the next one when it is due
+void snap_tick(snapshotter* sn, const snap_state* st, time_t now)
+    {
+    snap_reap(sn, false);
+    if (sn->path[0] == '\0' || sn->every <= 0 || sn->child > 0 || now < sn->next) {
+        return;
+        }
+    sn->next = now + sn->every;
+    pid_t pid = fork();
+    if (pid == 0) {
+        // _exit : the stdio buffers of the loop are not flushed a second time from here
+        _exit(snap_write(sn->path, st) < 0 ? 1 : 0);
+        }
+    if (pid < 0) {
+        sn->failures++;
+        fprintf(stderr, "[%sError%s] | Snapshot fork : %s\n", FG_RED, RESET, strerror(errno));
+        return;
+        }
+    sn->child = pid;
+    }
+
+// last snapshot at shutdown , written here
+void snap_final(snapshotter* sn, const snap_state* st)
+    {
+    if (sn->path[0] == '\0') {
+        return;
+        }
+    snap_reap(sn, true);
+    long long t0 = snap_now_us();
+    if (snap_write(sn->path, st) < 0) {
+        fprintf(stderr, "[%sError%s] | Snapshot %s : %s\n", FG_RED, RESET, sn->path, strerror(errno));
+        return;
+        }
+    printf("[%sSnap%s] %s written in %.1f ms (shutdown)\n", FG_BCYAN, RESET, sn->path, (double)(snap_now_us() - t0) / 1000.0);
+    }
+#endif
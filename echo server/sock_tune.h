@@ -0,0 +1,227 @@
+#ifndef SOCK_TUNE_H   // adaptive socket tuning : TCP_INFO samples -> buffer sizes , Nagle , notsent watermark
+#define SOCK_TUNE_H
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/*
+every connection is sampled every TUNE_INTERVAL_MS (TCP_INFO + bytes in the kernel send queue) ,
+the loop visits TUNE_PER_TICK slots per tick (round robin) so 1000 clients never make one long tick .
+class of a connection comes from what it does now :
+    chat : chat only , rtt under TUNE_FAR_RTT_US
+    far  : chat only , rtt over it (long path , needs a window of a full bdp to keep up)
+    bulk : blob upload or download running
+target per class (bdp = cwnd * mss , what one rtt can carry) :
+    chat : sndbuf 2 x bdp (32 KiB .. 256 KiB) , notsent_lowat 16 KiB  , nodelay on  , rcvbuf 64 KiB
+    far  : sndbuf 2 x bdp (64 KiB .. 4 MiB)   , notsent_lowat bdp     , nodelay on  , rcvbuf 64 KiB
+    bulk : sndbuf 2 x bdp (256 KiB .. 4 MiB)  , notsent_lowat 128 KiB , nodelay off , rcvbuf 1 MiB
+a small notsent_lowat keeps unsent chat in our out buffers instead of the kernel queue : there the
+control lane still goes first and the lane limits see a slow client (a socket is writable only below
+it) . a size is set again only when the target moved by more than 1/4 . the kernel doubles and caps
+SO_SNDBUF / SO_RCVBUF (net.core.wmem_max / rmem_max) , the value it really took is read back .
+effect : queue delay of a connection = bytes in the kernel send queue / (bdp / rtt) , per class
+avg / max with the stats next to the buffer bytes the class holds . "-T <file>" : every sample as csv
+*/
+#define TUNE_INTERVAL_MS 1000
+#define TUNE_PER_TICK    128
+#define TUNE_FAR_RTT_US  50000
+
+#ifndef SIOCOUTQNSD
+#define SIOCOUTQNSD 0x894B   // bytes not sent yet (linux/sockios.h)
+#endif
+
+enum tune_class {
+    TC_CHAT = 0,
+    TC_FAR,
+    TC_BULK,
+    TC_COUNT
+    };
+
+static const char* const tune_names[TC_COUNT] = { "chat", "far", "bulk" };
+
+typedef struct tune_target {
+    int sndbuf;
+    int rcvbuf;
+    int lowat;
+    int nodelay;
+    }tune_target;
+
+typedef struct tune_class_stats {
+    unsigned long samples;
+    long long rtt_sum_us;
+    long long qdelay_sum_us;
+    long long qdelay_max_us;
+    unsigned long long outq_sum;
+    unsigned long retrans;
+    unsigned long changes;      // setsockopt calls
+    }tune_class_stats;
+
+typedef struct sock_tuner {
+    int next;                         // round robin slot
+    FILE* csv;                        // -T <file>
+    // per slot
+    long long last_ms[FD_SETSIZE];    // 0 = sample on the next visit
+    int cls[FD_SETSIZE];
+    tune_target set[FD_SETSIZE];      // what we asked for , 0 = kernel default
+    int snd_eff[FD_SETSIZE];          // what the kernel took
+    int rcv_eff[FD_SETSIZE];
+    unsigned int retrans[FD_SETSIZE]; // tcpi_total_retrans of last sample
+    tune_class_stats st[TC_COUNT];
+    }sock_tuner;
+
+static int tune_clamp(long long v, int lo, int hi)
+    {
+    return (v < lo) ? lo : (v > hi) ? hi : (int)v;
+    }
+
+// new connection on slot i (sampled and tuned on the next visit)
+void tune_reset(sock_tuner* t, int i)
+    {
+    t->last_ms[i] = 0;
+    t->cls[i] = TC_CHAT;
+    memset(&t->set[i], 0, sizeof(t->set[i]));
+    t->set[i].nodelay = 1;    // tune_client_socket()
+    t->snd_eff[i] = t->rcv_eff[i] = 0;
+    t->retrans[i] = 0;
+    }
+
+/*
+csv of every sample (-T <path>)
+    return -1 : Error
+*/
+int tune_csv_open(sock_tuner* t, const char* path)
+    {
+    t->csv = fopen(path, "w");
+    if (!t->csv) {
+        fprintf(stderr, "[%sError%s] | Tune csv %s : %s\n", FG_RED, RESET, path, strerror(errno));
+        return -1;
+        }
+    fputs("t_ms,fd,class,rtt_us,rttvar_us,cwnd,mss,unacked,retrans,outq,notsent,sndbuf,rcvbuf,lowat,nodelay,qdelay_us\n", t->csv);
+    printf("%sTune : socket samples -> %s%s\n", FG_BGREEN, path, RESET);
+    return 0;
+    }
+
+static tune_target tune_pick(int cls, long long bdp, const tune_target* cur)
+    {
+    tune_target w = { 0, 64 * 1024, 16 * 1024, 1 };
+    if (cls == TC_CHAT) {
+        w.sndbuf = tune_clamp(2 * bdp, 32 * 1024, 256 * 1024);
+        }
+    else if (cls == TC_FAR) {
+        w.sndbuf = tune_clamp(2 * bdp, 64 * 1024, 4 << 20);
+        w.lowat = tune_clamp(bdp, 16 * 1024, 4 << 20);
+        }
+    else {
+        w.sndbuf = tune_clamp(2 * bdp, 256 * 1024, 4 << 20);
+        w.rcvbuf = 1 << 20;
+        w.lowat = 128 * 1024;
+        w.nodelay = 0;
+        }
+    // small moves are not worth a setsockopt
+    if (cur->sndbuf && w.sndbuf * 4 > cur->sndbuf * 3 && w.sndbuf * 4 < cur->sndbuf * 5) {
+        w.sndbuf = cur->sndbuf;
+        }
+    if (cur->lowat && w.lowat * 4 > cur->lowat * 3 && w.lowat * 4 < cur->lowat * 5) {
+        w.lowat = cur->lowat;
+        }
+    return w;
+    }
+
+static void tune_apply(sock_tuner* t, int i, int fd, const tune_target* w)
+    {
+    tune_target* cur = &t->set[i];
+    tune_class_stats* st = &t->st[t->cls[i]];
+    socklen_t len = sizeof(int);
+    if (w->sndbuf != cur->sndbuf && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &w->sndbuf, sizeof(int)) == 0) {
+        cur->sndbuf = w->sndbuf;
+        getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &t->snd_eff[i], &len);
+        st->changes++;
+        }
+    if (w->rcvbuf != cur->rcvbuf && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &w->rcvbuf, sizeof(int)) == 0) {
+        cur->rcvbuf = w->rcvbuf;
+        len = sizeof(int);
+        getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &t->rcv_eff[i], &len);
+        st->changes++;
+        }
+    if (w->lowat != cur->lowat && setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &w->lowat, sizeof(int)) == 0) {
+        cur->lowat = w->lowat;
+        st->changes++;
+        }
+    if (w->nodelay != cur->nodelay && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &w->nodelay, sizeof(int)) == 0) {
+        cur->nodelay = w->nodelay;
+        st->changes++;
+        }
+    }
+
+/*
+sample connection of slot i and move its socket to the target of its class
+bulk = a blob upload / download is running on it
+*/
+void tune_slot(sock_tuner* t, int i, int fd, bool bulk, long long now_ms)
+    {
+    t->last_ms[i] = now_ms;
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+        return;
+        }
+    int outq = 0, notsent = 0;
+    ioctl(fd, TIOCOUTQ, &outq);
+    ioctl(fd, SIOCOUTQNSD, &notsent);
+    long long bdp = (long long)ti.tcpi_snd_cwnd * ti.tcpi_snd_mss;
+    t->cls[i] = bulk ? TC_BULK : (ti.tcpi_rtt > TUNE_FAR_RTT_US) ? TC_FAR : TC_CHAT;
+    // kernel queue drains at about one bdp per rtt
+    long long qdelay = (bdp > 0) ? (long long)outq * ti.tcpi_rtt / bdp : 0;
+    unsigned int retrans = ti.tcpi_total_retrans - t->retrans[i];
+    t->retrans[i] = ti.tcpi_total_retrans;
+
+    tune_class_stats* st = &t->st[t->cls[i]];
+    st->samples++;
+    st->rtt_sum_us += ti.tcpi_rtt;
+    st->qdelay_sum_us += qdelay;
+    if (qdelay > st->qdelay_max_us) {
+        st->qdelay_max_us = qdelay;
+        }
+    st->outq_sum += (unsigned long long)outq;
+    st->retrans += retrans;
+
+    tune_target w = tune_pick(t->cls[i], bdp, &t->set[i]);
+    tune_apply(t, i, fd, &w);
+    if (t->csv) {
+        fprintf(t->csv, "%lld,%d,%s,%u,%u,%u,%u,%u,%u,%d,%d,%d,%d,%d,%d,%lld\n", now_ms, fd, tune_names[t->cls[i]],
+            ti.tcpi_rtt, ti.tcpi_rttvar, ti.tcpi_snd_cwnd, ti.tcpi_snd_mss, ti.tcpi_unacked, retrans,
+            outq, notsent, t->snd_eff[i], t->rcv_eff[i], t->set[i].lowat, t->set[i].nodelay, qdelay);
+        }
+    }
+
+// fds = fd per slot (-1 = none) , buffer bytes are what the kernel allows each class to hold
+void tune_report(sock_tuner* t, const int* fds)
+    {
+    int conns[TC_COUNT] = { 0 };
+    long long snd[TC_COUNT] = { 0 }, rcv[TC_COUNT] = { 0 };
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (fds[i] != -1 && t->last_ms[i] != 0) {
+            conns[t->cls[i]]++;
+            snd[t->cls[i]] += t->snd_eff[i];
+            rcv[t->cls[i]] += t->rcv_eff[i];
+            }
+        }
+    for (int c = 0;c < TC_COUNT;c++) {
+        tune_class_stats* st = &t->st[c];
+        if (conns[c] == 0 && st->samples == 0) {
+            continue;
+            }
+        printf("[%sTune%s] %-4s conns=%d sndbuf=%lldK rcvbuf=%lldK samples=%lu rtt avg=%lldus queue avg=%lluB delay avg=%lldus max=%lldus retrans=%lu setsockopt=%lu\n",
+            FG_BCYAN, RESET, tune_names[c], conns[c], snd[c] / 1024, rcv[c] / 1024, st->samples,
+            st->samples ? st->rtt_sum_us / (long long)st->samples : 0, st->samples ? st->outq_sum / st->samples : 0,
+            st->samples ? st->qdelay_sum_us / (long long)st->samples : 0, st->qdelay_max_us, st->retrans, st->changes);
+        memset(st, 0, sizeof(*st));
+        }
+    }
+#endif
@@ -0,0 +1,48 @@
+#ifndef STATS_H   // server counters , printed periodically
+#define STATS_H
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+
+#define STATS_INTERVAL 10  // seconds between two reports
+
+typedef struct server_stats {
+    unsigned long msgs_in;         // msgs read from clients
+    unsigned long msgs_invalid;    // dropped , not valid utf-8
+    unsigned long ctrl_dropped;    // dropped , line starts with MSG_SEPRATE but is no known request
+    unsigned long msgs_delivered;  // msg copies queued for recipients
+    unsigned long send_calls;      // send() syscalls on client sockets
+    unsigned long bytes_out;
+    unsigned long early_flushes;   // flushes before tick end (high water / latency cap)
+    unsigned long accepts;         // connections accepted
+    unsigned long accept_rejects;  // closed at once (no free slot / out of fds)
+    unsigned long accept_budget_hits;  // ticks which stopped accepting at ACCEPT_BUDGET (backlog was not empty)
+    unsigned long handshake_timeouts;
+    unsigned long hb_pings;        // PING frames queued on the control lane
+    unsigned long hb_timeouts;     // clients dropped for not answering
+    long long hb_rtt_max_us;       // worst PING -> PONG time (measured through the data backlog)
+    time_t last_report;
+    }server_stats;
+
+// return true when a report was printed (caller adds its own lines)
+bool stats_report(server_stats* st, time_t now)
+    {
+    if (now - st->last_report < STATS_INTERVAL) {
+        return false;
+        }
+    double per_msg = st->msgs_delivered ? (double)st->send_calls / (double)st->msgs_delivered : 0.0;
+    double secs = (double)(now - st->last_report);
+    printf("[%sStats%s] in=%lu delivered=%lu send()=%lu (%.2f per delivered msg) bytes_out=%lu early_flush=%lu invalid=%lu unknown_ctrl=%lu\n",
+        FG_BCYAN, RESET, st->msgs_in, st->msgs_delivered, st->send_calls, per_msg, st->bytes_out, st->early_flushes, st->msgs_invalid,
+        st->ctrl_dropped);
+    printf("[%sStats%s] accepts=%lu (%.1f conn/s) rejected=%lu accept_budget_hit=%lu handshake_timeout=%lu\n",
+        FG_BCYAN, RESET, st->accepts, st->accepts / secs, st->accept_rejects, st->accept_budget_hits, st->handshake_timeouts);
+    printf("[%sStats%s] heartbeat ping=%lu timeout=%lu rtt_max=%lldus\n",
+        FG_BCYAN, RESET, st->hb_pings, st->hb_timeouts, st->hb_rtt_max_us);
+    time_t keep = now;
+    memset(st, 0, sizeof(*st));
+    st->last_report = keep;
+    return true;
+    }
+#endif
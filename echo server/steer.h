@@ -0,0 +1,222 @@
+#ifndef STEER_H   // uuid affinity : a reconnecting uuid gets its home slot back , its session kept warm there
+#define STEER_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include "handshake.h"
+#include "log_index.h"
+
+/*
+one reactor owns every connection , what a uuid can keep is its slot (every per connection array is
+indexed by it) and the state behind the slot :
+    1. at accept the hello is normally in the socket already (TCP_DEFER_ACCEPT) , a MSG_PEEK of it gives
+       the uuid before a slot is picked . a uuid which had a slot gets it again when it is free
+    2. a uuid which left keeps its home reserved for STEER_KEEP_S , new uuids get other free slots as
+       long as there are any
+    3. its session is parked in the home : transcript FILE (with -Z the open zlog block) and the index
+       writer of the uuid (postings of the current segment in memory) . a reconnect from the same ip in
+       STEER_KEEP_S goes on with them : no mkdir / open / index reload , no segment write per reconnect
+a parked session is closed when it expires (sweep once a second) , when another client needs the slot
+or when the uuid shows up on another slot . at most STEER_PARK_MAX are parked (each holds fds)
+*/
+#define STEER_TABLE     4096   // uuid hash -> home slot , direct mapped (a collision only loses affinity)
+#define STEER_KEEP_S    60
+#define STEER_PARK_MAX  128
+
+typedef struct steer_table {
+    uint64_t key[STEER_TABLE];          // uuid hash , 0 = empty
+    int home[STEER_TABLE];
+    time_t last_sweep;
+    int parked_count;
+    // per slot
+    uint64_t owner[FD_SETSIZE];         // uuid hash of the last session on the slot , 0 = none
+    time_t keep_until[FD_SETSIZE];      // reserved for the owner until
+    bool parked[FD_SETSIZE];
+    FILE* file[FD_SETSIZE];             // parked session
+    log_index* idx[FD_SETSIZE];
+    int file_no[FD_SETSIZE];
+    long log_off[FD_SETSIZE];
+    uint32_t ip[FD_SETSIZE];
+    // counters since last report
+    unsigned long peeks;
+    unsigned long peek_uuids;           // uuid known at accept
+    unsigned long home_hits;            // got its home slot back
+    unsigned long home_busy;            // home slot was taken
+    unsigned long parks;
+    unsigned long resumes;
+    unsigned long releases;             // parked sessions closed
+    }steer_table;
+
+uint64_t steer_hash(const char* uuid)
+    {
+    uint64_t h = 1469598103934665603ULL;
+    for (const char* p = uuid;*p;p++) {
+        h = (h ^ (unsigned char)*p) * 1099511628211ULL;
+        }
+    return h | 1;
+    }
+
+// uuid hash of the hello waiting in the socket (not read) , 0 = not there yet / bad hello
+uint64_t steer_peek(steer_table* st, int fd)
+    {
+    char buf[HS_MSG_MAX + 1];
+    st->peeks++;
+    ssize_t n = recv(fd, buf, sizeof(buf) - 1, MSG_PEEK | MSG_DONTWAIT);
+    hs_hello hello;
+    if (n <= 0 || hs_decode_hello(buf, (size_t)n, &hello) < 0) {
+        return 0;
+        }
+    st->peek_uuids++;
+    return steer_hash(hello.uuid);
+    }
+
+// home slot of uuid hash h , -1 = none
+static int steer_home(const steer_table* st, uint64_t h)
+    {
+    int k = (int)(h & (STEER_TABLE - 1));
+    if (h == 0 || st->key[k] != h || st->owner[st->home[k]] != h) {
+        return -1;
+        }
+    return st->home[k];
+    }
+
+// close the session parked on slot i
+void steer_release(steer_table* st, int i)
+    {
+    if (!st->parked[i]) {
+        return;
+        }
+    fclose(st->file[i]);
+    log_index_close(st->idx[i]);
+    st->file[i] = NULL;
+    st->idx[i] = NULL;
+    st->parked[i] = false;
+    st->keep_until[i] = 0;
+    st->parked_count--;
+    st->releases++;
+    }
+
+/*
+slot for a new connection of uuid hash h (0 = not known yet) , fds = fd per slot (-1 = free)
+a parked session of another uuid on the picked slot is closed
+    return -1 : no free slot
+*/
+int steer_slot(steer_table* st, uint64_t h, const int* fds, time_t now)
+    {
+    int i = steer_home(st, h);
+    if (i >= 0 && fds[i] == -1) {
+        st->home_hits++;
+        return i;
+        }
+    if (i >= 0) {
+        st->home_busy++;
+        }
+    int reserved = -1;
+    for (i = 0;i < FD_SETSIZE;i++) {
+        if (fds[i] != -1) {
+            continue;
+            }
+        if (st->keep_until[i] <= now) {
+            break;
+            }
+        if (reserved == -1) {
+            reserved = i;
+            }
+        }
+    if (i == FD_SETSIZE) {
+        // only reserved slots left
+        i = reserved;
+        }
+    if (i >= 0 && st->owner[i] != h) {
+        steer_release(st, i);
+        }
+    return i;
+    }
+
+/*
+handshake of uuid hash h from ip on slot i : hands back the session parked there
+    return true  : *file .. *log_off are the parked session
+    return false : open a new one (a parked session of the uuid elsewhere is closed)
+*/
+bool steer_resume(steer_table* st, int i, uint64_t h, uint32_t ip, FILE** file, log_index** idx, int* file_no, long* log_off)
+    {
+    if (st->parked[i] && st->owner[i] == h && st->ip[i] == ip) {
+        *file = st->file[i];
+        *idx = st->idx[i];
+        *file_no = st->file_no[i];
+        *log_off = st->log_off[i];
+        st->file[i] = NULL;
+        st->idx[i] = NULL;
+        st->parked[i] = false;
+        st->parked_count--;
+        st->resumes++;
+        return true;
+        }
+    steer_release(st, i);
+    int j = steer_home(st, h);
+    if (j >= 0) {
+        steer_release(st, j);
+        }
+    return false;
+    }
+
+// slot i belongs to uuid hash h from now
+void steer_claim(steer_table* st, int i, uint64_t h)
+    {
+    int k = (int)(h & (STEER_TABLE - 1));
+    st->key[k] = h;
+    st->home[k] = i;
+    st->owner[i] = h;
+    st->keep_until[i] = 0;
+    }
+
+/*
+session of slot i ended , keep it for a reconnect of its owner
+    return false : not parked (table full / no owner) , the caller closes it
+*/
+bool steer_park(steer_table* st, int i, FILE* file, log_index* idx, int file_no, long log_off, uint32_t ip, time_t now)
+    {
+    if (st->owner[i] == 0 || !file || st->parked_count >= STEER_PARK_MAX) {
+        return false;
+        }
+    st->file[i] = file;
+    st->idx[i] = idx;
+    st->file_no[i] = file_no;
+    st->log_off[i] = log_off;
+    st->ip[i] = ip;
+    st->parked[i] = true;
+    st->keep_until[i] = now + STEER_KEEP_S;
+    st->parked_count++;
+    st->parks++;
+    return true;
+    }
+
+// close expired parked sessions (all of them : now = 0)
+void steer_sweep(steer_table* st, time_t now)
+    {
+    if (now != 0 && now == st->last_sweep) {
+        return;
+        }
+    st->last_sweep = now;
+    for (int i = 0;i < FD_SETSIZE && st->parked_count > 0;i++) {
+        if (st->parked[i] && (now == 0 || st->keep_until[i] <= now)) {
+            steer_release(st, i);
+            }
+        }
+    }
+
+void steer_report(steer_table* st)
+    {
+    if (st->peeks == 0 && st->parked_count == 0) {
+        return;
+        }
+    printf("[%sSteer%s] accepts=%lu uuid_at_accept=%lu home_hits=%lu home_busy=%lu parked=%d parks=%lu resumes=%lu released=%lu\n",
+        FG_BCYAN, RESET, st->peeks, st->peek_uuids, st->home_hits, st->home_busy, st->parked_count, st->parks,
+        st->resumes, st->releases);
+    st->peeks = st->peek_uuids = st->home_hits = st->home_busy = st->parks = st->resumes = st->releases = 0;
+    }
+#endif
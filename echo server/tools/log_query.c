@@ -0,0 +1,395 @@
+#include "../header.h"
+#include "../log_index.h"
+#include "../zlog.h"
+#include <sys/mman.h>
+#include <dirent.h>
+#include <ctype.h>
+
+/*
+query tool over the transcript index written by the server (see log_index.h)
+
+    ./log_query <client_files dir> <uuid> [-from T1] [-to T2] [-word W] [-limit N]
+        T1 / T2 : unix seconds or "YYYY-MM-DD HH:MM:SS" (local time)
+        W       : one term , same rules as the indexer (letters / digits , case insensitive)
+
+1. msg.idx is mmaped , [T1 , T2) becomes a record range [lo , hi) by binary search
+2. every terms_*.idx segment which overlaps [lo , hi) is mmaped , the term hash is found
+   by binary search and its postings are decoded (only this term is touched)
+   records no segment covers are checked by text : the ones still in server memory , and any
+   range whose segment was never written (server killed before the writer closed)
+3. matched records are read from the cli_N.txt logs with pread , or from cli_N.zlog (server -Z)
+   where only the block of the record is inflated (seek points in cli_N.zidx , see zlog.h)
+*/
+#define QUERY_FILES_OPEN 64
+
+typedef struct mapped_file {
+    void* base;
+    size_t size;
+    }mapped_file;
+
+bool map_file(const char* path, mapped_file* m)
+    {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+        }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+        }
+    m->size = (size_t)st.st_size;
+    m->base = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    return m->base != MAP_FAILED;
+    }
+
+void unmap_file(mapped_file* m)
+    {
+    if (m->base && m->base != MAP_FAILED) {
+        munmap(m->base, m->size);
+        }
+    m->base = NULL;
+    }
+
+// first record with ts_us >= ts
+uint64_t lower_bound_ts(const log_record* r, uint64_t n, int64_t ts)
+    {
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (r[mid].ts_us < ts) {
+            lo = mid + 1;
+            }
+        else {
+            hi = mid;
+            }
+        }
+    return lo;
+    }
+
+int64_t parse_time(const char* s)
+    {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+    if (end && *end == '\0') {
+        tm.tm_isdst = -1;
+        return (int64_t)mktime(&tm) * 1000000;
+        }
+    char* e;
+    long long v = strtoll(s, &e, 10);
+    if (*e != '\0') {
+        fprintf(stderr, "[%sError%s] | Bad time : %s\n", FG_RED, RESET, s);
+        exit(2);
+        }
+    return (int64_t)v * 1000000;
+    }
+
+// collect the term hash of the query word
+static void take_hash(void* arg, uint64_t h)
+    {
+    uint64_t* out = (uint64_t*)arg;
+    if (*out == 0) {
+        *out = h;
+        }
+    }
+
+// records [first , last] of one terms segment
+typedef struct rec_range {
+    uint64_t first;
+    uint64_t last;
+    }rec_range;
+
+// append v to a growing array , false when out of memory
+static bool push_u64(uint64_t** arr, size_t* n, size_t* cap, uint64_t v)
+    {
+    if (*n == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 256;
+        uint64_t* t = (uint64_t*)realloc(*arr, ncap * sizeof(uint64_t));
+        if (!t) {
+            return false;
+            }
+        *arr = t;
+        *cap = ncap;
+        }
+    (*arr)[(*n)++] = v;
+    return true;
+    }
+
+/*
+in range record numbers of the word (caller frees)
+    segs : record ranges of every valid segment (caller frees) , records outside of them have no postings
+*/
+uint64_t* word_matches(const char* dir, uint64_t hash, uint64_t lo, uint64_t hi, size_t* count, size_t* cap_out, rec_range** segs, size_t* n_segs)
+    {
+    size_t cap = 256, n = 0, seg_cap = 0;
+    uint64_t* out = (uint64_t*)malloc(cap * sizeof(uint64_t));
+    *segs = NULL;
+    *n_segs = 0;
+    *count = 0;
+    *cap_out = out ? cap : 0;
+    DIR* d = opendir(dir);
+    if (!d || !out) {
+        if (d) closedir(d);
+        return out;
+        }
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, "terms_", 6) != 0) {
+            continue;
+            }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        mapped_file m = { 0 };
+        if (!map_file(path, &m) || m.size < sizeof(log_seg_header)) {
+            unmap_file(&m);
+            continue;
+            }
+        const log_seg_header* h = (const log_seg_header*)m.base;
+        size_t need = sizeof(*h) + (size_t)h->n_terms * sizeof(log_term_entry) + h->postings_len;
+        // broken files cover nothing , their records are checked by text
+        if (h->magic != LOG_SEG_MAGIC || m.size < need || h->last_rec < h->first_rec) {
+            unmap_file(&m);
+            continue;
+            }
+        if (*n_segs == seg_cap) {
+            seg_cap = seg_cap ? seg_cap * 2 : 16;
+            rec_range* t = (rec_range*)realloc(*segs, seg_cap * sizeof(rec_range));
+            if (!t) {
+                unmap_file(&m);
+                break;
+                }
+            *segs = t;
+            }
+        (*segs)[(*n_segs)++] = (rec_range){ h->first_rec, h->last_rec };
+        // skip segments outside the time range
+        if (h->last_rec < lo || h->first_rec >= hi) {
+            unmap_file(&m);
+            continue;
+            }
+        const log_term_entry* ents = (const log_term_entry*)(h + 1);
+        const uint8_t* postings = (const uint8_t*)(ents + h->n_terms);
+        uint32_t a = 0, b = h->n_terms;
+        while (a < b) {
+            uint32_t mid = a + (b - a) / 2;
+            if (ents[mid].hash < hash) {
+                a = mid + 1;
+                }
+            else {
+                b = mid;
+                }
+            }
+        if (a < h->n_terms && ents[a].hash == hash && (uint64_t)ents[a].off + ents[a].len <= h->postings_len) {
+            const uint8_t* p = postings + ents[a].off;
+            size_t left = ents[a].len;
+            uint64_t rec = h->first_rec;
+            while (left > 0) {
+                uint64_t delta;
+                size_t used = log_varint_get(p, left, &delta);
+                if (used == 0) {
+                    break;
+                    }
+                p += used;
+                left -= used;
+                rec += delta;
+                if (rec >= hi) {
+                    break;
+                    }
+                if (rec < lo) {
+                    continue;
+                    }
+                if (!push_u64(&out, &n, &cap, rec)) {
+                    break;
+                    }
+                }
+            }
+        unmap_file(&m);
+        }
+    closedir(d);
+    *count = n;
+    *cap_out = cap;
+    return out;
+    }
+
+static int cmp_u64(const void* a, const void* b)
+    {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+    }
+
+static int cmp_range(const void* a, const void* b)
+    {
+    const rec_range* x = (const rec_range*)a;
+    const rec_range* y = (const rec_range*)b;
+    return (x->first > y->first) - (x->first < y->first);
+    }
+
+// small cache of open cli_N.txt / cli_N.zlog files
+typedef struct log_file {
+    uint32_t ip;
+    uint32_t file_no;
+    int fd;
+    zlog_reader* zr;
+    }log_file;
+
+static void log_file_close(log_file* lf)
+    {
+    if (lf->fd >= 0) {
+        close(lf->fd);
+        }
+    zlog_reader_close(lf->zr);
+    lf->fd = -1;
+    lf->zr = NULL;
+    }
+
+log_file* log_open(log_file* cache, const char* dir, uint32_t ip, uint32_t file_no)
+    {
+    int slot = (int)((ip ^ file_no) % QUERY_FILES_OPEN);
+    log_file* lf = &cache[slot];
+    if ((lf->fd >= 0 || lf->zr) && lf->ip == ip && lf->file_no == file_no) {
+        return lf;
+        }
+    log_file_close(lf);
+    char ip_s[INET_ADDRSTRLEN], path[512];
+    struct in_addr a = { .s_addr = ip };
+    inet_ntop(AF_INET, &a, ip_s, sizeof(ip_s));
+    snprintf(path, sizeof(path), "%s/%s/cli_%u.txt", dir, ip_s, file_no);
+    lf->ip = ip;
+    lf->file_no = file_no;
+    lf->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (lf->fd < 0) {
+        snprintf(path, sizeof(path), "%s/%s/cli_%u", dir, ip_s, file_no);
+        lf->zr = zlog_reader_open(path);
+        }
+    return lf;
+    }
+
+// whole word , case insensitive check (removes hash collisions)
+bool has_word(const char* text, size_t n, const char* word)
+    {
+    size_t w = strlen(word);
+    for (size_t k = 0;k + w <= n;k++) {
+        if (strncasecmp(text + k, word, w) == 0) {
+            bool left_ok = (k == 0) || !isalnum((unsigned char)text[k - 1]);
+            bool right_ok = (k + w == n) || !isalnum((unsigned char)text[k + w]);
+            if (left_ok && right_ok) {
+                return true;
+                }
+            }
+        }
+    return false;
+    }
+
+// return 1 if the record was printed
+int print_record(log_file* cache, const char* dir, const log_record* r, const char* word)
+    {
+    char text[4096];
+    size_t want = (r->len < sizeof(text)) ? r->len : sizeof(text);
+    log_file* lf = log_open(cache, dir, r->ip, r->file_no);
+    ssize_t got = (lf->fd >= 0) ? pread(lf->fd, text, want, (off_t)r->offset) :
+        lf->zr ? zlog_pread(lf->zr, text, want, r->offset) : -1;
+    // log not flushed yet / removed
+    if (got <= 0) {
+        return 0;
+        }
+    if (word && !has_word(text, (size_t)got, word)) {
+        return 0;
+        }
+    while (got > 0 && (text[got - 1] == '\n' || text[got - 1] == '\r')) {
+        got--;
+        }
+    time_t sec = (time_t)(r->ts_us / 1000000);
+    struct tm tm;
+    char when[32];
+    localtime_r(&sec, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s%s.%06lld%s  %.*s\n", FG_BBLUE, when, (long long)(r->ts_us % 1000000), RESET, (int)got, text);
+    return 1;
+    }
+
+int main(int argc, char* argv[])
+    {
+    if (argc < 3) {
+        fprintf(stderr, "%sUsage : %s <client_files dir> <uuid> [-from T1] [-to T2] [-word W] [-limit N]%s\n", FG_RED, argv[0], RESET);
+        return 2;
+        }
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    const char* word = NULL;
+    long limit = -1;
+    for (int k = 3;k + 1 < argc;k += 2) {
+        if (strcmp(argv[k], "-from") == 0) from = parse_time(argv[k + 1]);
+        else if (strcmp(argv[k], "-to") == 0) to = parse_time(argv[k + 1]);
+        else if (strcmp(argv[k], "-word") == 0) word = argv[k + 1];
+        else if (strcmp(argv[k], "-limit") == 0) limit = atol(argv[k + 1]);
+        else {
+            fprintf(stderr, "[%sError%s] | Unknown option %s\n", FG_RED, RESET, argv[k]);
+            return 2;
+            }
+        }
+    if (strchr(argv[2], '/')) {
+        fprintf(stderr, "[%sError%s] | Bad uuid\n", FG_RED, RESET);
+        return 2;
+        }
+    char dir[512], path[600];
+    snprintf(dir, sizeof(dir), "%s/%s", argv[1], argv[2]);
+    snprintf(path, sizeof(path), "%s/%s", dir, LOG_INDEX_FILE);
+
+    mapped_file idx = { 0 };
+    if (!map_file(path, &idx)) {
+        fprintf(stderr, "[%sError%s] | No index for uuid %s\n", FG_RED, RESET, argv[2]);
+        return 1;
+        }
+    const log_record* recs = (const log_record*)idx.base;
+    uint64_t n_recs = idx.size / sizeof(log_record);
+    uint64_t lo = lower_bound_ts(recs, n_recs, from);
+    uint64_t hi = (to == INT64_MAX) ? n_recs : lower_bound_ts(recs, n_recs, to);
+
+    log_file cache[QUERY_FILES_OPEN];
+    for (int k = 0;k < QUERY_FILES_OPEN;k++) {
+        cache[k].fd = -1;
+        cache[k].zr = NULL;
+        }
+    long shown = 0;
+    if (word) {
+        uint64_t hash = 0;
+        log_terms(word, strlen(word), take_hash, &hash);
+        if (hash == 0) {
+            fprintf(stderr, "[%sError%s] | Word must have %d..%d letters / digits\n", FG_RED, RESET, LOG_TERM_MIN, LOG_TERM_MAX);
+            return 2;
+            }
+        size_t count, cap, n_segs;
+        rec_range* segs;
+        uint64_t* m = word_matches(dir, hash, lo, hi, &count, &cap, &segs, &n_segs);
+        // every record of [lo , hi) no segment covers is a candidate too (print_record checks the text)
+        qsort(segs, n_segs, sizeof(rec_range), cmp_range);
+        uint64_t r = lo;
+        for (size_t s = 0;s <= n_segs && r < hi && m;s++) {
+            uint64_t gap_end = (s < n_segs && segs[s].first < hi) ? segs[s].first : hi;
+            for (;r < gap_end;r++) {
+                if (!push_u64(&m, &count, &cap, r)) {
+                    break;
+                    }
+                }
+            if (s < n_segs && segs[s].last + 1 > r) {
+                r = segs[s].last + 1;
+                }
+            }
+        qsort(m, count, sizeof(uint64_t), cmp_u64);
+        for (size_t k = 0;k < count && (limit < 0 || shown < limit);k++) {
+            shown += print_record(cache, dir, &recs[m[k]], word);
+            }
+        free(m);
+        free(segs);
+        }
+    else {
+        for (uint64_t r = lo;r < hi && (limit < 0 || shown < limit);r++) {
+            shown += print_record(cache, dir, &recs[r], NULL);
+            }
+        }
+    for (int k = 0;k < QUERY_FILES_OPEN;k++) {
+        log_file_close(&cache[k]);
+        }
+    unmap_file(&idx);
+    return 0;
+    }
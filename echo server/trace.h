@@ -0,0 +1,181 @@
+#ifndef TRACE_H   // traffic trace : connection lifecycle , msg sizes and fan out , recorded by the server (-R)
+#define TRACE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/select.h>
+
+/*
+server <port> -R <file> writes one record per event (no msg text , only sizes) :
+    magic "CHTRACE1" , then records :
+        type (1 byte) , dt_us (varint , since the previous record) , conn (varint)
+        TR_MSG  : size (varint , bytes with '\n') , fanout (varint , recipients)
+        TR_BLOB : size (varint)
+    conn is a trace id (1 , 2 ...) , not the slot , a reused slot is a new connection
+varints are 7 bits per byte , low first , so a msg record of a busy room is 4..6 bytes .
+records go through stdio , the loop fflush() of the disk phase writes them out
+bench/replay.c reads the file and drives a test server with the same traffic
+*/
+#define TRACE_MAGIC     "CHTRACE1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_REC_MAX   32
+
+enum trace_type {
+    TR_OPEN = 1,    // handshake done
+    TR_CLOSE,       // connection dropped
+    TR_MSG,         // chat line delivered to the room
+    TR_BLOB         // blob upload finished
+    };
+
+typedef struct trace_rec {
+    int type;
+    unsigned long long t_us;   // since the first record
+    unsigned long conn;
+    unsigned long size;
+    unsigned long fanout;
+    }trace_rec;
+
+typedef struct trace_writer {
+    FILE* f;                       // NULL = not recording
+    long long last_us;
+    unsigned long next_conn;
+    unsigned long conn_of[FD_SETSIZE];   // trace id of the connection on the slot , 0 = none
+    unsigned long records;
+    unsigned long long bytes;
+    }trace_writer;
+
+static long long trace_now_us()
+    {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+static size_t trace_put_varint(uint8_t* p, unsigned long long v)
+    {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+        }
+    p[n++] = (uint8_t)v;
+    return n;
+    }
+
+/*
+Meanings of return in trace_get_varint :
+    return false : Error [end of file inside the number / too long]
+    return true  : Success
+*/
+static bool trace_get_varint(FILE* f, unsigned long long* v)
+    {
+    *v = 0;
+    for (int shift = 0;shift < 64;shift += 7) {
+        int c = getc(f);
+        if (c == EOF) {
+            return false;
+            }
+        *v |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+            }
+        }
+    return false;
+    }
+
+/*
+start recording to path (truncated)
+    return -1 : Error
+*/
+int trace_open(trace_writer* tw, const char* path)
+    {
+    memset(tw, 0, sizeof(*tw));
+    tw->f = fopen(path, "wb");
+    if (!tw->f) {
+        fprintf(stderr, "[%sError%s] | Trace %s : %s\n", FG_RED, RESET, path, strerror(errno));
+        return -1;
+        }
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, tw->f);
+    tw->last_us = trace_now_us();
+    tw->bytes = TRACE_MAGIC_LEN;
+    printf("%sTrace : recording connections and msg sizes -> %s%s\n", FG_BGREEN, path, RESET);
+    return 0;
+    }
+
+// one event of slot i (TR_OPEN gives the slot a new trace id)
+void trace_event(trace_writer* tw, int type, int i, unsigned long size, unsigned long fanout)
+    {
+    if (!tw->f) {
+        return;
+        }
+    if (type == TR_OPEN) {
+        tw->conn_of[i] = ++tw->next_conn;
+        }
+    unsigned long conn = tw->conn_of[i];
+    if (conn == 0) {
+        return;
+        }
+    long long now = trace_now_us();
+    uint8_t rec[TRACE_REC_MAX];
+    size_t n = 0;
+    rec[n++] = (uint8_t)type;
+    n += trace_put_varint(rec + n, (unsigned long long)(now - tw->last_us));
+    n += trace_put_varint(rec + n, conn);
+    if (type == TR_MSG || type == TR_BLOB) {
+        n += trace_put_varint(rec + n, size);
+        }
+    if (type == TR_MSG) {
+        n += trace_put_varint(rec + n, fanout);
+        }
+    fwrite(rec, 1, n, tw->f);
+    tw->last_us = now;
+    tw->records++;
+    tw->bytes += n;
+    if (type == TR_CLOSE) {
+        tw->conn_of[i] = 0;
+        }
+    }
+
+/*
+next record of a trace file (after trace_check_magic) , t_us is carried in r between calls
+    return false : end of file (or a cut record)
+*/
+bool trace_read(FILE* f, trace_rec* r)
+    {
+    int type = getc(f);
+    unsigned long long dt, conn, size = 0, fanout = 0;
+    if (type == EOF || type < TR_OPEN || type > TR_BLOB ||
+        !trace_get_varint(f, &dt) || !trace_get_varint(f, &conn)) {
+        return false;
+        }
+    if ((type == TR_MSG || type == TR_BLOB) && !trace_get_varint(f, &size)) {
+        return false;
+        }
+    if (type == TR_MSG && !trace_get_varint(f, &fanout)) {
+        return false;
+        }
+    r->type = type;
+    r->t_us += dt;
+    r->conn = (unsigned long)conn;
+    r->size = (unsigned long)size;
+    r->fanout = (unsigned long)fanout;
+    return true;
+    }
+
+bool trace_check_magic(FILE* f)
+    {
+    char magic[TRACE_MAGIC_LEN];
+    return fread(magic, 1, TRACE_MAGIC_LEN, f) == TRACE_MAGIC_LEN && memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0;
+    }
+
+void trace_report(trace_writer* tw)
+    {
+    if (!tw->f) {
+        return;
+        }
+    printf("[%sTrace%s] records=%lu bytes=%llu connections=%lu\n", FG_BCYAN, RESET, tw->records, tw->bytes, tw->next_conn);
+    }
+#endif
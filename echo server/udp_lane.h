@@ -0,0 +1,318 @@
+#ifndef UDP_LANE_H   // datagram lane : throwaway events (typing , presence) , coalesced per tick , sendmmsg fan out
+#define UDP_LANE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+events never wait behind chat and are never sent again , a lost one is replaced by the next .
+server <port> -U binds a UDP socket on the port of the TCP listener :
+    client -> tcp  "!?!?UDP\n"                               after the handshake , asks for a token
+    server -> ctrl "!?!?UTOK <port> <id> <token>\n"          id = member id (roster.h) , 64 random bits
+                                                             (port and token 0 without -U)
+    client -> udp  "!?!?UEV <id> <token> <type> [<text>]\n"  one event , type 0 = hello (address only)
+    server -> udp  "!?!?UACK\n" for a new address , then the events of every tick :
+                   "!?!?EV <from id> <type> <text>\n" lines , as many as fit in UDP_DGRAM_MAX
+a datagram is taken only with the token of the member and from the ip of its TCP connection .
+one tick keeps only the newest event per (sender , type) , the lines of the tick are cut into
+datagrams once and the same datagrams go to every registered client (sendmmsg , UDP_BATCH per call) ,
+a client skips its own id . fallback (no -U , or no UACK) : the client sends "!?!?EV <type> <text>\n"
+on TCP and gets the same EV lines on its control lane , skipped while that lane has UDP_TCP_BACKLOG
+bytes queued (an event is never worth a slow client drop)
+*/
+#define UDP_TYPES        8                // event types 1 .. 7 (0 = hello)
+#define UDP_TEXT_MAX     96
+#define UDP_DGRAM_MAX    1200             // no ip fragments on any path
+#define UDP_BATCH        64               // datagrams per recvmmsg / sendmmsg
+#define UDP_READ_BATCHES 4                // recvmmsg calls per tick
+#define UDP_EVENTS_MAX   1024             // events of one tick , more are lost (counted)
+#define UDP_DGRAMS_MAX   128              // datagrams of one tick
+#define UDP_TCP_BACKLOG  (16 * 1024)
+#define UDP_LINE_MAX     (UDP_TEXT_MAX + 64)
+
+enum udp_type {
+    UE_HELLO = 0,
+    UE_TYPING,
+    UE_PRESENCE
+    };
+
+typedef struct udp_event {
+    uint32_t from;
+    uint8_t type;
+    uint8_t len;
+    char text[UDP_TEXT_MAX];
+    }udp_event;
+
+typedef struct udp_lane {
+    int fd;                                // -1 = no UDP , events go over TCP only
+    unsigned short port;
+    // per slot
+    bool want[FD_SETSIZE];                 // asked for events (sent UDP)
+    uint64_t token[FD_SETSIZE];
+    struct sockaddr_in addr[FD_SETSIZE];   // sin_port 0 = no UDP path (yet)
+    int16_t pend[FD_SETSIZE][UDP_TYPES];   // 1 + index in ev of the event of (slot , type) , 0 = none
+    // events of the current tick
+    udp_event ev[UDP_EVENTS_MAX];
+    int ev_slot[UDP_EVENTS_MAX];
+    int ev_count;
+    // datagrams of the current tick (udp_batch)
+    char dgram[UDP_DGRAMS_MAX][UDP_DGRAM_MAX];
+    size_t dgram_len[UDP_DGRAMS_MAX];
+    int dgram_count;
+    // receive batch
+    char rx[UDP_BATCH][UDP_DGRAM_MAX];
+    struct sockaddr_in rx_from[UDP_BATCH];
+    struct mmsghdr rx_msg[UDP_BATCH];
+    struct iovec rx_iov[UDP_BATCH];
+    // counters since last report
+    unsigned long dgrams_in;
+    unsigned long bad_in;
+    unsigned long events_in;
+    unsigned long tcp_events_in;
+    unsigned long coalesced;
+    unsigned long lost;
+    unsigned long dgrams_out;
+    unsigned long sendmmsg_calls;
+    unsigned long send_drops;
+    unsigned long tcp_batches;
+    unsigned long tcp_skipped;
+    }udp_lane;
+
+/*
+UDP socket on port (same number as the TCP listener)
+    return -1 : Error
+*/
+int udp_open(udp_lane* u, uint16_t port)
+    {
+    u->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (u->fd < 0) {
+        fprintf(stderr, "[%sError%s] | UDP socket : %s\n", FG_RED, RESET, strerror(errno));
+        return -1;
+        }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    int rcv = 1 << 20;
+    setsockopt(u->fd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv));
+    if (bind(u->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "[%sError%s] | UDP bind %u : %s\n", FG_RED, RESET, (unsigned)port, strerror(errno));
+        close(u->fd);
+        u->fd = -1;
+        return -1;
+        }
+    u->port = port;
+    for (int k = 0;k < UDP_BATCH;k++) {
+        u->rx_iov[k] = (struct iovec){ u->rx[k], UDP_DGRAM_MAX };
+        }
+    printf("%sUDP : event lane on port %u (typing , presence)%s\n", FG_BGREEN, (unsigned)port, RESET);
+    return 0;
+    }
+
+/*
+slot i asked for events , a new token when the UDP lane is on
+    return 0 : no UDP (events over TCP) , else the token
+*/
+uint64_t udp_want(udp_lane* u, int i)
+    {
+    u->want[i] = true;
+    u->addr[i].sin_port = 0;
+    if (u->fd < 0) {
+        return 0;
+        }
+    uint64_t t = 0;
+    while (t == 0) {
+        if (getrandom(&t, sizeof(t), 0) != (ssize_t)sizeof(t)) {
+            t = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+            }
+        }
+    u->token[i] = t;
+    return t;
+    }
+
+// slot i is gone , its events of this tick still go out
+void udp_forget(udp_lane* u, int i)
+    {
+    u->want[i] = false;
+    u->token[i] = 0;
+    u->addr[i].sin_port = 0;
+    }
+
+// event of slot i (member id from) , only the newest one per (slot , type) of a tick is kept
+void udp_post(udp_lane* u, int i, uint32_t from, int type, const char* text, size_t len)
+    {
+    if (type <= UE_HELLO || type >= UDP_TYPES) {
+        return;
+        }
+    int k = u->pend[i][type] - 1;
+    if (k >= 0) {
+        u->coalesced++;
+        }
+    else if (u->ev_count == UDP_EVENTS_MAX) {
+        u->lost++;
+        return;
+        }
+    else {
+        k = u->ev_count++;
+        u->pend[i][type] = (int16_t)(k + 1);
+        u->ev_slot[k] = i;
+        }
+    udp_event* e = &u->ev[k];
+    e->from = from;
+    e->type = (uint8_t)type;
+    e->len = (uint8_t)((len < UDP_TEXT_MAX) ? len : UDP_TEXT_MAX);
+    // one line per event , whatever the sender put in
+    for (int c = 0;c < e->len;c++) {
+        e->text[c] = ((unsigned char)text[c] < ' ') ? ' ' : text[c];
+        }
+    }
+
+/*
+events of the tick -> EV lines packed into datagrams (whole lines only) , the event table is emptied
+    return : datagrams made
+*/
+int udp_batch(udp_lane* u)
+    {
+    u->dgram_count = 0;
+    for (int k = 0;k < u->ev_count;k++) {
+        u->pend[u->ev_slot[k]][u->ev[k].type] = 0;
+        }
+    for (int k = 0;k < u->ev_count;k++) {
+        udp_event* e = &u->ev[k];
+        char line[UDP_LINE_MAX];
+        int len = snprintf(line, sizeof(line), "!?!?EV %x %d %.*s\n", e->from, e->type, (int)e->len, e->text);
+        int d = u->dgram_count - 1;
+        if (d < 0 || u->dgram_len[d] + (size_t)len > UDP_DGRAM_MAX) {
+            if (u->dgram_count == UDP_DGRAMS_MAX) {
+                u->lost += (unsigned long)(u->ev_count - k);
+                break;
+                }
+            d = u->dgram_count++;
+            u->dgram_len[d] = 0;
+            }
+        memcpy(u->dgram[d] + u->dgram_len[d], line, (size_t)len);
+        u->dgram_len[d] += (size_t)len;
+        }
+    u->ev_count = 0;
+    return u->dgram_count;
+    }
+
+// n datagrams with one sendmmsg (more calls only for a partial send) , a full socket buffer drops the rest
+static void udp_send_batch(udp_lane* u, struct mmsghdr* msg, int n)
+    {
+    int sent = 0;
+    while (sent < n) {
+        int r = sendmmsg(u->fd, msg + sent, (unsigned int)(n - sent), 0);
+        u->sendmmsg_calls++;
+        if (r < 0 && errno == EINTR) {
+            continue;
+            }
+        if (r <= 0) {
+            break;
+            }
+        sent += r;
+        }
+    u->dgrams_out += (unsigned long)sent;
+    u->send_drops += (unsigned long)(n - sent);
+    }
+
+// datagrams of the tick to every slot with a UDP path , UDP_BATCH per sendmmsg
+void udp_fanout(udp_lane* u)
+    {
+    static struct mmsghdr msg[UDP_BATCH];
+    static struct iovec iov[UDP_BATCH];
+    int n = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        if (u->addr[i].sin_port == 0) {
+            continue;
+            }
+        for (int d = 0;d < u->dgram_count;d++) {
+            if (n == UDP_BATCH) {
+                udp_send_batch(u, msg, n);
+                n = 0;
+                }
+            iov[n] = (struct iovec){ u->dgram[d], u->dgram_len[d] };
+            memset(&msg[n], 0, sizeof(msg[n]));
+            msg[n].msg_hdr.msg_name = &u->addr[i];
+            msg[n].msg_hdr.msg_namelen = sizeof(u->addr[i]);
+            msg[n].msg_hdr.msg_iov = &iov[n];
+            msg[n].msg_hdr.msg_iovlen = 1;
+            n++;
+            }
+        }
+    if (n > 0) {
+        udp_send_batch(u, msg, n);
+        }
+    }
+
+/*
+one recvmmsg into rx[] / rx_from[]
+    return : datagrams received (0 = none waiting)
+*/
+int udp_recv_batch(udp_lane* u)
+    {
+    for (int k = 0;k < UDP_BATCH;k++) {
+        memset(&u->rx_msg[k].msg_hdr, 0, sizeof(u->rx_msg[k].msg_hdr));
+        u->rx_msg[k].msg_hdr.msg_name = &u->rx_from[k];
+        u->rx_msg[k].msg_hdr.msg_namelen = sizeof(u->rx_from[k]);
+        u->rx_msg[k].msg_hdr.msg_iov = &u->rx_iov[k];
+        u->rx_msg[k].msg_hdr.msg_iovlen = 1;
+        }
+    int r = recvmmsg(u->fd, u->rx_msg, UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (r <= 0) {
+        return 0;
+        }
+    u->dgrams_in += (unsigned long)r;
+    return r;
+    }
+
+/*
+"!?!?UEV <id> <token> <type> [<text>]\n" of rx[k]
+    return false : not a valid event datagram
+*/
+bool udp_parse(udp_lane* u, int k, uint32_t* id, uint64_t* token, int* type, const char** text, size_t* len)
+    {
+    size_t n = u->rx_msg[k].msg_len;
+    char* d = u->rx[k];
+    if (n < 10 || n >= UDP_DGRAM_MAX || memcmp(d, "!?!?UEV ", 8) != 0 || d[n - 1] != '\n') {
+        return false;
+        }
+    d[n - 1] = '\0';
+    unsigned int i;
+    unsigned long long t;
+    int pos = 0;
+    if (sscanf(d, "!?!?UEV %x %llx %d%n", &i, &t, type, &pos) != 3) {
+        return false;
+        }
+    *id = i;
+    *token = t;
+    *text = d + pos + (d[pos] == ' ');
+    *len = strlen(*text);
+    return true;
+    }
+
+void udp_report(udp_lane* u)
+    {
+    if (u->fd < 0 && u->tcp_events_in == 0) {
+        return;
+        }
+    int paths = 0, wants = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        paths += (u->addr[i].sin_port != 0);
+        wants += u->want[i];
+        }
+    printf("[%sUdp%s] clients=%d udp_paths=%d dgrams_in=%lu bad=%lu events udp=%lu tcp=%lu coalesced=%lu lost=%lu dgrams_out=%lu sendmmsg=%lu dropped=%lu tcp_batches=%lu tcp_skipped=%lu\n",
+        FG_BCYAN, RESET, wants, paths, u->dgrams_in, u->bad_in, u->events_in, u->tcp_events_in, u->coalesced, u->lost,
+        u->dgrams_out, u->sendmmsg_calls, u->send_drops, u->tcp_batches, u->tcp_skipped);
+    u->dgrams_in = u->bad_in = u->events_in = u->tcp_events_in = u->coalesced = u->lost = 0;
+    u->dgrams_out = u->sendmmsg_calls = u->send_drops = u->tcp_batches = u->tcp_skipped = 0;
+    }
+#endif
@@ -0,0 +1,303 @@
+#ifndef ZLOG_H   // block compressed transcripts with seek points (server -Z , tools/log_query)
+#define ZLOG_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*
+with -Z a transcript is client_files/<uuid>/<ip>/cli_N.zlog instead of cli_N.txt :
+    cli_N.zlog : blocks , each one zlib stream of up to ZLOG_BLOCK raw bytes (decoded alone)
+    cli_N.zidx : one zlog_seek per block , the seek points
+offsets in msg.idx stay raw offsets (the bytes cli_N.txt would have) , a reader finds the block by
+binary search in cli_N.zidx and inflates only that block (zlog_pread) .
+the server writes through a stdio FILE (fopencookie) , fwrite / fprintf of the transcript stay as they are :
+a block is written when it holds ZLOG_BLOCK bytes , when it is older than ZLOG_FLUSH_S at a write
+(the loop fflush()es every tick) and at fclose . a crash loses at most the open block , a torn
+block at the end of the file is cut off at the next open
+*/
+#define ZLOG_BLOCK   (64 * 1024)
+#define ZLOG_FLUSH_S 5
+#define ZLOG_LEVEL   Z_DEFAULT_COMPRESSION
+
+typedef struct zlog_seek {
+    uint64_t raw_off;    // first raw byte of the block
+    uint64_t file_off;   // block in cli_N.zlog
+    uint32_t raw_len;
+    uint32_t comp_len;
+    }zlog_seek;
+
+typedef struct zlog_stats {
+    unsigned long blocks;
+    unsigned long long raw_bytes;
+    unsigned long long comp_bytes;
+    }zlog_stats;
+
+zlog_stats zlog_st;
+
+typedef struct zlog_writer {
+    int log_fd;
+    int idx_fd;
+    uint64_t raw_off;    // raw offset of the open block
+    uint64_t file_off;   // end of the last whole block
+    char* blk;
+    size_t blk_len;
+    time_t blk_t0;
+    }zlog_writer;
+
+// write the open block + its seek point
+static int zlog_block_out(zlog_writer* zl)
+    {
+    if (zl->blk_len == 0) {
+        return 0;
+        }
+    uLongf comp_len = compressBound((uLong)zl->blk_len);
+    Bytef* comp = malloc(comp_len);
+    if (!comp || compress2(comp, &comp_len, (const Bytef*)zl->blk, (uLong)zl->blk_len, ZLOG_LEVEL) != Z_OK) {
+        free(comp);
+        return -1;
+        }
+    zlog_seek s = { zl->raw_off, zl->file_off, (uint32_t)zl->blk_len, (uint32_t)comp_len };
+    // block first , the seek point only when the block is on disk
+    if (pwrite(zl->log_fd, comp, comp_len, (off_t)zl->file_off) != (ssize_t)comp_len ||
+        write(zl->idx_fd, &s, sizeof(s)) != (ssize_t)sizeof(s)) {
+        free(comp);
+        return -1;
+        }
+    free(comp);
+    zlog_st.blocks++;
+    zlog_st.raw_bytes += zl->blk_len;
+    zlog_st.comp_bytes += comp_len;
+    zl->raw_off += zl->blk_len;
+    zl->file_off += comp_len;
+    zl->blk_len = 0;
+    return 0;
+    }
+
+static ssize_t zlog_cookie_write(void* cookie, const char* buf, size_t size)
+    {
+    zlog_writer* zl = cookie;
+    size_t done = 0;
+    while (done < size) {
+        if (zl->blk_len == 0) {
+            zl->blk_t0 = time(NULL);
+            }
+        size_t take = ZLOG_BLOCK - zl->blk_len;
+        if (take > size - done) {
+            take = size - done;
+            }
+        memcpy(zl->blk + zl->blk_len, buf + done, take);
+        zl->blk_len += take;
+        done += take;
+        if (zl->blk_len == ZLOG_BLOCK && zlog_block_out(zl) < 0) {
+            return -1;
+            }
+        }
+    if (zl->blk_len > 0 && time(NULL) - zl->blk_t0 >= ZLOG_FLUSH_S && zlog_block_out(zl) < 0) {
+        return -1;
+        }
+    return (ssize_t)size;
+    }
+
+static int zlog_cookie_close(void* cookie)
+    {
+    zlog_writer* zl = cookie;
+    int r = zlog_block_out(zl);
+    close(zl->log_fd);
+    close(zl->idx_fd);
+    free(zl->blk);
+    free(zl);
+    return r;
+    }
+
+/*
+open base.zlog / base.zidx for append (created when missing)
+    *raw_end : raw size so far (offset of the next byte written)
+    return NULL : Error
+*/
+FILE* zlog_fopen(const char* base, long* raw_end)
+    {
+    char path[512];
+    zlog_writer* zl = calloc(1, sizeof(*zl));
+    if (!zl || !(zl->blk = malloc(ZLOG_BLOCK))) {
+        free(zl);
+        return NULL;
+        }
+    snprintf(path, sizeof(path), "%s.zlog", base);
+    zl->log_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    snprintf(path, sizeof(path), "%s.zidx", base);
+    zl->idx_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (zl->log_fd < 0 || zl->idx_fd < 0) {
+        goto fail;
+        }
+    // continue after the last whole block (a torn seek point / block is cut off)
+    struct stat st;
+    if (fstat(zl->idx_fd, &st) < 0) {
+        goto fail;
+        }
+    off_t n = st.st_size / (off_t)sizeof(zlog_seek);
+    if (n > 0) {
+        zlog_seek last;
+        if (pread(zl->idx_fd, &last, sizeof(last), (n - 1) * (off_t)sizeof(zlog_seek)) != (ssize_t)sizeof(last)) {
+            goto fail;
+            }
+        zl->raw_off = last.raw_off + last.raw_len;
+        zl->file_off = last.file_off + last.comp_len;
+        }
+    if (ftruncate(zl->idx_fd, n * (off_t)sizeof(zlog_seek)) < 0 || ftruncate(zl->log_fd, (off_t)zl->file_off) < 0 ||
+        lseek(zl->idx_fd, 0, SEEK_END) < 0) {
+        goto fail;
+        }
+    cookie_io_functions_t io = { .read = NULL, .write = zlog_cookie_write, .seek = NULL, .close = zlog_cookie_close };
+    FILE* f = fopencookie(zl, "w", io);
+    if (!f) {
+        goto fail;
+        }
+    *raw_end = (long)zl->raw_off;
+    return f;
+fail:
+    fprintf(stderr, "[%sError%s] | Compressed transcript %s : %s\n", FG_RED, RESET, base, strerror(errno));
+    if (zl->log_fd > 0) {
+        close(zl->log_fd);
+        }
+    if (zl->idx_fd > 0) {
+        close(zl->idx_fd);
+        }
+    free(zl->blk);
+    free(zl);
+    return NULL;
+    }
+
+void zlog_report()
+    {
+    if (zlog_st.blocks == 0) {
+        return;
+        }
+    printf("[%sZlog%s] blocks=%lu raw=%llu disk=%llu (%.1f%%)\n", FG_BCYAN, RESET, zlog_st.blocks, zlog_st.raw_bytes,
+        zlog_st.comp_bytes, 100.0 * (double)zlog_st.comp_bytes / (double)zlog_st.raw_bytes);
+    memset(&zlog_st, 0, sizeof(zlog_st));
+    }
+
+// ------------------------------ reader (random access) ------------------------------
+typedef struct zlog_reader {
+    int log_fd;
+    zlog_seek* seek;     // whole cli_N.zidx
+    size_t n_seek;
+    long cached;         // block in buf , -1 = none
+    char* buf;
+    }zlog_reader;
+
+/*
+open base.zlog for reads
+    return NULL : no compressed transcript there
+*/
+zlog_reader* zlog_reader_open(const char* base)
+    {
+    char path[512];
+    snprintf(path, sizeof(path), "%s.zidx", base);
+    int idx_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (idx_fd < 0) {
+        return NULL;
+        }
+    zlog_reader* zr = calloc(1, sizeof(*zr));
+    struct stat st;
+    if (!zr || fstat(idx_fd, &st) < 0) {
+        close(idx_fd);
+        free(zr);
+        return NULL;
+        }
+    zr->n_seek = (size_t)st.st_size / sizeof(zlog_seek);
+    zr->seek = malloc(zr->n_seek * sizeof(zlog_seek) + 1);
+    zr->buf = malloc(ZLOG_BLOCK);
+    snprintf(path, sizeof(path), "%s.zlog", base);
+    zr->log_fd = open(path, O_RDONLY | O_CLOEXEC);
+    zr->cached = -1;
+    ssize_t want = (ssize_t)(zr->n_seek * sizeof(zlog_seek));
+    bool ok = zr->seek && zr->buf && zr->log_fd >= 0 && pread(idx_fd, zr->seek, (size_t)want, 0) == want;
+    close(idx_fd);
+    if (!ok) {
+        if (zr->log_fd >= 0) {
+            close(zr->log_fd);
+            }
+        free(zr->seek);
+        free(zr->buf);
+        free(zr);
+        return NULL;
+        }
+    return zr;
+    }
+
+void zlog_reader_close(zlog_reader* zr)
+    {
+    if (!zr) {
+        return;
+        }
+    close(zr->log_fd);
+    free(zr->seek);
+    free(zr->buf);
+    free(zr);
+    }
+
+// inflate block b into buf (kept for the next read)
+static bool zlog_load(zlog_reader* zr, size_t b)
+    {
+    if (zr->cached == (long)b) {
+        return true;
+        }
+    zlog_seek* s = &zr->seek[b];
+    Bytef* comp = malloc(s->comp_len);
+    uLongf raw_len = ZLOG_BLOCK;
+    bool ok = comp && pread(zr->log_fd, comp, s->comp_len, (off_t)s->file_off) == (ssize_t)s->comp_len &&
+        uncompress((Bytef*)zr->buf, &raw_len, comp, s->comp_len) == Z_OK && raw_len == s->raw_len;
+    free(comp);
+    zr->cached = ok ? (long)b : -1;
+    return ok;
+    }
+
+/*
+like pread() on the raw transcript
+    return -1 : Error , 0 : offset not written (yet) , else bytes read
+*/
+ssize_t zlog_pread(zlog_reader* zr, char* out, size_t n, uint64_t off)
+    {
+    // last block which starts at or before off
+    size_t lo = 0, hi = zr->n_seek;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (zr->seek[mid].raw_off <= off) {
+            lo = mid + 1;
+            }
+        else {
+            hi = mid;
+            }
+        }
+    size_t got = 0;
+    // a msg can run over the end of its block
+    for (size_t b = lo ? lo - 1 : 0;b < zr->n_seek && got < n;b++) {
+        zlog_seek* s = &zr->seek[b];
+        uint64_t at = off + got;
+        if (at < s->raw_off || at >= s->raw_off + s->raw_len) {
+            break;
+            }
+        if (!zlog_load(zr, b)) {
+            return -1;
+            }
+        size_t in_blk = (size_t)(at - s->raw_off);
+        size_t take = s->raw_len - in_blk;
+        if (take > n - got) {
+            take = n - got;
+            }
+        memcpy(out + got, zr->buf + in_blk, take);
+        got += take;
+        }
+    return (ssize_t)got;
+    }
+#endif
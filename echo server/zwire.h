@@ -0,0 +1,294 @@
+#ifndef ZWIRE_H   // compressed wire mode : room trained preset dictionary , one deflate per room msg
+#define ZWIRE_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zlib.h>
+#include <sys/select.h>
+
+/*
+server <port> -Z turns it on , a client asks for it right after the handshake :
+    client -> "!?!?ZLIB <dict id>\n"        id of the dictionary it kept from an earlier connection (0 = none)
+    server -> on the data lane , in order with the chat :
+        "!?!?ZDICT <id> <len>\n" + len bytes   dictionary of the frames which follow (only when the client
+                                               does not have it yet)
+        "!?!?Z <len>\n" + len bytes            one room msg , raw deflate primed with the dictionary
+every msg is compressed alone (reset + dictionary) , so it is compressed once and the same bytes go to
+every capable recipient , and a frame never needs the frames before it . the FROM mark stays plain
+(it differs per recipient) . a msg goes as a Z frame only when the frame is smaller than the msg .
+dictionary : after ZDICT_FIRST_MSGS and then every ZDICT_TRAIN_MSGS room msgs it is trained again from the msgs in the delivery ring :
+    1. candidates = short whole lines and words (with their space) , counted in a hash table
+    2. score = (count - 1) x length , best ones go to the END of the dictionary (shortest distance)
+    3. the new dictionary is taken only when it compresses the newest msgs ZDICT_GAIN % better
+a client gets the dictionary once (ZDICT_MAX bytes) and keeps it over reconnects
+*/
+#define ZDICT_MAX        8192
+#define ZDICT_FIRST_MSGS 256            // first dictionary
+#define ZDICT_TRAIN_MSGS 2048
+#define ZDICT_SAMPLE     (256 * 1024)   // newest ring bytes a training looks at
+#define ZDICT_CANDS      16384          // candidate table (power of 2)
+#define ZDICT_EVAL_MSGS  256
+#define ZDICT_GAIN       5
+#define ZDICT_LINE_MAX   64             // whole lines up to this length are candidates
+#define ZW_MSG_MIN       12             // shorter msgs are not worth a frame header
+#define ZW_MSG_MAX       (64 * 1024)
+#define ZW_HDR_MAX       48
+
+typedef struct zw_cand {
+    const char* p;
+    uint32_t len;
+    uint32_t count;
+    uint64_t hash;
+    }zw_cand;
+
+typedef struct zwire {
+    bool enabled;
+    z_stream def;
+    uint8_t dict[ZDICT_MAX];
+    size_t dict_len;
+    uint32_t dict_id;             // 0 = no dictionary yet
+    unsigned long msgs_since_train;
+    // frame of the msg being fanned out
+    uint8_t* frame;               // header + deflate bytes
+    size_t frame_cap;
+    long frame_len;               // -1 = not made yet , 0 = msg goes plain
+    // per slot
+    bool cap[FD_SETSIZE];         // asked for Z frames
+    uint32_t have[FD_SETSIZE];    // dictionary id the client has
+    zw_cand cand[ZDICT_CANDS];
+    // counters since last report
+    unsigned long frames;         // made (once per msg)
+    unsigned long sent;           // fanned out
+    unsigned long long raw_bytes;  // of the sent frames
+    unsigned long long wire_bytes;
+    unsigned long dict_sends;
+    unsigned long trainings;
+    unsigned long dict_changes;
+    }zwire;
+
+/*
+    return -1 : Error [zlib]
+*/
+int zw_init(zwire* zw)
+    {
+    memset(&zw->def, 0, sizeof(zw->def));
+    // raw deflate (no zlib header / adler) , 32 KiB window , level 9 : bytes matter more than cpu here
+    if (deflateInit2(&zw->def, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "[%sError%s] | deflateInit2 failed\n", FG_RED, RESET);
+        return -1;
+        }
+    zw->frame_cap = ZW_HDR_MAX + deflateBound(&zw->def, ZW_MSG_MAX);
+    zw->frame = malloc(zw->frame_cap);
+    if (!zw->frame) {
+        return -1;
+        }
+    zw->enabled = true;
+    zw->frame_len = -1;
+    printf("%sCompression : Z frames for clients which ask , block compressed transcripts%s\n", FG_BGREEN, RESET);
+    return 0;
+    }
+
+// slot i finished the handshake (plain until it sends ZLIB)
+void zw_attach(zwire* zw, int i)
+    {
+    zw->cap[i] = false;
+    zw->have[i] = 0;
+    }
+
+/*
+deflate msg with dict into out (raw deflate)
+    return -1 : does not fit / zlib error , else bytes written
+*/
+static long zw_deflate(zwire* zw, const uint8_t* dict, size_t dict_len, const char* msg, size_t n, uint8_t* out, size_t cap)
+    {
+    deflateReset(&zw->def);
+    if (dict_len > 0) {
+        deflateSetDictionary(&zw->def, dict, (uInt)dict_len);
+        }
+    zw->def.next_in = (Bytef*)msg;
+    zw->def.avail_in = (uInt)n;
+    zw->def.next_out = out;
+    zw->def.avail_out = (uInt)cap;
+    if (deflate(&zw->def, Z_FINISH) != Z_STREAM_END) {
+        return -1;
+        }
+    return (long)(cap - zw->def.avail_out);
+    }
+
+// next msg of the fan out (its frame is made on the first capable recipient)
+static inline void zw_begin(zwire* zw)
+    {
+    zw->frame_len = -1;
+    }
+
+/*
+Z frame of the current msg , made once
+    return 0 : msg goes plain (short , long , or the frame is not smaller)
+*/
+long zw_frame(zwire* zw, const char* msg, size_t n)
+    {
+    if (zw->frame_len >= 0) {
+        return zw->frame_len;
+        }
+    zw->frame_len = 0;
+    if (n < ZW_MSG_MIN || n > ZW_MSG_MAX) {
+        return 0;
+        }
+    uint8_t* body = zw->frame + ZW_HDR_MAX;
+    long c = zw_deflate(zw, zw->dict, zw->dict_len, msg, n, body, zw->frame_cap - ZW_HDR_MAX);
+    if (c < 0) {
+        return 0;
+        }
+    char hdr[ZW_HDR_MAX];
+    int h = snprintf(hdr, sizeof(hdr), "!?!?Z %ld\n", c);
+    if ((size_t)(h + c) >= n) {
+        return 0;
+        }
+    // header right in front of the body , the frame is one piece
+    memcpy(body - h, hdr, (size_t)h);
+    memmove(zw->frame, body - h, (size_t)(h + c));
+    zw->frame_len = h + c;
+    zw->frames++;
+    return zw->frame_len;
+    }
+
+// header of the dictionary frame for slot i (len 0 = no dictionary) , 0 = the client has it already
+int zw_dict_header(zwire* zw, int i, char* out, size_t cap)
+    {
+    if (zw->have[i] == zw->dict_id) {
+        return 0;
+        }
+    zw->have[i] = zw->dict_id;
+    zw->dict_sends++;
+    return snprintf(out, cap, "!?!?ZDICT %x %zu\n", zw->dict_id, zw->dict_len);
+    }
+
+static uint64_t zw_hash(const char* p, size_t n)
+    {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t k = 0;k < n;k++) {
+        h = (h ^ (unsigned char)p[k]) * 1099511628211ULL;
+        }
+    return h;
+    }
+
+static void zw_count(zwire* zw, const char* p, size_t n)
+    {
+    uint64_t h = zw_hash(p, n);
+    for (uint32_t probe = 0;probe < 64;probe++) {
+        zw_cand* c = &zw->cand[(h + probe) & (ZDICT_CANDS - 1)];
+        if (c->count == 0) {
+            *c = (zw_cand){ .p = p, .len = (uint32_t)n, .count = 1, .hash = h };
+            return;
+            }
+        if (c->hash == h && c->len == n && memcmp(c->p, p, n) == 0) {
+            c->count++;
+            return;
+            }
+        }
+    }
+
+static int zw_cand_cmp(const void* a, const void* b)
+    {
+    const zw_cand* x = a;
+    const zw_cand* y = b;
+    long long sx = (x->count > 1) ? (long long)(x->count - 1) * x->len : 0;
+    long long sy = (y->count > 1) ? (long long)(y->count - 1) * y->len : 0;
+    return (sx < sy) - (sx > sy);
+    }
+
+// bytes of the msgs compressed alone with dict
+static size_t zw_cost(zwire* zw, const uint8_t* dict, size_t dict_len, const char* const* msg, const size_t* len, int n)
+    {
+    static uint8_t out[ZW_HDR_MAX + 2 * ZW_MSG_MAX];
+    size_t total = 0;
+    for (int k = 0;k < n;k++) {
+        long c = (len[k] <= ZW_MSG_MAX) ? zw_deflate(zw, dict, dict_len, msg[k], len[k], out, sizeof(out)) : -1;
+        total += (c < 0 || (size_t)c >= len[k]) ? len[k] : (size_t)c;
+        }
+    return total;
+    }
+
+/*
+train a dictionary from the recent room (msg[0] = oldest) and take it when it is better
+    return true : dictionary changed
+*/
+bool zw_train(zwire* zw, const char* const* msg, const size_t* len, int n)
+    {
+    zw->msgs_since_train = 0;
+    zw->trainings++;
+    memset(zw->cand, 0, sizeof(zw->cand));
+    for (int k = 0;k < n;k++) {
+        const char* p = msg[k];
+        size_t l = len[k];
+        if (l <= ZDICT_LINE_MAX) {
+            zw_count(zw, p, l);
+            }
+        // words with the space after them
+        for (size_t s = 0;s < l;) {
+            size_t e = s;
+            while (e < l && p[e] != ' ' && p[e] != '\n') {
+                e++;
+                }
+            if (e < l) {
+                e++;
+                }
+            if (e - s >= 3 && e - s <= 32) {
+                zw_count(zw, p + s, e - s);
+                }
+            s = e;
+            }
+        }
+    qsort(zw->cand, ZDICT_CANDS, sizeof(zw_cand), zw_cand_cmp);
+    // best candidate last , filled from the end
+    uint8_t dict[ZDICT_MAX];
+    size_t at = ZDICT_MAX;
+    for (int k = 0;k < ZDICT_CANDS && zw->cand[k].count > 1;k++) {
+        zw_cand* c = &zw->cand[k];
+        if (c->len > at) {
+            continue;
+            }
+        // already in the dictionary as part of a better candidate
+        if (memmem(dict + at, ZDICT_MAX - at, c->p, c->len)) {
+            continue;
+            }
+        at -= c->len;
+        memcpy(dict + at, c->p, c->len);
+        }
+    size_t dict_len = ZDICT_MAX - at;
+    if (dict_len == 0) {
+        return false;
+        }
+    int eval = (n < ZDICT_EVAL_MSGS) ? n : ZDICT_EVAL_MSGS;
+    size_t old_cost = zw_cost(zw, zw->dict, zw->dict_len, msg + n - eval, len + n - eval, eval);
+    size_t new_cost = zw_cost(zw, dict + at, dict_len, msg + n - eval, len + n - eval, eval);
+    if (new_cost * 100 > old_cost * (100 - ZDICT_GAIN)) {
+        return false;
+        }
+    memcpy(zw->dict, dict + at, dict_len);
+    zw->dict_len = dict_len;
+    zw->dict_id = (uint32_t)zw_hash((const char*)zw->dict, dict_len) | 1u;
+    zw->dict_changes++;
+    printf("[%sZlib%s] new room dictionary %x (%zu bytes) : %zu -> %zu bytes on the last %d msgs\n",
+        FG_BCYAN, RESET, zw->dict_id, dict_len, old_cost, new_cost, eval);
+    return true;
+    }
+
+void zw_report(zwire* zw)
+    {
+    if (!zw->enabled) {
+        return;
+        }
+    int caps = 0;
+    for (int i = 0;i < FD_SETSIZE;i++) {
+        caps += zw->cap[i];
+        }
+    printf("[%sZlib%s] clients=%d dict=%x (%zu bytes) frames=%lu sent=%lu raw=%llu wire=%llu (%.1f%%) dict_sends=%lu trainings=%lu changes=%lu\n",
+        FG_BCYAN, RESET, caps, zw->dict_id, zw->dict_len, zw->frames, zw->sent, zw->raw_bytes, zw->wire_bytes,
+        zw->raw_bytes ? 100.0 * (double)zw->wire_bytes / (double)zw->raw_bytes : 0.0, zw->dict_sends, zw->trainings, zw->dict_changes);
+    zw->frames = zw->sent = zw->dict_sends = zw->trainings = zw->dict_changes = 0;
+    zw->raw_bytes = zw->wire_bytes = 0;
+    }
+#endif